@@ -0,0 +1,157 @@
+
+#include "stdafx.h"
+#include "AllocationCounter.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+bool AllocationCounter::s_enabled = false;
+
+// Plain data, so neither is constructed or destroyed on a path that may allocate
+static std::atomic<uint64_t> s_allocations;
+static std::atomic<uint64_t> s_bytes;
+static std::atomic<uint64_t> s_frees;
+
+static thread_local allocation_count t_count;
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+//
+//   enable
+//
+
+void AllocationCounter::enable()
+{
+    s_enabled = true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+//
+//   thread
+//
+
+allocation_count AllocationCounter::thread()
+{
+    return t_count;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+//
+//   total
+//
+
+allocation_count AllocationCounter::total()
+{
+    allocation_count c;
+    c.allocations = s_allocations.load(std::memory_order_relaxed);
+    c.bytes = s_bytes.load(std::memory_order_relaxed);
+    c.frees = s_frees.load(std::memory_order_relaxed);
+    return c;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+//
+//   allocated
+//
+
+void AllocationCounter::allocated(size_t bytes)
+{
+    t_count.allocations++;
+    t_count.bytes += bytes;
+
+    s_allocations.fetch_add(1, std::memory_order_relaxed);
+    s_bytes.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+//
+//   freed
+//
+
+void AllocationCounter::freed()
+{
+    t_count.frees++;
+
+    s_frees.fetch_add(1, std::memory_order_relaxed);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+//
+//   Global operator new and delete
+//
+//   The sized and array forms forward here, the aligned forms are left to the library
+//
+
+void* operator new(size_t size)
+{
+    if (AllocationCounter::s_enabled) {
+        AllocationCounter::allocated(size);
+    }
+
+    void* p = malloc((size > 0) ? size : 1);
+
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    if (AllocationCounter::s_enabled) {
+        AllocationCounter::allocated(size);
+    }
+    return malloc((size > 0) ? size : 1);
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t& tag) noexcept
+{
+    return operator new(size, tag);
+}
+
+void operator delete(void* p) noexcept
+{
+    if (p == nullptr) {
+        return;
+    }
+    if (AllocationCounter::s_enabled) {
+        AllocationCounter::freed();
+    }
+    free(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept
+{
+    operator delete(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    operator delete(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    operator delete(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept
+{
+    operator delete(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+    operator delete(p);
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+* AllocationCounter:
+*
+* Counts calls of the global operator new and delete, which AllocationCounter.cpp replaces. Counting
+* is off until enable(), the hooks then add to counters of the calling thread and to totals of every
+* thread. The difference of two reads is what the code in between allocated: TraceZone stores it
+* with each zone, the frame loop checks it per frame (-allocs).
+*
+* The hooks call malloc and free directly, counting itself never allocates.
+*/
+
+struct allocation_count {
+    uint64_t allocations;
+    uint64_t bytes;
+    uint64_t frees;
+};
+
+class AllocationCounter
+{
+public:
+
+    // Tested by every hook, set once before the first frame
+    static bool s_enabled;
+
+    static void enable();
+
+    // Counts of the calling thread
+    static allocation_count thread();
+
+    // Counts of every thread
+    static allocation_count total();
+
+    // Called by the hooks
+    static void allocated(size_t bytes);
+    static void freed();
+};
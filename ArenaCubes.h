@@ -1,13 +1,22 @@
 
 #pragma once
+#include <algorithm>
 #include <cmath>
 #include <vector>
 #include <random>
+#include <cstdint>
 
 struct instance_data {
     float data[4];
 };
 
+// Quantized instance record (-compact). pos is the position at the tile reference time in
+// steps from the tile origin, vel the velocity in units per second as half floats.
+struct compact_instance_data {
+    int16_t pos[2];
+    uint16_t vel[2];
+};
+
 struct arena_vertex {
     float position[3];
     float colorRGBA[4];
@@ -170,8 +179,25 @@ static void create_single_cube(std::vector<arena_vertex>& lcVertex)
 
 }
 
+// Radius of the sphere around the instance origin that holds every vertex, the culling bound of an instance
+static float bounding_radius(const std::vector<arena_vertex>& lcVertex)
+{
+    float r2 = 0.f;
+
+    for (const arena_vertex& v : lcVertex)
+    {
+        r2 = std::max(r2, v.position[0] * v.position[0] + v.position[1] * v.position[1] + v.position[2] * v.position[2]);
+    }
 
-static void create_cube_arena(std::vector<arena_vertex>& lcVertex)
+    // The sum and sqrt round to nearest, one ulp up keeps the bound conservative
+    return std::nextafter(std::sqrt(r2), HUGE_VALF);
+}
+
+
+// Rays of cubes around the arena center
+#define ARENA_RAY_COUNT 5010
+
+static void create_cube_arena(std::vector<arena_vertex>& lcVertex, uint32_t nRay = ARENA_RAY_COUNT)
 {
     const float x_0 = -1.0f;
     const float y_0 = -1.f;
@@ -187,14 +213,11 @@ static void create_cube_arena(std::vector<arena_vertex>& lcVertex)
 
     std::uniform_int_distribution<> skip_dis(0, 10);
 
-    // Num rays
-    const int NUM_RAY = 5010;
-
     const float R_FILL_CIRCLE = 0.95f;
 
-    const float rSectorSize = R_FILL_CIRCLE * 1.f / NUM_RAY;
+    const float rSectorSize = R_FILL_CIRCLE * 1.f / nRay;
 
-    for (uint32_t iRay = 0; iRay < NUM_RAY; iRay++)
+    for (uint32_t iRay = 0; iRay < nRay; iRay++)
     {
 
         const float PI = 3.1415927f;
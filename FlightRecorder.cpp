@@ -0,0 +1,79 @@
+
+#include "stdafx.h"
+#include "FlightRecorder.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+//
+//   FlightRecorder
+//
+//   Constructor
+//
+
+FlightRecorder::FlightRecorder(double thresholdMs, const std::string& prefix)
+{
+    _thresholdMs = thresholdMs;
+    _prefix = prefix;
+
+    if (!Trace::s_enabled) {
+        Trace::enable();
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+//
+//   frame
+//
+
+void FlightRecorder::frame(double ms)
+{
+    Trace::counter("frame ms", ms);
+
+    _frames++;
+
+    uint64_t now = Trace::now();
+
+    if ((ms > _thresholdMs) && (_frames > FLIGHTRECORDER_WARMUP_FRAMES)) {
+        Trace::instant("hitch", ms);
+
+        if (_hitch == 0) {
+            _hitch = now;
+        }
+        _hitchMs = std::max(_hitchMs, ms);
+    }
+
+    if ((_hitch == 0) || (now - _hitch < uint64_t(FLIGHTRECORDER_AFTER_MS) * 1000000)) {
+        return;
+    }
+
+    if (_dumps < FLIGHTRECORDER_MAX_DUMPS) {
+        // The hitch frame began ms before it was detected
+        uint64_t window = uint64_t(FLIGHTRECORDER_WINDOW_MS + _hitchMs) * 1000000;
+        uint64_t from = (_hitch > window) ? _hitch - window : 0;
+
+        std::string filename = _prefix + std::to_string(_dumps) + ".json";
+
+        std::vector<trace_thread> lcThread;
+        Trace::collect(lcThread, from);
+
+        double hitchMs = _hitchMs;
+
+        _writer.addJob([filename, hitchMs, lcThread = std::move(lcThread)] {
+            if (Trace::write(filename, lcThread)) {
+                std::cout << "Frame of " << std::fixed << std::setprecision(1) << hitchMs << " ms, trace written to " << filename << std::endl;
+            }
+            else {
+                std::cerr << "Could not write " << filename << std::endl;
+            }
+        });
+        _dumps++;
+    }
+
+    _hitch = 0;
+    _hitchMs = 0.0;
+}
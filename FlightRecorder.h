@@ -0,0 +1,58 @@
+#pragma once
+
+
+#include "Trace.h"
+#include "threadpool.hpp"
+
+#include <cstdint>
+#include <string>
+
+/*
+* FlightRecorder:
+*
+* Keeps tracing on and writes the trace around a frame that took longer than a threshold. The
+* trace rings hold the recent zones of every thread, so a dump shows what the simulation, the
+* uploads and the Vulkan waits were doing before the hitch. The dump is written
+* FLIGHTRECORDER_AFTER_MS after the hitch to include its aftermath, and covers
+* FLIGHTRECORDER_WINDOW_MS before it, as far as the rings reach back.
+*
+* Each frame adds its time as the "frame ms" counter and a hitch adds a "hitch" instant, both show
+* in the dump next to the zones. Files are named <prefix><n>.json, at most FLIGHTRECORDER_MAX_DUMPS
+* per run.
+*
+* The frame only copies the trace rings, the JSON is written by a thread of the recorder's own so
+* a dump neither stalls the frame nor waits behind command buffer recording on the shared pool.
+*/
+
+// Trace kept before a hitch
+#define FLIGHTRECORDER_WINDOW_MS 3000
+// Trace kept after a hitch, further hitches in this time go into the same dump
+#define FLIGHTRECORDER_AFTER_MS 250
+// Startup frames compile pipelines and fill caches, they are not hitches
+#define FLIGHTRECORDER_WARMUP_FRAMES 30
+#define FLIGHTRECORDER_MAX_DUMPS 8
+
+class FlightRecorder
+{
+private:
+    double _thresholdMs;
+    std::string _prefix;
+
+    uint64_t _frames = 0;
+    uint32_t _dumps = 0;
+
+    // Time of the first hitch waiting for its dump, 0 if none
+    uint64_t _hitch = 0;
+    double _hitchMs = 0.0;
+
+    // Writes the dumps in order. Declared last, so it finishes pending dumps before the rest is destroyed
+    vks::Thread _writer;
+
+public:
+
+    // Enables tracing
+    FlightRecorder(double thresholdMs, const std::string& prefix);
+
+    // Call at the end of every frame with its CPU time
+    void frame(double ms);
+};
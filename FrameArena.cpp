@@ -0,0 +1,188 @@
+
+#include "stdafx.h"
+#include "FrameArena.h"
+#include "MemoryAccounting.h"
+
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+//
+//   FrameArena
+//
+//   Constructor
+//
+
+FrameArena::FrameArena(uint32_t slotCount, size_t slotBytes)
+{
+    // Slots start aligned, operator new aligns each block for any fundamental type
+    slotBytes = (slotBytes + FRAMEARENA_ALIGNMENT - 1) & ~size_t(FRAMEARENA_ALIGNMENT - 1);
+    _slotCount = std::max(slotCount, 1u);
+
+    _lcBlock.resize(_slotCount);
+    _lcSlotBytes.assign(_slotCount, slotBytes);
+    _lcSlotUsed.assign(_slotCount, 0);
+    _lcOverflow.resize(_slotCount);
+
+    for (std::unique_ptr<char[]>& block : _lcBlock) {
+        block.reset(new char[slotBytes]);
+    }
+
+    _offset.store(0, std::memory_order_relaxed);
+    _overflows.store(0, std::memory_order_relaxed);
+}
+
+FrameArena::~FrameArena()
+{
+    for (std::vector<void*>& lcBlock : _lcOverflow) {
+        for (void* p : lcBlock) {
+            ::operator delete(p);
+        }
+    }
+
+    for (size_t used : _lcSlotUsed) {
+        MemoryAccounting::freed(MEMORY_HOST, MEMORY_FRAME, used);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+//
+//   allocate
+//
+
+void* FrameArena::allocate(size_t bytes, size_t alignment)
+{
+    // Sizes are rounded up so the next allocation starts aligned too
+    size_t padding = (alignment > FRAMEARENA_ALIGNMENT) ? alignment - FRAMEARENA_ALIGNMENT : 0;
+    size_t size = (bytes + padding + FRAMEARENA_ALIGNMENT - 1) & ~size_t(FRAMEARENA_ALIGNMENT - 1);
+
+    size_t offset = _offset.fetch_add(size, std::memory_order_relaxed);
+
+    if (offset + size > _lcSlotBytes[_slot]) {
+        return overflow(bytes, alignment);
+    }
+
+    uintptr_t p = reinterpret_cast<uintptr_t>(_lcBlock[_slot].get() + offset);
+
+    if (padding > 0) {
+        p = (p + alignment - 1) & ~uintptr_t(alignment - 1);
+    }
+    return reinterpret_cast<void*>(p);
+}
+
+void* FrameArena::overflow(size_t bytes, size_t alignment)
+{
+    _overflows.fetch_add(1, std::memory_order_relaxed);
+
+    // operator new aligns for fundamental types only, larger alignments are rounded up within the
+    // block. The list keeps the pointer operator new returned
+    alignment = std::max(alignment, size_t(FRAMEARENA_ALIGNMENT));
+    void* p = ::operator new(bytes + alignment - 1);
+
+    {
+        std::lock_guard<std::mutex> lock(_overflowMutex);
+        _lcOverflow[_slot].push_back(p);
+    }
+
+    uintptr_t aligned = (reinterpret_cast<uintptr_t>(p) + alignment - 1) & ~uintptr_t(alignment - 1);
+    return reinterpret_cast<void*>(aligned);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+//
+//   format
+//
+
+const char* FrameArena::format(const char* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+
+    va_list copy;
+    va_copy(copy, args);
+    int length = std::max(vsnprintf(nullptr, 0, format, copy), 0);
+    va_end(copy);
+
+    char* p = static_cast<char*>(allocate(size_t(length) + 1, 1));
+    vsnprintf(p, size_t(length) + 1, format, args);
+
+    va_end(args);
+    return p;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+//
+//   endFrame
+//
+
+void FrameArena::endFrame()
+{
+    size_t used = this->used();
+
+    _highWater = std::max(_highWater, used);
+    _demand = std::max(_demand, _offset.load(std::memory_order_relaxed));
+
+    // Only the bytes a frame wrote to are charged, the rest of the slot is reserved address space
+    if (used > _lcSlotUsed[_slot]) {
+        MemoryAccounting::allocated(MEMORY_HOST, MEMORY_FRAME, used - _lcSlotUsed[_slot]);
+        _lcSlotUsed[_slot] = used;
+    }
+
+    _slot = (_slot + 1) % _slotCount;
+    _offset.store(0, std::memory_order_relaxed);
+
+    // Nothing in the slot is live anymore, it can grow to what the busiest frame asked for
+    if (_demand > _lcSlotBytes[_slot]) {
+        size_t slotBytes = FRAMEARENA_ALIGNMENT;
+        while (slotBytes < _demand) {
+            slotBytes *= 2;
+        }
+
+        _lcBlock[_slot].reset(new char[slotBytes]);
+        _lcSlotBytes[_slot] = slotBytes;
+
+        MemoryAccounting::freed(MEMORY_HOST, MEMORY_FRAME, _lcSlotUsed[_slot]);
+        _lcSlotUsed[_slot] = 0;
+    }
+
+    std::vector<void*>& lcBlock = _lcOverflow[_slot];
+
+    // Overflows are rare, a frame without one costs the empty check only
+    if (!lcBlock.empty()) {
+        for (void* p : lcBlock) {
+            ::operator delete(p);
+        }
+        lcBlock.clear();
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+//
+//   statistics
+//
+
+size_t FrameArena::used() const
+{
+    return std::min(_offset.load(std::memory_order_relaxed), _lcSlotBytes[_slot]);
+}
+
+size_t FrameArena::highWater() const
+{
+    return std::max(_highWater, used());
+}
+
+size_t FrameArena::slotBytes() const
+{
+    return _lcSlotBytes[_slot];
+}
+
+uint64_t FrameArena::overflows() const
+{
+    return _overflows.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/*
+* FrameArena:
+*
+* Bump allocator for data that lives no longer than a frame. A frame allocates from its slot by
+* advancing an offset. endFrame() moves to the next slot and rewinds it, which releases everything
+* that slot held at once. There is one slot per frame in flight. Memory a frame hands to work that
+* finishes later, such as jobs still running on the thread pool, stays valid until the slot comes
+* around again.
+*
+* allocate() may be called from several threads; the offset is advanced atomically. endFrame() must
+* not run while other threads allocate. Requests that do not fit the slot go to the heap, are counted
+* as overflows and are freed when their slot is rewound.
+*
+* Slots start at the size given to the constructor and grow when they are rewound, to the next power
+* of two of the most bytes a frame asked for, overflows included. Memory accounting is charged for
+* the bytes frames actually used in each slot, not for the reserved size.
+*/
+
+// Alignment of every allocation, larger alignments are padded
+#define FRAMEARENA_ALIGNMENT 16
+
+class FrameArena
+{
+private:
+    // Block, size and bytes used at most of each slot
+    std::vector<std::unique_ptr<char[]>> _lcBlock;
+    std::vector<size_t> _lcSlotBytes;
+    std::vector<size_t> _lcSlotUsed;
+    uint32_t _slotCount;
+    uint32_t _slot = 0;
+
+    // Bytes requested by the current frame, overflows included
+    std::atomic<size_t> _offset;
+    size_t _highWater = 0;
+    size_t _demand = 0;
+
+    // Heap blocks of each slot's overflows
+    std::mutex _overflowMutex;
+    std::vector<std::vector<void*>> _lcOverflow;
+    std::atomic<uint64_t> _overflows;
+
+    void* overflow(size_t bytes, size_t alignment);
+
+public:
+
+    // slotBytes is the initial size of a slot
+    FrameArena(uint32_t slotCount, size_t slotBytes);
+    ~FrameArena();
+
+    FrameArena(const FrameArena&) = delete;
+    FrameArena& operator=(const FrameArena&) = delete;
+
+    void* allocate(size_t bytes, size_t alignment = FRAMEARENA_ALIGNMENT);
+
+    // Uninitialized storage for n objects of T
+    template <class T>
+    T* allocate(size_t n)
+    {
+        return static_cast<T*>(allocate(n * sizeof(T), alignof(T)));
+    }
+
+    // Formats like printf into the current slot
+    const char* format(const char* format, ...);
+
+    // Rewinds the next slot and makes it current
+    void endFrame();
+
+    // Bytes the current frame allocated so far, overflows excluded
+    size_t used() const;
+    // Most bytes any frame has used
+    size_t highWater() const;
+    // Size of the current slot
+    size_t slotBytes() const;
+    // Allocations that did not fit their slot
+    uint64_t overflows() const;
+};
+
+// Standard allocator over a FrameArena. deallocate() does nothing, so a container using it must not
+// outlive the frame. Converts from FrameArena* so containers can be constructed with the arena
+template <class T>
+class FrameAllocator
+{
+private:
+    FrameArena* _arena;
+
+public:
+    typedef T value_type;
+
+    template <class U>
+    struct rebind {
+        typedef FrameAllocator<U> other;
+    };
+
+    FrameAllocator(FrameArena* arena) noexcept : _arena(arena) {}
+
+    template <class U>
+    FrameAllocator(const FrameAllocator<U>& other) noexcept : _arena(other.arena()) {}
+
+    T* allocate(size_t n)
+    {
+        return _arena->allocate<T>(n);
+    }
+
+    void deallocate(T*, size_t) noexcept
+    {
+    }
+
+    FrameArena* arena() const
+    {
+        return _arena;
+    }
+};
+
+template <class T, class U>
+bool operator==(const FrameAllocator<T>& a, const FrameAllocator<U>& b) { return a.arena() == b.arena(); }
+
+template <class T, class U>
+bool operator!=(const FrameAllocator<T>& a, const FrameAllocator<U>& b) { return a.arena() != b.arena(); }
+
+template <class T>
+using frame_vector = std::vector<T, FrameAllocator<T>>;
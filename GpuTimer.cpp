@@ -0,0 +1,148 @@
+
+#include "stdafx.h"
+#include "GpuTimer.h"
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+//
+//   supported
+//
+//   The command buffers run on the graphics queue
+//
+
+bool GpuTimer::supported(vks::VulkanDevice* vulkanDevice)
+{
+    const uint32_t family = vulkanDevice->queueFamilyIndices.graphics;
+
+    return (vulkanDevice->properties.limits.timestampPeriod > 0.0f) &&
+        (vulkanDevice->queueFamilyProperties[family].timestampValidBits > 0);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+//
+//   GpuTimer
+//
+//   Constructor
+//
+
+GpuTimer::GpuTimer(vks::VulkanDevice* vulkanDevice, uint32_t imageCount)
+{
+    this->_vulkanDevice = vulkanDevice;
+
+    const uint32_t validBits = vulkanDevice->queueFamilyProperties[vulkanDevice->queueFamilyIndices.graphics].timestampValidBits;
+
+    _period = double(vulkanDevice->properties.limits.timestampPeriod);
+    _mask = (validBits >= 64) ? UINT64_MAX : ((uint64_t(1) << validBits) - 1);
+
+    _lcSubmitted.assign(imageCount, false);
+
+    // A value and an availability word per timestamp
+    _lcResult.resize(GPU_TIMESTAMP_COUNT * 2);
+
+    for (double& ms : _ms) {
+        ms = 0.0;
+    }
+
+    VkQueryPoolCreateInfo queryPoolInfo = {};
+    queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    queryPoolInfo.queryCount = imageCount * GPU_TIMESTAMP_COUNT;
+
+    VK_CHECK_RESULT(vkCreateQueryPool(vulkanDevice->logicalDevice, &queryPoolInfo, nullptr, &_queryPool));
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+//
+//   ~GpuTimer
+//
+
+GpuTimer::~GpuTimer()
+{
+    vkDestroyQueryPool(_vulkanDevice->logicalDevice, _queryPool, nullptr);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+//
+//   recordReset
+//
+
+void GpuTimer::recordReset(VkCommandBuffer cmdBuffer, uint32_t iImage)
+{
+    vkCmdResetQueryPool(cmdBuffer, _queryPool, iImage * GPU_TIMESTAMP_COUNT, GPU_TIMESTAMP_COUNT);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+//
+//   recordWrite
+//
+
+void GpuTimer::recordWrite(VkCommandBuffer cmdBuffer, uint32_t iImage, gpu_timestamp t, VkPipelineStageFlagBits stage)
+{
+    vkCmdWriteTimestamp(cmdBuffer, stage, _queryPool, iImage * GPU_TIMESTAMP_COUNT + t);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+//
+//   submitted
+//
+
+void GpuTimer::submitted(uint32_t iImage)
+{
+    _lcSubmitted[iImage] = true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+//
+//   read
+//
+//   Without VK_QUERY_RESULT_WAIT_BIT the call returns VK_NOT_READY instead of blocking, the
+//   availability words tell which timestamps were written
+//
+
+bool GpuTimer::read(uint32_t iImage)
+{
+    if (!_lcSubmitted[iImage]) {
+        return false;
+    }
+
+    VkResult result = vkGetQueryPoolResults(
+        _vulkanDevice->logicalDevice,
+        _queryPool,
+        iImage * GPU_TIMESTAMP_COUNT,
+        GPU_TIMESTAMP_COUNT,
+        _lcResult.size() * sizeof(uint64_t),
+        _lcResult.data(),
+        2 * sizeof(uint64_t),
+        VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+
+    if ((result != VK_SUCCESS) && (result != VK_NOT_READY)) {
+        VK_CHECK_RESULT(result);
+    }
+
+    for (uint32_t t = 0; t < GPU_TIMESTAMP_COUNT; ++t) {
+        if (_lcResult[t * 2 + 1] == 0) {
+            return false;
+        }
+    }
+
+    _lcSubmitted[iImage] = false;
+
+    auto ms = [this](gpu_timestamp t0, gpu_timestamp t1) {
+        // Masked difference, correct across a wrap of the counter
+        uint64_t ticks = (_lcResult[t1 * 2] - _lcResult[t0 * 2]) & _mask;
+        return double(ticks) * _period / 1000000.0;
+    };
+
+    _ms[GPU_PASS_COMPUTE] = ms(GPU_TIMESTAMP_BEGIN, GPU_TIMESTAMP_COMPUTE);
+    _ms[GPU_PASS_ROBOTS] = ms(GPU_TIMESTAMP_COMPUTE, GPU_TIMESTAMP_ROBOTS);
+    _ms[GPU_PASS_TEXT] = ms(GPU_TIMESTAMP_ROBOTS, GPU_TIMESTAMP_END);
+    _ms[GPU_PASS_TOTAL] = ms(GPU_TIMESTAMP_BEGIN, GPU_TIMESTAMP_END);
+
+    return true;
+}
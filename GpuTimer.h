@@ -0,0 +1,83 @@
+#pragma once
+
+
+#include <vulkan/vulkan.h>
+#include "VulkanDevice.hpp"
+
+#include <vector>
+
+/*
+* GpuTimer:
+*
+* Timestamp queries around the passes of every swap chain image's command buffer. Each image has
+* its own range of the query pool, written when its command buffer executes. The results are read
+* once the image's fence has been waited for in acquireFrame(), which happens again when the image
+* comes round, so the read never stalls.
+*
+* Timestamps of an image, a pass is the time between two neighbours:
+*   GPU_TIMESTAMP_BEGIN     start of the command buffer
+*   GPU_TIMESTAMP_COMPUTE   after the simulation and cull dispatches
+*   GPU_TIMESTAMP_ROBOTS    after the render pass clear and the robot draws
+*   GPU_TIMESTAMP_END       after the text overlay and the end of the render pass
+*/
+
+enum gpu_timestamp {
+    GPU_TIMESTAMP_BEGIN,
+    GPU_TIMESTAMP_COMPUTE,
+    GPU_TIMESTAMP_ROBOTS,
+    GPU_TIMESTAMP_END,
+    GPU_TIMESTAMP_COUNT
+};
+
+// Passes measured between the timestamps, followed by the whole command buffer
+enum gpu_pass {
+    GPU_PASS_COMPUTE,
+    GPU_PASS_ROBOTS,
+    GPU_PASS_TEXT,
+    GPU_PASS_TOTAL,
+    GPU_PASS_COUNT
+};
+
+class GpuTimer
+{
+private:
+    vks::VulkanDevice* _vulkanDevice;
+
+    VkQueryPool _queryPool;
+
+    // ns per timestamp tick
+    double _period;
+    // Timestamps wrap at timestampValidBits
+    uint64_t _mask;
+
+    // Per image, set when its command buffer has been submitted since the last read
+    std::vector<bool> _lcSubmitted;
+
+    // Timestamps and availability words of one image, see read()
+    std::vector<uint64_t> _lcResult;
+
+public:
+
+    // Pass times in ms of the last image read
+    double _ms[GPU_PASS_COUNT];
+
+    // Returns false if the graphics queue family does not support timestamps
+    static bool supported(vks::VulkanDevice* vulkanDevice);
+
+    GpuTimer(vks::VulkanDevice* vulkanDevice, uint32_t imageCount);
+
+    ~GpuTimer();
+
+    // Resets the image's queries, must be recorded outside a render pass before any write()
+    void recordReset(VkCommandBuffer cmdBuffer, uint32_t iImage);
+
+    // Writes timestamp t of the image after all previously recorded commands reach stage
+    void recordWrite(VkCommandBuffer cmdBuffer, uint32_t iImage, gpu_timestamp t, VkPipelineStageFlagBits stage);
+
+    // Call after the image's command buffer has been submitted
+    void submitted(uint32_t iImage);
+
+    // Reads the image's results into _ms without waiting. Returns false if the image has not been
+    // submitted since the last read or its results are not available yet
+    bool read(uint32_t iImage);
+};
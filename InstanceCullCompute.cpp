@@ -0,0 +1,230 @@
+
+
+#include "stdafx.h"
+#include "InstanceCullCompute.h"
+
+#include "ArenaCubes.h"
+
+#include <array>
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+//
+//   InstanceCullCompute
+//
+//   Constructor
+//
+
+InstanceCullCompute::InstanceCullCompute(
+    vks::VulkanDevice* vulkanDevice,
+    VkPipelineCache pipelineCache,
+    VkBuffer instanceBuffer,
+    uint32_t instanceCount,
+    uint32_t indexCount,
+    float radius,
+    VkDescriptorBufferInfo uboDescriptor,
+    VkPipelineShaderStageCreateInfo shaderStage)
+{
+    this->_vulkanDevice = vulkanDevice;
+
+    _params.count = instanceCount;
+    _params.radius = radius;
+
+    _indirectReset.indexCount = indexCount;
+    _indirectReset.instanceCount = 0;
+    _indirectReset.firstIndex = 0;
+    _indirectReset.vertexOffset = 0;
+    _indirectReset.firstInstance = 0;
+
+    prepareResources();
+    prepareDescriptors(instanceBuffer, uboDescriptor);
+    preparePipeline(pipelineCache, shaderStage);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+//
+//   ~InstanceCullCompute
+//
+
+InstanceCullCompute::~InstanceCullCompute()
+{
+    VkDevice device = _vulkanDevice->logicalDevice;
+
+    vkDestroyPipeline(device, _pipeline, nullptr);
+    vkDestroyPipelineLayout(device, _pipelineLayout, nullptr);
+    vkDestroyDescriptorSetLayout(device, _descriptorSetLayout, nullptr);
+    vkDestroyDescriptorPool(device, _descriptorPool, nullptr);
+
+    vkDestroyBuffer(device, _visibleBuffer, nullptr);
+    vks::memory::freeMemory(device, _visibleMemory);
+    vkDestroyBuffer(device, _indirectBuffer, nullptr);
+    vks::memory::freeMemory(device, _indirectMemory);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+//
+//   prepareResources
+//
+//   Both buffers are device local and only ever written by the GPU
+//
+
+void InstanceCullCompute::prepareResources()
+{
+    VK_CHECK_RESULT(_vulkanDevice->createBuffer(
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        _params.count * sizeof(instance_data),
+        &_visibleBuffer,
+        &_visibleMemory));
+
+    VK_CHECK_RESULT(_vulkanDevice->createBuffer(
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        sizeof(VkDrawIndexedIndirectCommand),
+        &_indirectBuffer,
+        &_indirectMemory));
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+//
+//   prepareDescriptors
+//
+//   Binding 0: Instance stream (dynamic, the offset selects the frame's copy), binding 1: Visible instances, binding 2: Indirect command,
+//   binding 3: Arena uniform buffer (session time and frustum planes, dynamic like binding 0)
+//
+
+void InstanceCullCompute::prepareDescriptors(VkBuffer instanceBuffer, VkDescriptorBufferInfo uboDescriptor)
+{
+    VkDevice device = _vulkanDevice->logicalDevice;
+
+    std::array<VkDescriptorPoolSize, 3> poolSizes;
+    poolSizes[0] = vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1);
+    poolSizes[1] = vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2);
+    poolSizes[2] = vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1);
+
+    VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::descriptorPoolCreateInfo(uint32_t(poolSizes.size()), poolSizes.data(), 1);
+    VK_CHECK_RESULT(vkCreateDescriptorPool(device, &descriptorPoolInfo, nullptr, &_descriptorPool));
+
+    std::array<VkDescriptorSetLayoutBinding, 4> setLayoutBindings;
+    setLayoutBindings[0] = vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, VK_SHADER_STAGE_COMPUTE_BIT, 0);
+    setLayoutBindings[1] = vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 1);
+    setLayoutBindings[2] = vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 2);
+    setLayoutBindings[3] = vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, VK_SHADER_STAGE_COMPUTE_BIT, 3);
+
+    VkDescriptorSetLayoutCreateInfo descriptorLayout = vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings.data(), uint32_t(setLayoutBindings.size()));
+    VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &descriptorLayout, nullptr, &_descriptorSetLayout));
+
+    VkDescriptorSetAllocateInfo allocInfo = vks::initializers::descriptorSetAllocateInfo(_descriptorPool, &_descriptorSetLayout, 1);
+    VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &_descriptorSet));
+
+    updateDescriptors(instanceBuffer, uboDescriptor);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+//
+//   updateDescriptors
+//
+
+void InstanceCullCompute::updateDescriptors(VkBuffer instanceBuffer, VkDescriptorBufferInfo uboDescriptor)
+{
+    VkDevice device = _vulkanDevice->logicalDevice;
+
+    VkDescriptorBufferInfo instanceDescriptor = { instanceBuffer, 0, _params.count * sizeof(instance_data) };
+    VkDescriptorBufferInfo visibleDescriptor = { _visibleBuffer, 0, VK_WHOLE_SIZE };
+    VkDescriptorBufferInfo indirectDescriptor = { _indirectBuffer, 0, VK_WHOLE_SIZE };
+
+    std::array<VkWriteDescriptorSet, 4> writeDescriptorSets;
+    writeDescriptorSets[0] = vks::initializers::writeDescriptorSet(_descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 0, &instanceDescriptor);
+    writeDescriptorSets[1] = vks::initializers::writeDescriptorSet(_descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, &visibleDescriptor);
+    writeDescriptorSets[2] = vks::initializers::writeDescriptorSet(_descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2, &indirectDescriptor);
+    writeDescriptorSets[3] = vks::initializers::writeDescriptorSet(_descriptorSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 3, &uboDescriptor);
+
+    vkUpdateDescriptorSets(device, uint32_t(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+//
+//   preparePipeline
+//
+
+void InstanceCullCompute::preparePipeline(VkPipelineCache pipelineCache, VkPipelineShaderStageCreateInfo shaderStage)
+{
+    VkDevice device = _vulkanDevice->logicalDevice;
+
+    VkPushConstantRange pushConstantRange = vks::initializers::pushConstantRange(VK_SHADER_STAGE_COMPUTE_BIT, sizeof(_params), 0);
+
+    VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = vks::initializers::pipelineLayoutCreateInfo(&_descriptorSetLayout, 1);
+    pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+    pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+    VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, nullptr, &_pipelineLayout));
+
+    VkComputePipelineCreateInfo computePipelineCreateInfo = vks::initializers::computePipelineCreateInfo(_pipelineLayout, 0);
+    computePipelineCreateInfo.stage = shaderStage;
+    VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, &computePipelineCreateInfo, nullptr, &_pipeline));
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+//
+//   recordDispatch
+//
+//   The visible and indirect buffers are shared by all frames. The first barrier waits for the
+//   previous frame's indirect draw and for any compute pass that wrote the instance stream,
+//   the last one hands the results to the indirect and vertex input stages.
+//
+
+void InstanceCullCompute::recordDispatch(VkCommandBuffer cmdBuffer, uint32_t instanceOffset, uint32_t uboOffset)
+{
+    VkMemoryBarrier memoryBarrier = vks::initializers::memoryBarrier();
+    memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+
+    vkCmdPipelineBarrier(
+        cmdBuffer,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+        VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        0,
+        1, &memoryBarrier,
+        0, nullptr,
+        0, nullptr);
+
+    // Reset the draw arguments, the atomic counter lives in instanceCount
+    vkCmdUpdateBuffer(cmdBuffer, _indirectBuffer, 0, sizeof(_indirectReset), &_indirectReset);
+
+    memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+    vkCmdPipelineBarrier(
+        cmdBuffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        0,
+        1, &memoryBarrier,
+        0, nullptr,
+        0, nullptr);
+
+    vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _pipeline);
+    // Dynamic offsets in binding order
+    std::array<uint32_t, 2> dynamicOffsets = { instanceOffset, uboOffset };
+    vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _pipelineLayout, 0, 1, &_descriptorSet, uint32_t(dynamicOffsets.size()), dynamicOffsets.data());
+    vkCmdPushConstants(cmdBuffer, _pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(_params), &_params);
+
+    vkCmdDispatch(cmdBuffer, (_params.count + INSTANCECULL_GROUP_SIZE - 1) / INSTANCECULL_GROUP_SIZE, 1, 1);
+
+    memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    memoryBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+
+    vkCmdPipelineBarrier(
+        cmdBuffer,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+        0,
+        1, &memoryBarrier,
+        0, nullptr,
+        0, nullptr);
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+
+#include <vulkan/vulkan.h>
+#include "VulkanDevice.hpp"
+
+/*
+* InstanceCullCompute:
+*
+* GPU frustum culling of the robot instance stream. cull.comp tests every instance against the
+* frustum planes in the arena uniform buffer, appends the survivors to a visible buffer through
+* an atomic counter and leaves the count in a VkDrawIndexedIndirectCommand. The draw command
+* buffers are recorded once, the CPU never reads the visible count back.
+*/
+
+// Work group size of cull.comp
+#define INSTANCECULL_GROUP_SIZE 256
+
+class InstanceCullCompute
+{
+private:
+    vks::VulkanDevice* _vulkanDevice;
+
+    struct {
+        uint32_t count;
+        float radius;
+    } _params;
+
+    // Written into the indirect buffer before every dispatch, instanceCount starts at zero
+    VkDrawIndexedIndirectCommand _indirectReset;
+
+    VkDescriptorPool _descriptorPool;
+    VkDescriptorSetLayout _descriptorSetLayout;
+    VkDescriptorSet _descriptorSet;
+    VkPipelineLayout _pipelineLayout;
+    VkPipeline _pipeline;
+
+public:
+
+    // Compacted visible instances, bound as vertex buffer 1 by the arena pipeline
+    VkBuffer _visibleBuffer;
+    VkDeviceMemory _visibleMemory;
+
+    // Single VkDrawIndexedIndirectCommand for vkCmdDrawIndexedIndirect
+    VkBuffer _indirectBuffer;
+    VkDeviceMemory _indirectMemory;
+
+    InstanceCullCompute(
+        vks::VulkanDevice* vulkanDevice,
+        VkPipelineCache pipelineCache,
+        VkBuffer instanceBuffer,
+        uint32_t instanceCount,
+        uint32_t indexCount,
+        float radius,
+        VkDescriptorBufferInfo uboDescriptor,
+        VkPipelineShaderStageCreateInfo shaderStage);
+
+    ~InstanceCullCompute();
+
+    void prepareResources();
+
+    void prepareDescriptors(VkBuffer instanceBuffer, VkDescriptorBufferInfo uboDescriptor);
+
+    // Points the set at new instance and uniform buffers. No command buffer using it may be pending
+    void updateDescriptors(VkBuffer instanceBuffer, VkDescriptorBufferInfo uboDescriptor);
+
+    void preparePipeline(VkPipelineCache pipelineCache, VkPipelineShaderStageCreateInfo shaderStage);
+
+    // Records counter reset and cull of the stream at instanceOffset bytes, reading the uniform slice at
+    // uboOffset. Must be outside a render pass, after the instance stream is written
+    void recordDispatch(VkCommandBuffer cmdBuffer, uint32_t instanceOffset, uint32_t uboOffset);
+};
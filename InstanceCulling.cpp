@@ -0,0 +1,254 @@
+
+#include "stdafx.h"
+#include "InstanceCulling.h"
+
+// The SSE2 path is built alongside AVX so the two can be checked against each other
+#if defined(__AVX__)
+#include <immintrin.h>
+#define INSTANCE_CULLING_AVX
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define INSTANCE_CULLING_SSE2
+#endif
+
+InstanceCulling::InstanceCulling(uint32_t nInstances) {
+
+    _lcX.resize(nInstances);
+    _lcY.resize(nInstances);
+    _lcDX.resize(nInstances);
+    _lcDY.resize(nInstances);
+
+    _lcVisible.resize(nInstances);
+}
+
+void
+InstanceCulling::set_instance_data(const instance_data* pData, uint32_t first, uint32_t count) {
+
+    for (uint32_t i = 0; i < count; i++) {
+        const float* d = pData[i].data;
+
+        _lcX[first + i] = d[0];
+        _lcY[first + i] = d[1];
+        _lcDX[first + i] = d[2];
+        _lcDY[first + i] = d[3];
+    }
+}
+
+// Robots lie in the z = 0 plane, so each plane test reduces to a * x + b * y + (d + radius) > 0.
+// Indices are appended branch free: every lane is written, only visible lanes advance the count.
+// The SIMD paths cull whole blocks and return the first robot they left for the scalar tail.
+// Every path evaluates the same expression in the same order, so all return the same set.
+uint32_t
+InstanceCulling::cull(const std::array<glm::vec4, 6>& planes, float t, float radius) {
+    return cull(planes, t, radius, best_path());
+}
+
+uint32_t
+InstanceCulling::cull(const std::array<glm::vec4, 6>& planes, float t, float radius, instance_cull_path path) {
+
+    const uint32_t n = uint32_t(_lcX.size());
+
+    float pa[6], pb[6], pd[6];
+
+    for (int p = 0; p < 6; p++) {
+        pa[p] = planes[p].x;
+        pb[p] = planes[p].y;
+        pd[p] = planes[p].w + radius;
+    }
+
+    uint32_t nVisible = 0;
+    uint32_t i = 0;
+
+    switch (path) {
+#if defined(INSTANCE_CULLING_AVX)
+    case INSTANCE_CULL_AVX:
+        i = cull_avx(pa, pb, pd, t, nVisible);
+        break;
+#endif
+#if defined(INSTANCE_CULLING_SSE2)
+    case INSTANCE_CULL_SSE2:
+        i = cull_sse2(pa, pb, pd, t, nVisible);
+        break;
+#endif
+    default:
+        break;
+    }
+
+    const float* x = _lcX.data();
+    const float* y = _lcY.data();
+    const float* dx = _lcDX.data();
+    const float* dy = _lcDY.data();
+
+    uint32_t* pVisible = _lcVisible.data();
+
+    // Scalar tail, and the whole park on the scalar path
+    for (; i < n; i++) {
+        float px = x[i] + t * dx[i];
+        float py = y[i] + t * dy[i];
+
+        bool inside = true;
+
+        for (int p = 0; p < 6; p++) {
+            if (!((pa[p] * px + pb[p] * py) + pd[p] > 0.f)) {
+                inside = false;
+                break;
+            }
+        }
+
+        if (inside) {
+            pVisible[nVisible++] = i;
+        }
+    }
+
+    _nVisible = nVisible;
+
+    return nVisible;
+}
+
+#if defined(INSTANCE_CULLING_AVX)
+
+uint32_t
+InstanceCulling::cull_avx(const float* pa, const float* pb, const float* pd, float t, uint32_t& nVisible) {
+
+    const uint32_t n = uint32_t(_lcX.size());
+
+    const float* x = _lcX.data();
+    const float* y = _lcY.data();
+    const float* dx = _lcDX.data();
+    const float* dy = _lcDY.data();
+
+    uint32_t* pVisible = _lcVisible.data();
+
+    const __m256 vt = _mm256_set1_ps(t);
+    const __m256 zero = _mm256_setzero_ps();
+
+    __m256 va[6], vb[6], vd[6];
+
+    for (int p = 0; p < 6; p++) {
+        va[p] = _mm256_set1_ps(pa[p]);
+        vb[p] = _mm256_set1_ps(pb[p]);
+        vd[p] = _mm256_set1_ps(pd[p]);
+    }
+
+    uint32_t i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        __m256 px = _mm256_add_ps(_mm256_loadu_ps(x + i), _mm256_mul_ps(vt, _mm256_loadu_ps(dx + i)));
+        __m256 py = _mm256_add_ps(_mm256_loadu_ps(y + i), _mm256_mul_ps(vt, _mm256_loadu_ps(dy + i)));
+
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+
+        for (int p = 0; p < 6; p++) {
+            __m256 d = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(va[p], px), _mm256_mul_ps(vb[p], py)), vd[p]);
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(d, zero, _CMP_GT_OQ));
+        }
+
+        uint32_t bits = uint32_t(_mm256_movemask_ps(inside));
+
+        for (uint32_t j = 0; j < 8; j++) {
+            pVisible[nVisible] = i + j;
+            nVisible += (bits >> j) & 1;
+        }
+    }
+
+    return i;
+}
+
+#endif
+
+#if defined(INSTANCE_CULLING_SSE2)
+
+uint32_t
+InstanceCulling::cull_sse2(const float* pa, const float* pb, const float* pd, float t, uint32_t& nVisible) {
+
+    const uint32_t n = uint32_t(_lcX.size());
+
+    const float* x = _lcX.data();
+    const float* y = _lcY.data();
+    const float* dx = _lcDX.data();
+    const float* dy = _lcDY.data();
+
+    uint32_t* pVisible = _lcVisible.data();
+
+    const __m128 vt = _mm_set1_ps(t);
+    const __m128 zero = _mm_setzero_ps();
+
+    __m128 va[6], vb[6], vd[6];
+
+    for (int p = 0; p < 6; p++) {
+        va[p] = _mm_set1_ps(pa[p]);
+        vb[p] = _mm_set1_ps(pb[p]);
+        vd[p] = _mm_set1_ps(pd[p]);
+    }
+
+    uint32_t i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        __m128 px = _mm_add_ps(_mm_loadu_ps(x + i), _mm_mul_ps(vt, _mm_loadu_ps(dx + i)));
+        __m128 py = _mm_add_ps(_mm_loadu_ps(y + i), _mm_mul_ps(vt, _mm_loadu_ps(dy + i)));
+
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+
+        for (int p = 0; p < 6; p++) {
+            __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(va[p], px), _mm_mul_ps(vb[p], py)), vd[p]);
+            inside = _mm_and_ps(inside, _mm_cmpgt_ps(d, zero));
+        }
+
+        uint32_t bits = uint32_t(_mm_movemask_ps(inside));
+
+        for (uint32_t j = 0; j < 4; j++) {
+            pVisible[nVisible] = i + j;
+            nVisible += (bits >> j) & 1;
+        }
+    }
+
+    return i;
+}
+
+#endif
+
+bool
+InstanceCulling::path_available(instance_cull_path path) {
+
+    switch (path) {
+    case INSTANCE_CULL_SCALAR:
+        return true;
+#if defined(INSTANCE_CULLING_SSE2)
+    case INSTANCE_CULL_SSE2:
+        return true;
+#endif
+#if defined(INSTANCE_CULLING_AVX)
+    case INSTANCE_CULL_AVX:
+        return true;
+#endif
+    default:
+        return false;
+    }
+}
+
+instance_cull_path
+InstanceCulling::best_path() {
+#if defined(INSTANCE_CULLING_AVX)
+    return INSTANCE_CULL_AVX;
+#elif defined(INSTANCE_CULLING_SSE2)
+    return INSTANCE_CULL_SSE2;
+#else
+    return INSTANCE_CULL_SCALAR;
+#endif
+}
+
+uint32_t
+InstanceCulling::visible_count() {
+    return _nVisible;
+}
+
+void
+InstanceCulling::get_visible_data(instance_data* pData) {
+
+    for (uint32_t k = 0; k < _nVisible; k++) {
+        uint32_t i = _lcVisible[k];
+
+        pData[k] = { _lcX[i], _lcY[i], _lcDX[i], _lcDY[i] };
+    }
+}
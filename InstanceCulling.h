@@ -0,0 +1,57 @@
+#pragma once
+
+
+#include "ArenaCubes.h"
+#include "MemoryAccounting.h"
+#include <glm/glm.hpp>
+#include <array>
+#include <vector>
+#include <cstdint>
+
+// Frustum culling of the robot instance stream on the CPU.
+//
+// Keeps a structure of arrays copy of the instance data so the plane tests run 8 (AVX) or
+// 4 (SSE2) robots at a time. Robots are tested as spheres at their position extrapolated to
+// the time since the instance epoch, the same way triangle.vert places them.
+
+// Implementations of cull(), the SIMD ones exist where the compiler targets the instruction set
+enum instance_cull_path {
+	INSTANCE_CULL_SCALAR,
+	INSTANCE_CULL_SSE2,
+	INSTANCE_CULL_AVX
+};
+
+class InstanceCulling {
+	tracked_vector<float, MEMORY_INSTANCES> _lcX;
+	tracked_vector<float, MEMORY_INSTANCES> _lcY;
+	tracked_vector<float, MEMORY_INSTANCES> _lcDX;
+	tracked_vector<float, MEMORY_INSTANCES> _lcDY;
+
+	// Indices of the robots that passed the last cull, in instance order
+	tracked_vector<uint32_t, MEMORY_INSTANCES> _lcVisible;
+	uint32_t _nVisible = 0;
+
+	// Cull whole blocks of 8 or 4 robots, return the first robot not tested
+	uint32_t cull_avx(const float* pa, const float* pb, const float* pd, float t, uint32_t& nVisible);
+	uint32_t cull_sse2(const float* pa, const float* pb, const float* pd, float t, uint32_t& nVisible);
+
+public:
+	InstanceCulling(uint32_t nInstances);
+
+	// Copies instance records [first, first + count) into the culling copy
+	void set_instance_data(const instance_data* pData, uint32_t first, uint32_t count);
+
+	// planes as produced by vks::Frustum::update, normalized, pointing inwards
+	uint32_t cull(const std::array<glm::vec4, 6>& planes, float t, float radius);
+	// Culls with the given implementation, which must be available. Every path returns the same set
+	uint32_t cull(const std::array<glm::vec4, 6>& planes, float t, float radius, instance_cull_path path);
+
+	static bool path_available(instance_cull_path path);
+	// Widest available path, the one cull() without a path uses
+	static instance_cull_path best_path();
+
+	uint32_t visible_count();
+
+	// Writes the visible instances compacted to pData[0, visible_count())
+	void get_visible_data(instance_data* pData);
+};
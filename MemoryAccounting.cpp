@@ -0,0 +1,152 @@
+
+#include "stdafx.h"
+#include "MemoryAccounting.h"
+
+#include <iomanip>
+#include <string>
+
+struct memory_slot {
+    std::atomic<uint64_t> current;
+    std::atomic<uint64_t> peak;
+    std::atomic<uint64_t> allocatedBytes;
+    std::atomic<uint64_t> allocations;
+};
+
+// Zero initialized before any constructor runs, static objects may allocate
+static memory_slot s_slot[MEMORY_DOMAIN_COUNT][MEMORY_SUBSYSTEM_COUNT];
+
+static thread_local memory_subsystem t_current = MEMORY_OTHER;
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+//
+//   name
+//
+
+const char* MemoryAccounting::name(memory_subsystem s)
+{
+    static const char* lcName[MEMORY_SUBSYSTEM_COUNT] = {
+        "other", "robots", "instances", "arena", "textures", "overlay", "ui", "framebuffers", "staging", "frame"
+    };
+    return lcName[s];
+}
+
+const char* MemoryAccounting::name(memory_domain d)
+{
+    return (d == MEMORY_HOST) ? "host" : "device";
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+//
+//   current
+//
+
+memory_subsystem MemoryAccounting::current()
+{
+    return t_current;
+}
+
+void MemoryAccounting::setCurrent(memory_subsystem s)
+{
+    t_current = s;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+//
+//   allocated
+//
+
+void MemoryAccounting::allocated(memory_domain d, memory_subsystem s, uint64_t bytes)
+{
+    memory_slot& slot = s_slot[d][s];
+
+    uint64_t current = slot.current.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+
+    slot.allocatedBytes.fetch_add(bytes, std::memory_order_relaxed);
+    slot.allocations.fetch_add(1, std::memory_order_relaxed);
+
+    uint64_t peak = slot.peak.load(std::memory_order_relaxed);
+
+    while ((current > peak) && !slot.peak.compare_exchange_weak(peak, current, std::memory_order_relaxed)) {
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+//
+//   freed
+//
+
+void MemoryAccounting::freed(memory_domain d, memory_subsystem s, uint64_t bytes)
+{
+    s_slot[d][s].current.fetch_sub(bytes, std::memory_order_relaxed);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+//
+//   counters
+//
+
+memory_counters MemoryAccounting::counters(memory_domain d, memory_subsystem s)
+{
+    const memory_slot& slot = s_slot[d][s];
+
+    memory_counters c;
+    c.current = slot.current.load(std::memory_order_relaxed);
+    c.peak = slot.peak.load(std::memory_order_relaxed);
+    c.allocatedBytes = slot.allocatedBytes.load(std::memory_order_relaxed);
+    c.allocations = slot.allocations.load(std::memory_order_relaxed);
+    return c;
+}
+
+std::vector<memory_counters> MemoryAccounting::snapshot()
+{
+    std::vector<memory_counters> lcCounters;
+
+    for (uint32_t d = 0; d < MEMORY_DOMAIN_COUNT; ++d) {
+        for (uint32_t s = 0; s < MEMORY_SUBSYSTEM_COUNT; ++s) {
+            lcCounters.push_back(counters(memory_domain(d), memory_subsystem(s)));
+        }
+    }
+    return lcCounters;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+//
+//   report
+//
+
+void MemoryAccounting::report(std::ostream& os, const std::vector<memory_counters>& previous, double seconds)
+{
+    std::vector<memory_counters> lcNow = snapshot();
+
+    os << std::fixed << std::setprecision(2)
+        << std::left << std::setw(20) << "memory" << std::right
+        << std::setw(14) << "current (MB)" << std::setw(12) << "peak (MB)"
+        << std::setw(10) << "allocs/s" << std::setw(10) << "MB/s" << std::endl;
+
+    for (uint32_t d = 0; d < MEMORY_DOMAIN_COUNT; ++d) {
+        for (uint32_t s = 0; s < MEMORY_SUBSYSTEM_COUNT; ++s) {
+            uint32_t i = d * MEMORY_SUBSYSTEM_COUNT + s;
+            const memory_counters& c = lcNow[i];
+
+            if (c.allocations == 0) {
+                continue;
+            }
+
+            double allocations = double(c.allocations - ((i < previous.size()) ? previous[i].allocations : 0));
+            double bytes = double(c.allocatedBytes - ((i < previous.size()) ? previous[i].allocatedBytes : 0));
+            double perSecond = (seconds > 0.0) ? 1.0 / seconds : 0.0;
+
+            os << std::left << std::setw(20) << (std::string(name(memory_domain(d))) + " " + name(memory_subsystem(s))) << std::right
+                << std::setw(14) << double(c.current) / (1024.0 * 1024.0)
+                << std::setw(12) << double(c.peak) / (1024.0 * 1024.0)
+                << std::setw(10) << std::setprecision(0) << allocations * perSecond
+                << std::setw(10) << std::setprecision(2) << bytes * perSecond / (1024.0 * 1024.0) << std::endl;
+        }
+    }
+}
@@ -0,0 +1,135 @@
+#pragma once
+
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <ostream>
+#include <vector>
+
+/*
+* MemoryAccounting:
+*
+* Current, peak and cumulative allocations per subsystem, for host memory and Vulkan device memory.
+* Does not depend on Vulkan. Device allocations are charged by vks::memory::allocateMemory() to the
+* subsystem of the calling thread's MemoryScope. Host containers are charged by the MemoryTracked
+* allocator, whose subsystem is part of the type.
+*
+* The counters are atomics, they can be read at any time from any thread. Allocation rates are the
+* difference of two snapshots.
+*/
+
+enum memory_subsystem {
+    MEMORY_OTHER,
+    MEMORY_ROBOTS,          // robot park storage and the gpu simulation state
+    MEMORY_INSTANCES,       // instance streams, culling and the per-frame dirty lists
+    MEMORY_ARENA,           // arena geometry and uniforms
+    MEMORY_TEXTURES,
+    MEMORY_OVERLAY,         // text overlay
+    MEMORY_UI,              // ImGui overlay
+    MEMORY_FRAMEBUFFERS,    // depth and offscreen attachments
+    MEMORY_STAGING,         // upload staging buffers
+    MEMORY_FRAME,           // per-frame arena slots
+    MEMORY_SUBSYSTEM_COUNT
+};
+
+enum memory_domain {
+    MEMORY_HOST,
+    MEMORY_DEVICE,
+    MEMORY_DOMAIN_COUNT
+};
+
+struct memory_counters {
+    // Bytes
+    uint64_t current;
+    uint64_t peak;
+    uint64_t allocatedBytes;
+    uint64_t allocations;
+};
+
+class MemoryAccounting
+{
+public:
+
+    static const char* name(memory_subsystem s);
+    static const char* name(memory_domain d);
+
+    // The calling thread's subsystem, set by MemoryScope
+    static memory_subsystem current();
+    static void setCurrent(memory_subsystem s);
+
+    static void allocated(memory_domain d, memory_subsystem s, uint64_t bytes);
+    static void freed(memory_domain d, memory_subsystem s, uint64_t bytes);
+
+    static memory_counters counters(memory_domain d, memory_subsystem s);
+
+    // Counters of every domain and subsystem, indexed [d * MEMORY_SUBSYSTEM_COUNT + s]
+    static std::vector<memory_counters> snapshot();
+
+    // Table of the subsystems with any allocation, rates between previous and now over seconds
+    static void report(std::ostream& os, const std::vector<memory_counters>& previous, double seconds);
+};
+
+// Charges the device allocations of the calling thread within its scope to a subsystem
+class MemoryScope
+{
+private:
+    memory_subsystem _previous;
+
+public:
+
+    explicit MemoryScope(memory_subsystem s)
+    {
+        _previous = MemoryAccounting::current();
+        MemoryAccounting::setCurrent(s);
+    }
+
+    ~MemoryScope()
+    {
+        MemoryAccounting::setCurrent(_previous);
+    }
+
+    MemoryScope(const MemoryScope&) = delete;
+    MemoryScope& operator=(const MemoryScope&) = delete;
+};
+
+// Standard allocator that charges host memory to subsystem S
+template <class T, memory_subsystem S>
+class MemoryTracked
+{
+public:
+    typedef T value_type;
+
+    template <class U>
+    struct rebind {
+        typedef MemoryTracked<U, S> other;
+    };
+
+    MemoryTracked() noexcept {}
+
+    template <class U>
+    MemoryTracked(const MemoryTracked<U, S>&) noexcept {}
+
+    T* allocate(size_t n)
+    {
+        T* p = static_cast<T*>(::operator new(n * sizeof(T)));
+        MemoryAccounting::allocated(MEMORY_HOST, S, n * sizeof(T));
+        return p;
+    }
+
+    void deallocate(T* p, size_t n) noexcept
+    {
+        MemoryAccounting::freed(MEMORY_HOST, S, n * sizeof(T));
+        ::operator delete(p);
+    }
+};
+
+template <class T, class U, memory_subsystem S>
+bool operator==(const MemoryTracked<T, S>&, const MemoryTracked<U, S>&) { return true; }
+
+template <class T, class U, memory_subsystem S>
+bool operator!=(const MemoryTracked<T, S>&, const MemoryTracked<U, S>&) { return false; }
+
+template <class T, memory_subsystem S>
+using tracked_vector = std::vector<T, MemoryTracked<T, S>>;
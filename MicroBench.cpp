@@ -0,0 +1,743 @@
+
+/*
+* MicroBench:
+*
+* Microbenchmarks of the simulation and geometry hot paths. Builds without Vulkan and runs
+* without a GPU, every benchmark works on plain memory. Each one is run for sizes from
+* -min to -max in steps of ten, a size being the number of elements it writes or updates.
+* A size is measured warmup + repetitions times, only the repetitions are kept.
+*
+*   microbench [-w <warmup>] [-r <repetitions>] [-min <size>] [-max <size>] [-f <name filter>] [-o <results.json>]
+*              [-b <baseline.json>] [-t <threshold percent>]
+*
+* With a baseline, results of an earlier -o run, every benchmark is compared with it and the exit
+* code is 1 if one regressed.
+*
+* Before measuring, the SIMD paths of InstanceCulling::cull are checked against the scalar one. The
+* exit code is 2 if any returns a different visible set.
+*
+* Besides the MicroBench project in the solution it builds as the MicroBench target of
+* CMakeLists.txt, which also runs it as a test, or with
+*
+*   g++ -std=c++14 -O2 -march=native MicroBench.cpp Robot.cpp RobotPark.cpp InstanceCulling.cpp TextLayout.cpp Trace.cpp MemoryAccounting.cpp AllocationCounter.cpp FrameArena.cpp -lpthread -o microbench
+*/
+
+#include "stdafx.h"
+
+#include "Robot.h"
+#include "RobotPark.h"
+#include "InstanceCulling.h"
+#include "ArenaCubes.h"
+#include "TextLayout.h"
+#include "FrameArena.h"
+#include "frustum.hpp"
+#include "benchmarkstats.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+// Results are folded into this so the measured work cannot be optimized away
+static volatile uint64_t g_sink = 0;
+
+static uint64_t bits(float f)
+{
+    uint32_t u;
+    memcpy(&u, &f, sizeof(u));
+    return u;
+}
+
+static uint64_t bits(double d)
+{
+    uint64_t u;
+    memcpy(&u, &d, sizeof(u));
+    return u;
+}
+
+struct micro_result {
+    std::string name;
+    uint64_t size;
+    // Elements processed by one repetition, can differ from size for randomized geometry
+    uint64_t elements;
+    // ms per repetition
+    std::vector<double> lcTime;
+};
+
+class MicroBench
+{
+private:
+    typedef std::chrono::high_resolution_clock clock;
+
+    std::vector<micro_result> _lcResult;
+
+public:
+    uint32_t _warmup = 2;
+    uint32_t _repetitions = 15;
+    uint64_t _minSize = 1000;
+    uint64_t _maxSize = 10000000;
+    // Only benchmarks whose name contains the filter run
+    std::string _filter;
+    std::string _filename;
+    // Results of an earlier run to compare with, and the regression threshold in percent
+    std::string _baseline;
+    double _threshold = BENCHMARK_COMPARE_THRESHOLD;
+
+    bool enabled(const std::string& name)
+    {
+        return name.find(_filter) != std::string::npos;
+    }
+
+    // body runs one repetition and returns the number of elements it processed
+    void measure(const std::string& name, uint64_t size, std::function<uint64_t()> body);
+
+    void save();
+
+    // Returns BENCHMARK_EXIT_REGRESSION if a benchmark regressed, BENCHMARK_EXIT_ERROR if the baseline cannot be read
+    int compare();
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+//
+//   measure
+//
+
+void MicroBench::measure(const std::string& name, uint64_t size, std::function<uint64_t()> body)
+{
+    micro_result result;
+    result.name = name;
+    result.size = size;
+    result.elements = 0;
+
+    for (uint32_t i = 0; i < _warmup; ++i) {
+        body();
+    }
+
+    for (uint32_t i = 0; i < _repetitions; ++i) {
+        clock::time_point t0 = clock::now();
+        result.elements = body();
+        result.lcTime.push_back(std::chrono::duration<double, std::milli>(clock::now() - t0).count());
+    }
+
+    vks::stats::Statistics stats = vks::stats::compute(result.lcTime);
+
+    double nsPerElement = stats.p50 * 1000000.0 / double(std::max<uint64_t>(result.elements, 1));
+
+    std::cout << std::fixed << std::setprecision(3)
+        << std::left << std::setw(30) << name << std::right
+        << std::setw(10) << size
+        << std::setw(12) << stats.p50 << " ms"
+        << std::setw(12) << stats.min << " ms"
+        << std::setw(8) << std::setprecision(1) << (100.0 * stats.stddev / std::max(stats.mean, 1e-9)) << " %"
+        << std::setw(10) << std::setprecision(3) << nsPerElement << " ns" << std::endl;
+
+    _lcResult.push_back(result);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+//
+//   save
+//
+//   JSON with build and run settings and every repetition, so runs can be compared sample by sample
+//
+
+void MicroBench::save()
+{
+    std::ofstream os(_filename, std::ios::out);
+
+    if (!os.is_open()) {
+        std::cerr << "Could not write " << _filename << std::endl;
+        return;
+    }
+
+    os << std::fixed << std::setprecision(6);
+
+    os << "{" << std::endl;
+    os << "  \"build\": {" << std::endl;
+    os << "    \"configuration\": " << vks::stats::jsonString(vks::stats::buildConfiguration()) << "," << std::endl;
+    os << "    \"compiler\": " << vks::stats::jsonString(vks::stats::compiler()) << "," << std::endl;
+    os << "    \"date\": " << vks::stats::jsonString(std::string(__DATE__) + " " + __TIME__) << std::endl;
+    os << "  }," << std::endl;
+    os << "  \"config\": {" << std::endl;
+    os << "    \"warmup\": " << _warmup << "," << std::endl;
+    os << "    \"repetitions\": " << _repetitions << "," << std::endl;
+    os << "    \"minSize\": " << _minSize << "," << std::endl;
+    os << "    \"maxSize\": " << _maxSize << "," << std::endl;
+    os << "    \"filter\": " << vks::stats::jsonString(_filter) << std::endl;
+    os << "  }," << std::endl;
+    os << "  \"results\": [";
+
+    for (size_t i = 0; i < _lcResult.size(); ++i) {
+        const micro_result& r = _lcResult[i];
+        vks::stats::Statistics stats = vks::stats::compute(r.lcTime);
+
+        os << (i > 0 ? "," : "") << std::endl;
+        os << "    { \"name\": " << vks::stats::jsonString(r.name) << ", \"size\": " << r.size << ", \"elements\": " << r.elements
+            << ", \"p50\": " << stats.p50 << ", \"min\": " << stats.min << ", \"mean\": " << stats.mean << ", \"stddev\": " << stats.stddev
+            << ", \"nsPerElement\": " << (stats.p50 * 1000000.0 / double(std::max<uint64_t>(r.elements, 1)))
+            << ", \"samples\": [";
+        for (size_t j = 0; j < r.lcTime.size(); ++j) {
+            os << (j > 0 ? ", " : "") << r.lcTime[j];
+        }
+        os << "] }";
+    }
+
+    os << std::endl << "  ]" << std::endl << "}" << std::endl;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+//
+//   compare
+//
+//   Every result is matched by name and size with the baseline and tested sample by sample
+//
+
+int MicroBench::compare()
+{
+    vks::stats::JsonValue base;
+
+    if (!vks::stats::loadJson(_baseline, base) || (base.find("results") == nullptr)) {
+        std::cerr << "Could not read baseline " << _baseline << std::endl;
+        return BENCHMARK_EXIT_ERROR;
+    }
+
+    const vks::stats::JsonValue* lcBase = base.find("results");
+
+    std::vector<vks::stats::Comparison> lcComparison;
+
+    for (const micro_result& r : _lcResult) {
+        for (const vks::stats::JsonValue& b : lcBase->items) {
+            const vks::stats::JsonValue* name = b.find("name");
+            const vks::stats::JsonValue* size = b.find("size");
+            const vks::stats::JsonValue* samples = b.find("samples");
+
+            if ((name == nullptr) || (size == nullptr) || (samples == nullptr) ||
+                (name->string != r.name) || (uint64_t(size->number) != r.size)) {
+                continue;
+            }
+
+            lcComparison.push_back(vks::stats::compare(r.name + " " + std::to_string(r.size), samples->numbers(), r.lcTime, _threshold));
+            break;
+        }
+    }
+
+    std::cout << std::endl << "Comparison with " << _baseline << " (median ms, Mann-Whitney p)" << std::endl;
+
+    uint32_t regressions = vks::stats::printComparisons(std::cout, lcComparison);
+
+    if (regressions > 0) {
+        std::cout << regressions << " benchmark(s) regressed by more than " << std::setprecision(1) << _threshold << " %" << std::endl;
+        return BENCHMARK_EXIT_REGRESSION;
+    }
+
+    return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+//
+//   Benchmarks
+//
+//   Each sets up its input for n elements and measures the hot path on it
+//
+
+static void bench_robot_advance(MicroBench& mb, uint64_t n)
+{
+    std::default_random_engine generator;
+    std::uniform_real_distribution<double> distribution(-1.0, 1.0);
+
+    std::vector<Robot> lcRobot(n);
+    for (Robot& r : lcRobot) {
+        r.set_data(100.0 * distribution(generator), 100.0 * distribution(generator), 0.001 * distribution(generator), 0.001 * distribution(generator), 0);
+    }
+
+    uint32_t t = 0;
+
+    mb.measure("Robot::advance", n, [&] {
+        t += 16;
+        for (Robot& r : lcRobot) {
+            r.advance(t);
+        }
+        g_sink += bits(lcRobot[n / 2]._x);
+        return n;
+    });
+}
+
+static void bench_robotpark_advance(MicroBench& mb, uint64_t n)
+{
+    RobotPark park(uint32_t(n), 0);
+
+    uint32_t t = 0;
+
+    mb.measure("RobotPark::advance", n, [&] {
+        t += 16;
+        park.advance(t);
+        g_sink += park.dirty_count();
+        return n;
+    });
+}
+
+static void bench_robotpark_get_instance_data(MicroBench& mb, uint64_t n)
+{
+    RobotPark park(uint32_t(n), 0);
+
+    std::vector<instance_data> lcData(n);
+
+    mb.measure("RobotPark::get_instance_data", n, [&] {
+        park.get_instance_data(lcData.data(), 0, uint32_t(n));
+        g_sink += bits(lcData[n / 2].data[0]);
+        return n;
+    });
+}
+
+// n indices, 36 per cube
+static void bench_setup_indices(MicroBench& mb, uint64_t n)
+{
+    uint32_t cubes = uint32_t(std::max<uint64_t>(1, n / 36));
+
+    mb.measure("setup_indices", n, [&] {
+        std::vector<uint32_t> lcIndex;
+        setup_indices(lcIndex, cubes);
+        g_sink += lcIndex.back();
+        return uint64_t(lcIndex.size());
+    });
+}
+
+// About n vertices, a ray holds 44 on average
+static void bench_create_cube_arena(MicroBench& mb, uint64_t n)
+{
+    uint32_t rays = uint32_t(std::max<uint64_t>(1, n / 44));
+
+    mb.measure("create_cube_arena", n, [&] {
+        std::vector<arena_vertex> lcVertex;
+        create_cube_arena(lcVertex, rays);
+        g_sink += lcVertex.size();
+        return uint64_t(lcVertex.size());
+    });
+}
+
+// n vertices, 8 per cube
+static void bench_cube_transform(MicroBench& mb, uint64_t n)
+{
+    std::vector<Cube> lcCube(std::max<uint64_t>(1, n / 8), Cube(-0.5f, -0.5f, -0.5f, 0.5f, 0.5f, 0.5f));
+
+    const float rCos = std::cos(0.001f);
+    const float rSin = std::sin(0.001f);
+
+    mb.measure("Cube::transform", n, [&] {
+        for (Cube& c : lcCube) {
+            c.transform(rCos, rSin, 0.0f);
+        }
+        g_sink += bits(lcCube[lcCube.size() / 2].acVertex[0].position[0]);
+        return uint64_t(lcCube.size() * 8);
+    });
+}
+
+// n robot sized spheres spread over the park, seen by a camera like the arena's
+static void bench_frustum_check_sphere(MicroBench& mb, uint64_t n)
+{
+    std::default_random_engine generator;
+    std::uniform_real_distribution<float> distribution(-100.0f, 100.0f);
+
+    std::vector<glm::vec3> lcPos(n);
+    for (glm::vec3& pos : lcPos) {
+        pos = glm::vec3(distribution(generator), distribution(generator), 0.0f);
+    }
+
+    glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 256.0f);
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f, -60.0f, 80.0f), glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+
+    vks::Frustum frustum;
+    frustum.update(projection * view);
+
+    mb.measure("vks::Frustum::checkSphere", n, [&] {
+        uint64_t visible = 0;
+        for (const glm::vec3& pos : lcPos) {
+            visible += frustum.checkSphere(pos, 1.0f) ? 1 : 0;
+        }
+        g_sink += visible;
+        return n;
+    });
+}
+
+// n robots of a park culled by the arena's camera, radius of the robot mesh
+static void bench_instance_culling(MicroBench& mb, uint64_t n)
+{
+    RobotPark park(uint32_t(n), 0);
+
+    std::vector<instance_data> lcData(n);
+    park.get_instance_data(lcData.data(), 0, uint32_t(n));
+
+    InstanceCulling culling((uint32_t)n);
+    culling.set_instance_data(lcData.data(), 0, uint32_t(n));
+
+    std::vector<arena_vertex> lcVertex;
+    create_single_cube(lcVertex);
+    const float radius = bounding_radius(lcVertex);
+
+    glm::mat4 projection = glm::perspective(glm::radians(35.0f), 16.0f / 9.0f, 0.1f, 4096.0f);
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, 150.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+    vks::Frustum frustum;
+    frustum.update(projection * view);
+
+    float t = 0.0f;
+
+    mb.measure("InstanceCulling::cull", n, [&] {
+        t += 16.0f;
+        g_sink += culling.cull(frustum.planes, t, radius);
+        return n;
+    });
+}
+
+// n letters of overlay style text, laid out into a buffer the size of an overlay slice
+static void bench_text_layout(MicroBench& mb, uint64_t n)
+{
+    static std::vector<unsigned char> lcPixels(TEXTLAYOUT_FONT_SIZE * TEXTLAYOUT_FONT_SIZE);
+
+    TextLayout layout;
+    layout.prepareFont(lcPixels.data());
+
+    const std::vector<std::string> lcText = {
+        "THE GAME",
+        "16.67ms (60 fps) Vulkan Device rotation 1.23 nRay 4",
+        "model view matrix",
+        "+0.71 -0.71 +0.00 +0.00",
+        "+0.50 +0.50 -0.71 +0.00",
+        "[X]",
+        "Info...",
+    };
+
+    const uint32_t maxLetters = 512;
+    std::vector<float> lcVertex(maxLetters * 16);
+
+    mb.measure("TextLayout::layout", n, [&] {
+        uint64_t letters = 0;
+        uint32_t used = 0;
+
+        while (letters < n) {
+            for (const std::string& text : lcText) {
+                // A full slice starts over, like the next frame's update
+                if (used + text.size() > maxLetters) {
+                    used = 0;
+                }
+                used += layout.layout(text.c_str(), 5.0f, 25.0f, TextLayout::alignLeft, 1280, 720, &lcVertex[used * 16], maxLetters - used);
+                letters += text.size();
+            }
+        }
+        g_sink += bits(lcVertex[0]);
+        return letters;
+    });
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+//
+//   Self-checks
+//
+//   Run before the benchmarks, a SIMD path that is fast but wrong must not pass as an improvement
+//
+
+// Every available InstanceCulling::cull path must return the scalar path's visible set. The park
+// is culled from cameras inside, at the edge and outside it, over a range of times, so robots
+// cross the frustum planes at all lanes of a block and in the scalar tail
+static bool check_instance_culling()
+{
+    // Not a multiple of 8, the SIMD paths leave a tail
+    const uint32_t n = 100003;
+
+    RobotPark park(n, 0);
+
+    std::vector<instance_data> lcData(n);
+    park.get_instance_data(lcData.data(), 0, n);
+
+    InstanceCulling culling(n);
+    culling.set_instance_data(lcData.data(), 0, n);
+
+    std::vector<instance_data> lcExpected(n);
+    std::vector<instance_data> lcVisible(n);
+
+    std::vector<arena_vertex> lcVertex;
+    create_single_cube(lcVertex);
+    const float radius = bounding_radius(lcVertex);
+
+    const instance_cull_path acPath[] = { INSTANCE_CULL_SSE2, INSTANCE_CULL_AVX };
+    const char* acPathName[] = { "SSE2", "AVX" };
+
+    const glm::vec3 acCenter[] = { glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(60.0f, -30.0f, 0.0f), glm::vec3(100.0f, 100.0f, 0.0f), glm::vec3(-180.0f, 20.0f, 0.0f) };
+
+    glm::mat4 projection = glm::perspective(glm::radians(35.0f), 16.0f / 9.0f, 0.1f, 4096.0f);
+
+    bool ok = true;
+    uint32_t checked = 0;
+
+    for (const glm::vec3& center : acCenter) {
+        glm::mat4 view = glm::lookAt(glm::vec3(center.x, center.y, 150.0f), center, glm::vec3(0.0f, 1.0f, 0.0f));
+
+        vks::Frustum frustum;
+        frustum.update(projection * view);
+
+        for (float t = 0.0f; t < 60000.0f; t += 7919.0f) {
+            uint32_t nExpected = culling.cull(frustum.planes, t, radius, INSTANCE_CULL_SCALAR);
+            culling.get_visible_data(lcExpected.data());
+
+            for (int i = 0; i < 2; i++) {
+                if (!InstanceCulling::path_available(acPath[i])) {
+                    continue;
+                }
+
+                uint32_t nVisible = culling.cull(frustum.planes, t, radius, acPath[i]);
+                culling.get_visible_data(lcVisible.data());
+
+                checked++;
+
+                if ((nVisible != nExpected) || (memcmp(lcVisible.data(), lcExpected.data(), nVisible * sizeof(instance_data)) != 0)) {
+                    std::cerr << "InstanceCulling::cull " << acPathName[i] << " path: " << nVisible << " visible, scalar path " << nExpected
+                        << " (camera " << center.x << ", " << center.y << ", t " << t << ")" << std::endl;
+                    ok = false;
+                }
+            }
+        }
+    }
+
+    std::cout << "InstanceCulling::cull: " << checked << " SIMD culls match the scalar path" << (ok ? "" : ", except the ones above") << std::endl << std::endl;
+
+    return ok;
+}
+
+// IEEE 754 binary16 to float, as the vertex fetch converts VK_FORMAT_R16G16_SFLOAT
+static float half_to_float(uint16_t h)
+{
+    float magnitude;
+    uint32_t exponent = (h >> 10) & 0x1f;
+    uint32_t mantissa = h & 0x3ff;
+
+    if (exponent == 0) {
+        magnitude = std::ldexp(float(mantissa), -24);
+    }
+    else if (exponent == 31) {
+        magnitude = (mantissa == 0) ? INFINITY : NAN;
+    }
+    else {
+        magnitude = std::ldexp(float(mantissa | 0x400), int(exponent) - 25);
+    }
+    return (h & 0x8000) ? -magnitude : magnitude;
+}
+
+// RobotPark::get_compact_instance_data decoded the way triangle_compact.vert reads it, R16G16_SSCALED
+// steps from the tile origin and R16G16_SFLOAT units per second, must place every robot where the
+// float records decoded like triangle.vert do, within the quantization error, over the whole tile
+// period. The park is encoded after the robots drifted past their starting bounds
+static bool check_compact_instance_data()
+{
+    // Not a multiple of 2, the SSE2 path leaves a tail
+    const uint32_t n = 100003;
+    const uint32_t t0 = 200000;
+
+    RobotPark park(n, 0);
+    park.advance(t0);
+
+    std::vector<instance_data> lcData(n);
+    park.get_instance_data(lcData.data(), 0, n);
+
+    instance_tile tile;
+    park.get_instance_tile(tile, t0, INSTANCE_TILE_PERIOD);
+
+    std::vector<compact_instance_data> lcCompact(n);
+    park.get_compact_instance_data(lcCompact.data(), 0, n, tile);
+
+    // tileParams as the uniform buffer carries them
+    const float tileParams[3] = { float(tile.origin[0]), float(tile.origin[1]), float(tile.step) };
+
+    bool ok = true;
+    double maxError = 0.0;
+
+    for (uint32_t dt = 0; dt <= INSTANCE_TILE_PERIOD; dt += INSTANCE_TILE_PERIOD / 4) {
+        // triangle.vert position at the same time, the epoch is 0
+        const double t = double(t0 + dt);
+
+        for (uint32_t i = 0; i < n; i++) {
+            const compact_instance_data& c = lcCompact[i];
+            const float* d = lcData[i].data;
+
+            for (int k = 0; k < 2; k++) {
+                float velocity = 0.001f * half_to_float(c.vel[k]);
+                float position = tileParams[k] + tileParams[2] * float(c.pos[k]) + float(dt) * velocity;
+
+                double expected = double(d[k]) + t * double(d[k + 2]);
+                double error = std::abs(double(position) - expected);
+
+                // Half a step, the half float velocity over dt and float rounding of the sum
+                double tolerance = tile.step + std::abs(double(d[k + 2])) * dt / 1024.0 + 1e-4 * std::abs(expected);
+
+                maxError = std::max(maxError, error);
+
+                if (!(error <= tolerance) && ok) {
+                    std::cerr << "RobotPark::get_compact_instance_data: robot " << i << " axis " << k << " at " << position << ", float record " << expected
+                        << " (tile step " << tile.step << ", " << dt << " ms into the tile)" << std::endl;
+                    ok = false;
+                }
+            }
+        }
+    }
+
+    std::cout << "RobotPark::get_compact_instance_data: " << n << " robots decoded like triangle_compact.vert, largest error " << maxError
+        << " at a step of " << tile.step << (ok ? "" : ", beyond tolerance") << std::endl << std::endl;
+
+    return ok;
+}
+
+// FrameArena::allocate must honour the requested alignment in the slot and on the heap overflow path.
+// The slots start smaller than a frame's requests, so the first frame overflows, and must have grown
+// to fit them once they are rewound
+static bool check_frame_arena()
+{
+    const size_t acAlignment[] = { 1, 16, 64, 256 };
+
+    FrameArena arena(2, 256);
+
+    bool ok = true;
+    uint32_t checked = 0;
+    uint64_t grownOverflows = 0;
+
+    for (int frame = 0; frame < 4; frame++) {
+        if (frame == 2) {
+            grownOverflows = arena.overflows();
+        }
+
+        for (size_t alignment : acAlignment) {
+            for (size_t bytes : { size_t(24), size_t(200) }) {
+                uint64_t overflows = arena.overflows();
+                char* p = static_cast<char*>(arena.allocate(bytes, alignment));
+                bool overflowed = (arena.overflows() != overflows);
+
+                checked++;
+
+                if ((reinterpret_cast<uintptr_t>(p) & (alignment - 1)) != 0) {
+                    std::cerr << "FrameArena::allocate: " << bytes << " bytes aligned to " << alignment << (overflowed ? " on the overflow path" : "")
+                        << " returned " << static_cast<void*>(p) << std::endl;
+                    ok = false;
+                }
+
+                // The whole request must be writable
+                memset(p, 0xCD, bytes);
+            }
+        }
+        arena.endFrame();
+    }
+
+    if (grownOverflows == 0) {
+        std::cerr << "FrameArena::allocate: no request overflowed the slot" << std::endl;
+        ok = false;
+    }
+    if (arena.overflows() != grownOverflows) {
+        std::cerr << "FrameArena::endFrame: " << (arena.overflows() - grownOverflows) << " requests overflowed after the slots grew to " << arena.slotBytes() << " bytes" << std::endl;
+        ok = false;
+    }
+
+    std::cout << "FrameArena::allocate: " << checked << " allocations, " << arena.overflows() << " overflowed, aligned as requested" << (ok ? "" : " except the ones above") << std::endl << std::endl;
+
+    return ok;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+//
+//   main
+//
+
+int main(const int argc, const char* argv[])
+{
+    MicroBench mb;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg(argv[i]);
+        bool hasValue = (i + 1 < argc);
+
+        if ((arg == std::string("-w")) && hasValue) {
+            mb._warmup = uint32_t(strtoul(argv[++i], nullptr, 10));
+        }
+        else if ((arg == std::string("-r")) && hasValue) {
+            mb._repetitions = std::max(1u, uint32_t(strtoul(argv[++i], nullptr, 10)));
+        }
+        else if ((arg == std::string("-min")) && hasValue) {
+            mb._minSize = std::max<uint64_t>(1, strtoull(argv[++i], nullptr, 10));
+        }
+        else if ((arg == std::string("-max")) && hasValue) {
+            mb._maxSize = strtoull(argv[++i], nullptr, 10);
+        }
+        else if ((arg == std::string("-f")) && hasValue) {
+            mb._filter = argv[++i];
+        }
+        else if ((arg == std::string("-o")) && hasValue) {
+            mb._filename = argv[++i];
+        }
+        else if ((arg == std::string("-b")) && hasValue) {
+            mb._baseline = argv[++i];
+        }
+        else if ((arg == std::string("-t")) && hasValue) {
+            mb._threshold = strtod(argv[++i], nullptr);
+        }
+        else {
+            std::cerr << "Unknown argument " << arg << std::endl;
+            return 1;
+        }
+    }
+
+    if (!check_instance_culling() || !check_compact_instance_data() || !check_frame_arena()) {
+        return BENCHMARK_EXIT_ERROR;
+    }
+
+    typedef void (*bench_function)(MicroBench&, uint64_t);
+
+    const std::vector<std::pair<std::string, bench_function>> lcBench = {
+        { "Robot::advance", bench_robot_advance },
+        { "RobotPark::advance", bench_robotpark_advance },
+        { "RobotPark::get_instance_data", bench_robotpark_get_instance_data },
+        { "setup_indices", bench_setup_indices },
+        { "create_cube_arena", bench_create_cube_arena },
+        { "Cube::transform", bench_cube_transform },
+        { "vks::Frustum::checkSphere", bench_frustum_check_sphere },
+        { "InstanceCulling::cull", bench_instance_culling },
+        { "TextLayout::layout", bench_text_layout },
+    };
+
+    std::cout << std::left << std::setw(30) << "benchmark" << std::right
+        << std::setw(10) << "size"
+        << std::setw(15) << "median"
+        << std::setw(15) << "min"
+        << std::setw(10) << "cv"
+        << std::setw(13) << "per element" << std::endl;
+
+    for (const auto& bench : lcBench) {
+        if (!mb.enabled(bench.first)) {
+            continue;
+        }
+        for (uint64_t n = mb._minSize; n <= mb._maxSize; n *= 10) {
+            bench.second(mb, n);
+        }
+    }
+
+    if (!mb._filename.empty()) {
+        mb.save();
+    }
+
+    if (!mb._baseline.empty()) {
+        return mb.compare();
+    }
+
+    return 0;
+}
@@ -1,11 +1,180 @@
 
 #include "stdafx.h"
 #include "RobotPark.h"
+#include "Trace.h"
 
 #include <random>
+#include <algorithm>
+#include <numeric>
+
+#include <cmath>
+#include <cstring>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define ROBOTPARK_SSE2
+#endif
+
+// F16C has no MSVC macro of its own, every AVX2 capable cpu has it
+#if defined(ROBOTPARK_SSE2) && (defined(__F16C__) || defined(__AVX2__))
+#include <immintrin.h>
+#define ROBOTPARK_F16C
+#endif
+
+static uint32_t lowest_bit(uint64_t w) {
+#if defined(_MSC_VER)
+    unsigned long i;
+    _BitScanForward64(&i, w);
+    return uint32_t(i);
+#else
+    return uint32_t(__builtin_ctzll(w));
+#endif
+}
+
+// IEEE 754 binary16, round to nearest even like _mm_cvtps_ph
+static uint16_t float_to_half(float f) {
+    uint32_t x;
+    memcpy(&x, &f, sizeof(x));
+
+    uint16_t sign = uint16_t((x >> 16) & 0x8000);
+    uint32_t a = x & 0x7fffffff;
+
+    if (a >= 0x7f800000) {
+        // Inf or NaN, NaN stays quiet
+        return sign | 0x7c00 | ((a > 0x7f800000) ? 0x0200 : 0);
+    }
+
+    if (a >= 0x477ff000) {
+        // Rounds above 65504
+        return sign | 0x7c00;
+    }
+
+    if (a < 0x38800000) {
+        // Below the smallest normal half, scale into the subnormal range
+        float af;
+        memcpy(&af, &a, sizeof(af));
+        return sign | uint16_t(std::nearbyint(af * 16777216.0f));
+    }
+
+    // Rebias the exponent by 127 - 15 and round the 13 dropped mantissa bits
+    return sign | uint16_t((a + 0xc8000fff + ((a >> 13) & 1)) >> 13);
+}
+
+static int16_t quantize(double v) {
+    return int16_t(std::lrint(std::min(32767.0, std::max(-32768.0, v))));
+}
+
+// Spreads the low 16 bits of v over the even bits
+static uint32_t part_1by1(uint32_t v) {
+    v &= 0x0000ffff;
+    v = (v | (v << 8)) & 0x00ff00ff;
+    v = (v | (v << 4)) & 0x0f0f0f0f;
+    v = (v | (v << 2)) & 0x33333333;
+    v = (v | (v << 1)) & 0x55555555;
+    return v;
+}
+
+// Runs f(iChunk) for every chunk, one job per pool thread
+template<typename F>
+static void run_chunks(vks::ThreadPool& threadPool, uint32_t nChunk, F f) {
+
+    if (threadPool.threads.empty()) {
+        f(0);
+        return;
+    }
+
+    for (uint32_t iChunk = 0; iChunk < nChunk; iChunk++) {
+        threadPool.threads[iChunk]->addJob([&f, iChunk] { f(iChunk); });
+    }
+
+    threadPool.wait();
+}
+
+// Stable LSD radix sort of 32 bit keys with a value each, 8 bits per pass. Every pass histograms
+// and scatters one contiguous chunk per thread. Offsets are prefix summed digit major, thread
+// minor, so equal digits keep their input order across chunks. Passes where all keys share the
+// digit are skipped.
+static void parallel_radix_sort(
+    vks::ThreadPool& threadPool,
+    tracked_vector<uint32_t, MEMORY_ROBOTS>& lcKey,
+    tracked_vector<uint32_t, MEMORY_ROBOTS>& lcValue,
+    tracked_vector<uint32_t, MEMORY_ROBOTS>& lcKeyTmp,
+    tracked_vector<uint32_t, MEMORY_ROBOTS>& lcValueTmp) {
+
+    const uint32_t n = uint32_t(lcKey.size());
+    const uint32_t nChunk = std::max<uint32_t>(1, uint32_t(threadPool.threads.size()));
+    const uint32_t chunkSize = (n + nChunk - 1) / nChunk;
+
+    lcKeyTmp.resize(n);
+    lcValueTmp.resize(n);
+
+    std::vector<uint32_t> lcOffset(nChunk * 256);
+
+    uint32_t* pKey = lcKey.data();
+    uint32_t* pValue = lcValue.data();
+    uint32_t* pKeyOut = lcKeyTmp.data();
+    uint32_t* pValueOut = lcValueTmp.data();
+
+    for (uint32_t shift = 0; shift < 32; shift += 8) {
+
+        run_chunks(threadPool, nChunk, [&](uint32_t iChunk) {
+            uint32_t* pCount = &lcOffset[iChunk * 256];
+            std::fill(pCount, pCount + 256, 0);
+
+            uint32_t end = std::min(n, (iChunk + 1) * chunkSize);
+
+            for (uint32_t i = iChunk * chunkSize; i < end; i++) {
+                pCount[(pKey[i] >> shift) & 0xff]++;
+            }
+        });
+
+        uint32_t sum = 0;
+        bool skip = false;
+
+        for (uint32_t d = 0; d < 256; d++) {
+            uint32_t first = sum;
+
+            for (uint32_t iChunk = 0; iChunk < nChunk; iChunk++) {
+                uint32_t c = lcOffset[iChunk * 256 + d];
+                lcOffset[iChunk * 256 + d] = sum;
+                sum += c;
+            }
+
+            skip = skip || (sum - first == n);
+        }
+
+        if (skip) {
+            continue;
+        }
+
+        run_chunks(threadPool, nChunk, [&](uint32_t iChunk) {
+            uint32_t* pOffset = &lcOffset[iChunk * 256];
+
+            uint32_t end = std::min(n, (iChunk + 1) * chunkSize);
+
+            for (uint32_t i = iChunk * chunkSize; i < end; i++) {
+                uint32_t j = pOffset[(pKey[i] >> shift) & 0xff]++;
+                pKeyOut[j] = pKey[i];
+                pValueOut[j] = pValue[i];
+            }
+        });
+
+        std::swap(pKey, pKeyOut);
+        std::swap(pValue, pValueOut);
+    }
+
+    if (pKey != lcKey.data()) {
+        lcKey.swap(lcKeyTmp);
+        lcValue.swap(lcValueTmp);
+    }
+}
+
+RobotPark::RobotPark(uint32_t nInstances, uint32_t t) {
 
-RobotPark::RobotPark(uint32_t nInstances, uint32_t t) { 
-	
 
     std::default_random_engine generator;
     std::uniform_real_distribution<double> distribution(-1.f, 1.f);
@@ -13,6 +182,8 @@ RobotPark::RobotPark(uint32_t nInstances, uint32_t t) {
     double pos_scale = 100.0;
     double vel_scale = 0.001;
 
+    _boundary = pos_scale;
+
     for (uint32_t i = 0; i < nInstances; i++) {
         double x_pos = pos_scale * distribution(generator);
         double y_pos = pos_scale * distribution(generator);
@@ -26,11 +197,20 @@ RobotPark::RobotPark(uint32_t nInstances, uint32_t t) {
         _lcRobot.push_back(r);
     }
 
+    _lcDirty.resize((nInstances + 63) / 64, 0);
+
+    _lcSlot.resize(nInstances);
+    _lcHandle.resize(nInstances);
+
+    std::iota(_lcSlot.begin(), _lcSlot.end(), 0);
+    std::iota(_lcHandle.begin(), _lcHandle.end(), 0);
 }
 
 void
 RobotPark::advance(uint32_t t) {
 
+    TraceZone zone("RobotPark::advance");
+
     for (Robot& r : _lcRobot) {
         r.advance(t);
     }
@@ -43,9 +223,272 @@ RobotPark::instances() {
 }
 
 void
-RobotPark::get_instance_data(std::vector<instance_data>& lcData) {
+RobotPark::get_instance_data(tracked_vector<instance_data, MEMORY_INSTANCES>& lcData) {
 
-    for (Robot& r : _lcRobot) {
-        lcData.push_back( {float(r._x), float(r._y), float(r._dx), float(r._dy) });
+    size_t first = lcData.size();
+
+    lcData.resize(first + _lcRobot.size());
+
+    get_instance_data(lcData.data() + first, 0, instances());
+}
+
+// triangle.vert extrapolates the position as xy + epoch_ms * dxdy, where epoch_ms is the
+// session time since the epoch, so each robot is written as its trajectory origin at the
+// epoch. The record stays valid until the velocity changes or the epoch moves.
+void
+RobotPark::get_instance_data(instance_data* pData, uint32_t first, uint32_t count) {
+
+    for (uint32_t i = 0; i < count; i++) {
+        const Robot& r = _lcRobot[first + i];
+
+        double t = double(r._t) - double(_epoch);
+
+        pData[i] = { float(r._x - t * r._dx), float(r._y - t * r._dy), float(r._dx), float(r._dy) };
+    }
+}
+
+void
+RobotPark::set_epoch(uint32_t t) {
+
+    _epoch = t - t % INSTANCE_EPOCH_PERIOD;
+
+    set_all_dirty();
+}
+
+uint32_t
+RobotPark::epoch() {
+    return _epoch;
+}
+
+void
+RobotPark::get_instance_tile(instance_tile& tile, uint32_t t, uint32_t period) {
+
+    // Robots drift out of the park where they started, so the tile covers their positions at t
+    double maxSpeed = 0.0;
+    double maxPos = _boundary;
+
+    for (const Robot& r : _lcRobot) {
+        double dt = double(t) - double(r._t);
+
+        maxSpeed = std::max(maxSpeed, std::max(std::abs(r._dx), std::abs(r._dy)));
+        maxPos = std::max(maxPos, std::max(std::abs(r._x + dt * r._dx), std::abs(r._y + dt * r._dy)));
+    }
+
+    double extent = maxPos + maxSpeed * period;
+
+    tile.origin[0] = 0.0;
+    tile.origin[1] = 0.0;
+    tile.step = extent / 32767.0;
+    tile.t = t;
+}
+
+// Two robots per iteration: positions at the tile time are clamped and converted to int32 in
+// doubles, packed to int16 with saturation, velocities go through float to half (F16C when
+// available) and the two halves are interleaved into one 16 byte store.
+void
+RobotPark::get_compact_instance_data(compact_instance_data* pData, uint32_t first, uint32_t count, const instance_tile& tile) {
+
+    const double rStep = 1.0 / tile.step;
+    const double tRef = double(tile.t);
+
+    uint32_t i = 0;
+
+#if defined(ROBOTPARK_SSE2)
+
+    const __m128d origin = _mm_set_pd(tile.origin[1], tile.origin[0]);
+    const __m128d scale = _mm_set1_pd(rStep);
+    const __m128d lo = _mm_set1_pd(-32768.0);
+    const __m128d hi = _mm_set1_pd(32767.0);
+    const __m128d perSecond = _mm_set1_pd(1000.0);
+
+    for (; i + 2 <= count; i += 2) {
+        const Robot& r0 = _lcRobot[first + i];
+        const Robot& r1 = _lcRobot[first + i + 1];
+
+        __m128d v0 = _mm_loadu_pd(&r0._dx);
+        __m128d v1 = _mm_loadu_pd(&r1._dx);
+
+        __m128d p0 = _mm_add_pd(_mm_loadu_pd(&r0._x), _mm_mul_pd(_mm_set1_pd(tRef - double(r0._t)), v0));
+        __m128d p1 = _mm_add_pd(_mm_loadu_pd(&r1._x), _mm_mul_pd(_mm_set1_pd(tRef - double(r1._t)), v1));
+
+        p0 = _mm_min_pd(hi, _mm_max_pd(lo, _mm_mul_pd(_mm_sub_pd(p0, origin), scale)));
+        p1 = _mm_min_pd(hi, _mm_max_pd(lo, _mm_mul_pd(_mm_sub_pd(p1, origin), scale)));
+
+        __m128i q = _mm_unpacklo_epi64(_mm_cvtpd_epi32(p0), _mm_cvtpd_epi32(p1));
+        q = _mm_packs_epi32(q, q);
+
+        __m128 v = _mm_movelh_ps(_mm_cvtpd_ps(_mm_mul_pd(v0, perSecond)), _mm_cvtpd_ps(_mm_mul_pd(v1, perSecond)));
+
+#if defined(ROBOTPARK_F16C)
+        __m128i h = _mm_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT);
+#else
+        float af[4];
+        _mm_storeu_ps(af, v);
+        __m128i h = _mm_setr_epi16(
+            short(float_to_half(af[0])), short(float_to_half(af[1])),
+            short(float_to_half(af[2])), short(float_to_half(af[3])),
+            0, 0, 0, 0);
+#endif
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(pData + i), _mm_unpacklo_epi32(q, h));
+    }
+
+#endif
+
+    for (; i < count; i++) {
+        const Robot& r = _lcRobot[first + i];
+
+        double dt = tRef - double(r._t);
+
+        pData[i].pos[0] = quantize((r._x + dt * r._dx - tile.origin[0]) * rStep);
+        pData[i].pos[1] = quantize((r._y + dt * r._dy - tile.origin[1]) * rStep);
+        pData[i].vel[0] = float_to_half(float(r._dx * 1000.0));
+        pData[i].vel[1] = float_to_half(float(r._dy * 1000.0));
+    }
+}
+
+void
+RobotPark::set_velocity(uint32_t handle, double dx, double dy, uint32_t t) {
+
+    uint32_t i = _lcSlot[handle];
+
+    Robot& r = _lcRobot[i];
+
+    r.advance(t);
+
+    r._dx = dx;
+    r._dy = dy;
+
+    set_dirty(i);
+}
+
+uint32_t
+RobotPark::slot(uint32_t handle) {
+    return _lcSlot[handle];
+}
+
+// Keys are the robots' current positions quantized to 16 bits per axis over the park and
+// interleaved. Robots outside the boundary are clamped onto the edge.
+void
+RobotPark::reorder(vks::ThreadPool& threadPool) {
+
+    const uint32_t n = instances();
+    const uint32_t nChunk = std::max<uint32_t>(1, uint32_t(threadPool.threads.size()));
+    const uint32_t chunkSize = (n + nChunk - 1) / nChunk;
+
+    const double scale = 65535.0 / (2.0 * _boundary);
+
+    _lcKey.resize(n);
+    _lcOrder.resize(n);
+
+    run_chunks(threadPool, nChunk, [&](uint32_t iChunk) {
+        uint32_t end = std::min(n, (iChunk + 1) * chunkSize);
+
+        for (uint32_t i = iChunk * chunkSize; i < end; i++) {
+            const Robot& r = _lcRobot[i];
+
+            uint32_t qx = uint32_t(std::min(65535.0, std::max(0.0, (r._x + _boundary) * scale)));
+            uint32_t qy = uint32_t(std::min(65535.0, std::max(0.0, (r._y + _boundary) * scale)));
+
+            _lcKey[i] = part_1by1(qx) | (part_1by1(qy) << 1);
+            _lcOrder[i] = i;
+        }
+    });
+
+    parallel_radix_sort(threadPool, _lcKey, _lcOrder, _lcKeyTmp, _lcOrderTmp);
+
+    // Gather robots and handles into the sorted order, then point the handles at their new slots
+    _lcRobotTmp.resize(n);
+    _lcKeyTmp.resize(n);
+
+    run_chunks(threadPool, nChunk, [&](uint32_t iChunk) {
+        uint32_t end = std::min(n, (iChunk + 1) * chunkSize);
+
+        for (uint32_t j = iChunk * chunkSize; j < end; j++) {
+            uint32_t i = _lcOrder[j];
+
+            _lcRobotTmp[j] = _lcRobot[i];
+            _lcKeyTmp[j] = _lcHandle[i];
+            _lcSlot[_lcHandle[i]] = j;
+        }
+    });
+
+    _lcRobot.swap(_lcRobotTmp);
+    _lcHandle.swap(_lcKeyTmp);
+
+    set_all_dirty();
+}
+
+void
+RobotPark::set_dirty(uint32_t i) {
+
+    uint64_t bit = uint64_t(1) << (i & 63);
+    uint64_t& w = _lcDirty[i >> 6];
+
+    if ((w & bit) == 0) {
+        w |= bit;
+        _nDirty++;
     }
 }
+
+uint32_t
+RobotPark::dirty_count() {
+    return _nDirty;
+}
+
+void
+RobotPark::set_all_dirty() {
+
+    std::fill(_lcDirty.begin(), _lcDirty.end(), ~uint64_t(0));
+
+    // Bits past the last robot stay clear, get_dirty_ranges must not report them
+    uint32_t tail = instances() & 63;
+
+    if (tail != 0) {
+        _lcDirty.back() = (uint64_t(1) << tail) - 1;
+    }
+
+    _nDirty = instances();
+}
+
+void
+RobotPark::get_dirty_ranges(frame_vector<dirty_range>& lcRange, uint32_t maxGap) {
+
+    lcRange.clear();
+
+    if (_nDirty == 0) {
+        return;
+    }
+
+    for (uint32_t iWord = 0; iWord < _lcDirty.size(); iWord++) {
+        uint64_t w = _lcDirty[iWord];
+
+        while (w != 0) {
+            uint32_t i = (iWord << 6) + lowest_bit(w);
+            w &= w - 1;
+
+            if (!lcRange.empty()) {
+                dirty_range& last = lcRange.back();
+                uint32_t end = last.first + last.count;
+
+                if (i - end <= maxGap) {
+                    last.count = i + 1 - last.first;
+                    continue;
+                }
+            }
+
+            lcRange.push_back({ i, 1 });
+        }
+    }
+}
+
+void
+RobotPark::clear_dirty() {
+
+    if (_nDirty == 0) {
+        return;
+    }
+
+    std::fill(_lcDirty.begin(), _lcDirty.end(), uint64_t(0));
+    _nDirty = 0;
+}
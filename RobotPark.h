@@ -3,15 +3,92 @@
 
 #include "Robot.h"
 #include "ArenaCubes.h"
+#include "threadpool.hpp"
+#include "MemoryAccounting.h"
+#include "FrameArena.h"
 #include <vector>
 #include <cstdint>
 
+// Run of robots [first, first + count) whose instance data is out of date on the GPU
+struct dirty_range {
+	uint32_t first;
+	uint32_t count;
+};
+
+// Quantization frame of compact_instance_data. Positions are given at time t, so a record
+// only has to cover the distance a robot travels within one tile period.
+struct instance_tile {
+	double origin[2];
+	// Park units per 16 bit position step
+	double step;
+	uint32_t t;
+};
+
+// How long (ms) a compact tile is used before the stream is re-encoded at a new reference time
+#define INSTANCE_TILE_PERIOD 16384
+
+// Interval (ms) between rebases of the instance_data epoch. The records and the shader time are
+// relative to the epoch, so neither grows with the session and float precision stays at 1/256 ms.
+// Epochs are multiples of the period, exact in a float for the whole uint32_t session time range.
+#define INSTANCE_EPOCH_PERIOD 65536
+
+// Interval (ms) between Morton reorders of the park storage (-morton). Robots drift slowly,
+// so the order stays useful for many ticks and the full re-upload after a sort is rare.
+#define ROBOTPARK_REORDER_PERIOD 4096
+
 class RobotPark {
-	std::vector<Robot> _lcRobot;
+	// Storage order, which is also the instance buffer order. reorder() permutes it
+	tracked_vector<Robot, MEMORY_ROBOTS> _lcRobot;
+
+	// Stable handles: _lcSlot[handle] is the robot's current index, _lcHandle the inverse
+	tracked_vector<uint32_t, MEMORY_ROBOTS> _lcSlot;
+	tracked_vector<uint32_t, MEMORY_ROBOTS> _lcHandle;
+
+	// Scratch for reorder(), kept to avoid reallocating every period
+	tracked_vector<uint32_t, MEMORY_ROBOTS> _lcKey;
+	tracked_vector<uint32_t, MEMORY_ROBOTS> _lcOrder;
+	tracked_vector<uint32_t, MEMORY_ROBOTS> _lcKeyTmp;
+	tracked_vector<uint32_t, MEMORY_ROBOTS> _lcOrderTmp;
+	tracked_vector<Robot, MEMORY_ROBOTS> _lcRobotTmp;
+
+	// One bit per robot, set when the robot's velocity changes
+	tracked_vector<uint64_t, MEMORY_ROBOTS> _lcDirty;
+	uint32_t _nDirty = 0;
+
+	// Robots start within +/- _boundary
+	double _boundary;
+
+	// Session time (ms) the instance_data origins refer to
+	uint32_t _epoch = 0;
+
+	void set_dirty(uint32_t i);
 public:
 	RobotPark(uint32_t nInstances, uint32_t t);
 	void advance(uint32_t t);
 	uint32_t instances();
-	void get_instance_data(std::vector<instance_data>& lcData);
+	void get_instance_data(tracked_vector<instance_data, MEMORY_INSTANCES>& lcData);
+	void get_instance_data(instance_data* pData, uint32_t first, uint32_t count);
+
+	// Moves the instance_data epoch to t rounded down to INSTANCE_EPOCH_PERIOD. Marks every robot dirty
+	void set_epoch(uint32_t t);
+	uint32_t epoch();
+
+	// Tile covering the park for records extrapolated up to period ms past t
+	void get_instance_tile(instance_tile& tile, uint32_t t, uint32_t period);
+	void get_compact_instance_data(compact_instance_data* pData, uint32_t first, uint32_t count, const instance_tile& tile);
+
+	// Robots are addressed by handle, which survives reorder()
+	void set_velocity(uint32_t handle, double dx, double dy, uint32_t t);
+	uint32_t slot(uint32_t handle);
+
+	// Sorts storage by the Morton (Z-order) key of each robot's position so spatial neighbors
+	// are close in memory and in the instance buffer. Marks every robot dirty.
+	void reorder(vks::ThreadPool& threadPool);
+
+	uint32_t dirty_count();
+	void set_all_dirty();
+	// Coalesces dirty robots into ranges, bridging clean gaps of up to maxGap robots
+	void get_dirty_ranges(frame_vector<dirty_range>& lcRange, uint32_t maxGap);
+	void clear_dirty();
 
 };
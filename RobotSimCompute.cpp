@@ -0,0 +1,239 @@
+
+
+#include "stdafx.h"
+#include "RobotSimCompute.h"
+
+#include <array>
+#include <vector>
+#include <stdexcept>
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+//
+//   RobotSimCompute
+//
+//   Constructor
+//
+
+RobotSimCompute::RobotSimCompute(
+    vks::VulkanDevice* vulkanDevice,
+    UploadService* uploadService,
+    VkPipelineCache pipelineCache,
+    RobotPark* robotPark,
+    VkDescriptorBufferInfo uboDescriptor,
+    VkPipelineShaderStageCreateInfo shaderStage)
+{
+    this->_vulkanDevice = vulkanDevice;
+
+    // The dispatch is recorded into the draw command buffers, so the graphics queue must also do compute
+    uint32_t graphicsFamily = _vulkanDevice->queueFamilyIndices.graphics;
+
+    if ((_vulkanDevice->queueFamilyProperties[graphicsFamily].queueFlags & VK_QUEUE_COMPUTE_BIT) == 0) {
+        throw std::runtime_error("graphics queue does not support compute, gpu robot simulation unavailable");
+    }
+
+    _params.count = robotPark->instances();
+
+    prepareResources(uploadService, robotPark);
+    prepareDescriptors(uboDescriptor);
+    preparePipeline(pipelineCache, shaderStage);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+//
+//   ~RobotSimCompute
+//
+
+RobotSimCompute::~RobotSimCompute()
+{
+    VkDevice device = _vulkanDevice->logicalDevice;
+
+    vkDestroyPipeline(device, _pipeline, nullptr);
+    vkDestroyPipelineLayout(device, _pipelineLayout, nullptr);
+    vkDestroyDescriptorSetLayout(device, _descriptorSetLayout, nullptr);
+    vkDestroyDescriptorPool(device, _descriptorPool, nullptr);
+
+    vkDestroyBuffer(device, _stateBuffer, nullptr);
+    vks::memory::freeMemory(device, _stateMemory);
+    vkDestroyBuffer(device, _instanceBuffer, nullptr);
+    vks::memory::freeMemory(device, _instanceMemory);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+//
+//   prepareResources
+//
+//   Both buffers are device local. The state buffer is filled once by the upload service,
+//   the instance buffer is written by the first dispatch before any draw reads it.
+//
+
+void RobotSimCompute::prepareResources(UploadService* uploadService, RobotPark* robotPark)
+{
+    tracked_vector<instance_data, MEMORY_INSTANCES> lcInstance;
+
+    robotPark->get_instance_data(lcInstance);
+
+    // Start every robot at its trajectory origin at the epoch, the first dispatch advances it
+    std::vector<robot_state> lcState(lcInstance.size());
+
+    const float epoch = float(robotPark->epoch());
+
+    for (size_t i = 0; i < lcInstance.size(); i++) {
+        const float* d = lcInstance[i].data;
+        lcState[i] = { { d[0], d[1] }, { d[2], d[3] }, 0.f, epoch, { 0.f, 0.f } };
+    }
+
+    VkDeviceSize stateSize = lcState.size() * sizeof(robot_state);
+    VkDeviceSize instanceSize = lcInstance.size() * sizeof(instance_data);
+
+    VK_CHECK_RESULT(_vulkanDevice->createBuffer(
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        stateSize,
+        &_stateBuffer,
+        &_stateMemory));
+
+    VK_CHECK_RESULT(_vulkanDevice->createBuffer(
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        instanceSize,
+        &_instanceBuffer,
+        &_instanceMemory));
+
+    uploadService->uploadBuffer(_stateBuffer, 0, lcState.data(), stateSize, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+//
+//   prepareDescriptors
+//
+//   Binding 0: Robot state, binding 1: Instance stream, binding 2: Arena uniform buffer (session time,
+//   dynamic, the offset selects the frame's slice)
+//
+
+void RobotSimCompute::prepareDescriptors(VkDescriptorBufferInfo uboDescriptor)
+{
+    VkDevice device = _vulkanDevice->logicalDevice;
+
+    std::array<VkDescriptorPoolSize, 2> poolSizes;
+    poolSizes[0] = vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2);
+    poolSizes[1] = vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1);
+
+    VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::descriptorPoolCreateInfo(uint32_t(poolSizes.size()), poolSizes.data(), 1);
+    VK_CHECK_RESULT(vkCreateDescriptorPool(device, &descriptorPoolInfo, nullptr, &_descriptorPool));
+
+    std::array<VkDescriptorSetLayoutBinding, 3> setLayoutBindings;
+    setLayoutBindings[0] = vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 0);
+    setLayoutBindings[1] = vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 1);
+    setLayoutBindings[2] = vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, VK_SHADER_STAGE_COMPUTE_BIT, 2);
+
+    VkDescriptorSetLayoutCreateInfo descriptorLayout = vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings.data(), uint32_t(setLayoutBindings.size()));
+    VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &descriptorLayout, nullptr, &_descriptorSetLayout));
+
+    VkDescriptorSetAllocateInfo allocInfo = vks::initializers::descriptorSetAllocateInfo(_descriptorPool, &_descriptorSetLayout, 1);
+    VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &_descriptorSet));
+
+    updateDescriptors(uboDescriptor);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+//
+//   updateDescriptors
+//
+
+void RobotSimCompute::updateDescriptors(VkDescriptorBufferInfo uboDescriptor)
+{
+    VkDevice device = _vulkanDevice->logicalDevice;
+
+    VkDescriptorBufferInfo stateDescriptor = { _stateBuffer, 0, VK_WHOLE_SIZE };
+    VkDescriptorBufferInfo instanceDescriptor = { _instanceBuffer, 0, VK_WHOLE_SIZE };
+
+    std::array<VkWriteDescriptorSet, 3> writeDescriptorSets;
+    writeDescriptorSets[0] = vks::initializers::writeDescriptorSet(_descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 0, &stateDescriptor);
+    writeDescriptorSets[1] = vks::initializers::writeDescriptorSet(_descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, &instanceDescriptor);
+    writeDescriptorSets[2] = vks::initializers::writeDescriptorSet(_descriptorSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 2, &uboDescriptor);
+
+    vkUpdateDescriptorSets(device, uint32_t(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+//
+//   preparePipeline
+//
+
+void RobotSimCompute::preparePipeline(VkPipelineCache pipelineCache, VkPipelineShaderStageCreateInfo shaderStage)
+{
+    VkDevice device = _vulkanDevice->logicalDevice;
+
+    // The robot count never changes, so it is pushed once at record time
+    VkPushConstantRange pushConstantRange = vks::initializers::pushConstantRange(VK_SHADER_STAGE_COMPUTE_BIT, sizeof(_params), 0);
+
+    VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = vks::initializers::pipelineLayoutCreateInfo(&_descriptorSetLayout, 1);
+    pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+    pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+    VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, nullptr, &_pipelineLayout));
+
+    VkComputePipelineCreateInfo computePipelineCreateInfo = vks::initializers::computePipelineCreateInfo(_pipelineLayout, 0);
+    computePipelineCreateInfo.stage = shaderStage;
+    VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, &computePipelineCreateInfo, nullptr, &_pipeline));
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+//
+//   recordDispatch
+//
+//   All frames share the state and instance buffers. The leading barrier orders this dispatch after
+//   the previous frame's dispatch and instanced draw, the trailing one makes the new instance stream
+//   visible to the vertex input stage.
+//
+
+void RobotSimCompute::recordDispatch(VkCommandBuffer cmdBuffer, uint32_t uboOffset)
+{
+    VkMemoryBarrier memoryBarrier = vks::initializers::memoryBarrier();
+    memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+    vkCmdPipelineBarrier(
+        cmdBuffer,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        0,
+        1, &memoryBarrier,
+        0, nullptr,
+        0, nullptr);
+
+    vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _pipeline);
+    vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _pipelineLayout, 0, 1, &_descriptorSet, 1, &uboOffset);
+    vkCmdPushConstants(cmdBuffer, _pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(_params), &_params);
+
+    vkCmdDispatch(cmdBuffer, (_params.count + ROBOTSIM_GROUP_SIZE - 1) / ROBOTSIM_GROUP_SIZE, 1, 1);
+
+    VkBufferMemoryBarrier bufferBarrier = vks::initializers::bufferMemoryBarrier();
+    bufferBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    bufferBarrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+    bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    bufferBarrier.buffer = _instanceBuffer;
+    bufferBarrier.offset = 0;
+    bufferBarrier.size = VK_WHOLE_SIZE;
+
+    vkCmdPipelineBarrier(
+        cmdBuffer,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+        0,
+        0, nullptr,
+        1, &bufferBarrier,
+        0, nullptr);
+}
+
+uint32_t RobotSimCompute::instances()
+{
+    return _params.count;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+
+#include <vulkan/vulkan.h>
+#include "VulkanDevice.hpp"
+
+#include "RobotPark.h"
+#include "UploadService.h"
+
+/*
+* RobotSimCompute:
+*
+* GPU backend for the robot park. The robot state lives in a device local storage buffer,
+* robotsim.comp advances it and writes the instance stream that
+* the arena pipeline reads as its per instance vertex buffer. Nothing is uploaded per frame.
+*/
+
+// Work group size of robotsim.comp
+#define ROBOTSIM_GROUP_SIZE 256
+
+class RobotSimCompute
+{
+private:
+    vks::VulkanDevice* _vulkanDevice;
+
+    // Matches RobotState in robotsim.comp (std430, 32 bytes)
+    struct robot_state {
+        float pos[2];
+        float vel[2];
+        float t;
+        float epoch;
+        float pad[2];
+    };
+
+    struct {
+        uint32_t count;
+    } _params;
+
+    VkBuffer _stateBuffer;
+    VkDeviceMemory _stateMemory;
+
+    VkDescriptorPool _descriptorPool;
+    VkDescriptorSetLayout _descriptorSetLayout;
+    VkDescriptorSet _descriptorSet;
+    VkPipelineLayout _pipelineLayout;
+    VkPipeline _pipeline;
+
+public:
+
+    // Instance stream, same layout as instance_data. Bound as vertex buffer 1 by the arena pipeline
+    VkBuffer _instanceBuffer;
+    VkDeviceMemory _instanceMemory;
+
+    RobotSimCompute(
+        vks::VulkanDevice* vulkanDevice,
+        UploadService* uploadService,
+        VkPipelineCache pipelineCache,
+        RobotPark* robotPark,
+        VkDescriptorBufferInfo uboDescriptor,
+        VkPipelineShaderStageCreateInfo shaderStage);
+
+    ~RobotSimCompute();
+
+    // Create the state and instance buffers and upload the initial park
+    void prepareResources(UploadService* uploadService, RobotPark* robotPark);
+
+    void prepareDescriptors(VkDescriptorBufferInfo uboDescriptor);
+
+    // Points the set at a new uniform buffer. No command buffer using it may be pending
+    void updateDescriptors(VkDescriptorBufferInfo uboDescriptor);
+
+    void preparePipeline(VkPipelineCache pipelineCache, VkPipelineShaderStageCreateInfo shaderStage);
+
+    // Records the simulation step reading the uniform slice at uboOffset. Must be outside a render pass,
+    // before the instanced draw
+    void recordDispatch(VkCommandBuffer cmdBuffer, uint32_t uboOffset);
+
+    uint32_t instances();
+};
@@ -0,0 +1,259 @@
+
+#include "stdafx.h"
+#include "StartupGraph.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <stdexcept>
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+//
+//   add
+//
+//   Dependencies must have been added before, so the graph cannot contain a cycle
+//
+
+StartupGraph::task_id StartupGraph::add(const std::string& name, std::function<void()> function, std::vector<task_id> lcDependency, bool mainThread)
+{
+    const task_id id = task_id(_lcTask.size());
+
+    task t;
+    t.name = name;
+    t.function = function;
+    t.mainThread = mainThread;
+    t.waiting = 0;
+    t.start = 0.0;
+    t.end = 0.0;
+    t.thread = none;
+
+    for (task_id dependency : lcDependency) {
+        if (dependency == none) {
+            continue;
+        }
+        if (dependency >= id) {
+            throw std::runtime_error("startup step " + name + " depends on a step that was not added before it");
+        }
+        t.lcDependency.push_back(dependency);
+        _lcTask[dependency].lcDependent.push_back(id);
+        ++t.waiting;
+    }
+
+    _lcTask.push_back(t);
+
+    return id;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+//
+//   elapsed
+//
+
+double StartupGraph::elapsed(clock::time_point t0)
+{
+    return std::chrono::duration<double, std::milli>(clock::now() - t0).count();
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+//
+//   run
+//
+//   The calling thread schedules. It hands every ready worker step to the pool thread with the
+//   fewest unfinished steps, runs ready main thread steps itself and otherwise sleeps until a
+//   worker step finishes
+//
+
+void StartupGraph::run(vks::ThreadPool& threadPool)
+{
+    const clock::time_point t0 = clock::now();
+    const uint32_t threadCount = uint32_t(threadPool.threads.size());
+
+    // Unfinished steps queued on each pool thread
+    std::vector<uint32_t> lcLoad(threadCount, 0);
+
+    std::vector<task_id> lcReady;
+    std::vector<task_id> lcMain;
+    std::vector<task_id> lcFinished;
+
+    for (task_id id = 0; id < _lcTask.size(); ++id) {
+        if (_lcTask[id].waiting == 0) {
+            lcReady.push_back(id);
+        }
+    }
+
+    size_t finished = 0;
+    uint32_t running = 0;
+
+    auto complete = [&](task_id id) {
+        ++finished;
+        for (task_id dependent : _lcTask[id].lcDependent) {
+            if (--_lcTask[dependent].waiting == 0) {
+                lcReady.push_back(dependent);
+            }
+        }
+    };
+
+    while (finished < _lcTask.size()) {
+
+        bool failed;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            failed = (_error != nullptr);
+        }
+
+        // Nothing new is started once a step has failed
+        if (!failed) {
+            for (task_id id : lcReady) {
+                task& t = _lcTask[id];
+
+                if (t.mainThread || (threadCount == 0)) {
+                    lcMain.push_back(id);
+                    continue;
+                }
+
+                const uint32_t iThread = uint32_t(std::min_element(lcLoad.begin(), lcLoad.end()) - lcLoad.begin());
+
+                ++lcLoad[iThread];
+                ++running;
+                t.thread = iThread;
+
+                threadPool.threads[iThread]->addJob([this, id, t0] {
+                    task& t = _lcTask[id];
+
+                    t.start = elapsed(t0);
+                    try {
+                        t.function();
+                    }
+                    catch (...) {
+                        std::lock_guard<std::mutex> lock(_mutex);
+                        if (_error == nullptr) {
+                            _error = std::current_exception();
+                        }
+                    }
+                    t.end = elapsed(t0);
+
+                    std::lock_guard<std::mutex> lock(_mutex);
+                    _lcFinished.push_back(id);
+                    _condition.notify_one();
+                });
+            }
+            lcReady.clear();
+
+            if (!lcMain.empty()) {
+                const task_id id = lcMain.front();
+                lcMain.erase(lcMain.begin());
+
+                task& t = _lcTask[id];
+
+                t.start = elapsed(t0);
+                try {
+                    t.function();
+                }
+                catch (...) {
+                    std::lock_guard<std::mutex> lock(_mutex);
+                    if (_error == nullptr) {
+                        _error = std::current_exception();
+                    }
+                }
+                t.end = elapsed(t0);
+
+                complete(id);
+                continue;
+            }
+        }
+
+        if (running == 0) {
+            break;
+        }
+
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _condition.wait(lock, [this] { return !_lcFinished.empty(); });
+            lcFinished.swap(_lcFinished);
+        }
+
+        for (task_id id : lcFinished) {
+            --lcLoad[_lcTask[id].thread];
+            --running;
+            complete(id);
+        }
+        lcFinished.clear();
+    }
+
+    _runTime = elapsed(t0);
+
+    if (_error != nullptr) {
+        std::exception_ptr error = _error;
+        _error = nullptr;
+        std::rethrow_exception(error);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+//
+//   report
+//
+
+void StartupGraph::report(std::ostream& os)
+{
+    if (_lcTask.empty()) {
+        return;
+    }
+
+    os << std::fixed << std::setprecision(2);
+    os << "Startup: " << _runTime << " ms, " << _lcTask.size() << " steps" << std::endl;
+
+    double busy = 0.0;
+
+    for (const task& t : _lcTask) {
+        os << "  " << std::setw(8) << t.start << " - " << std::setw(8) << t.end << " ms  " << std::setw(8) << (t.end - t.start) << " ms  ";
+        if (t.thread == none) {
+            os << "main      ";
+        }
+        else {
+            os << "worker " << std::setw(2) << t.thread << " ";
+        }
+        os << t.name << std::endl;
+
+        busy += t.end - t.start;
+    }
+
+    os << "  step time " << busy << " ms, average parallelism " << (busy / std::max(_runTime, 0.001)) << std::endl;
+
+    // Walk back from the last step to finish, always through the dependency that finished last
+    task_id id = 0;
+    for (task_id i = 1; i < _lcTask.size(); ++i) {
+        if (_lcTask[i].end > _lcTask[id].end) {
+            id = i;
+        }
+    }
+
+    std::vector<task_id> lcPath;
+
+    while (id != none) {
+        lcPath.push_back(id);
+
+        task_id gate = none;
+        for (task_id dependency : _lcTask[id].lcDependency) {
+            if ((gate == none) || (_lcTask[dependency].end > _lcTask[gate].end)) {
+                gate = dependency;
+            }
+        }
+        id = gate;
+    }
+
+    double pathTime = 0.0;
+
+    os << "Critical path:" << std::endl;
+    for (auto it = lcPath.rbegin(); it != lcPath.rend(); ++it) {
+        const task& t = _lcTask[*it];
+        os << "  " << std::setw(8) << (t.end - t.start) << " ms  " << t.name << std::endl;
+        pathTime += t.end - t.start;
+    }
+
+    // The rest of the path is spent queued behind other steps on the same thread
+    os << "  " << pathTime << " ms in steps, " << (_lcTask[lcPath.front()].end - pathTime) << " ms waiting for a thread" << std::endl;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+
+#include "threadpool.hpp"
+
+#include <chrono>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/*
+* StartupGraph:
+*
+* Runs the steps of VulkanExampleBase::prepare() as a dependency graph. A step starts once all of
+* its dependencies have finished. Worker steps go to the least loaded thread of a vks::ThreadPool,
+* main thread steps run on the thread calling run(). The upload service and the main command pool
+* are only used on the calling thread.
+*
+* Every step is timed. report() prints the steps and the critical path, the chain of steps that
+* each waited for the previous one and that ends with the last step to finish.
+*/
+
+class StartupGraph
+{
+public:
+    typedef uint32_t task_id;
+
+    // Returned for steps that are not added, ignored when passed as a dependency
+    static const task_id none = UINT32_MAX;
+
+private:
+    typedef std::chrono::high_resolution_clock clock;
+
+    struct task {
+        std::string name;
+        std::function<void()> function;
+        std::vector<task_id> lcDependency;
+        bool mainThread;
+
+        // Dependencies that have not finished yet
+        uint32_t waiting;
+        std::vector<task_id> lcDependent;
+
+        // ms since run() started
+        double start;
+        double end;
+        // Pool thread index, none for the calling thread
+        uint32_t thread;
+    };
+
+    std::vector<task> _lcTask;
+
+    // Wall time of the last run()
+    double _runTime = 0.0;
+
+    // Worker completions, guarded by _mutex
+    std::mutex _mutex;
+    std::condition_variable _condition;
+    std::vector<task_id> _lcFinished;
+    std::exception_ptr _error;
+
+    double elapsed(clock::time_point t0);
+
+public:
+
+    // Adds a step that runs once every step in lcDependency has finished
+    task_id add(const std::string& name, std::function<void()> function, std::vector<task_id> lcDependency = {}, bool mainThread = false);
+
+    // Runs every step and returns when all have finished. An exception thrown by a step is rethrown here
+    // after the steps already running have finished
+    void run(vks::ThreadPool& threadPool);
+
+    // Per step timings and the critical path of the last run()
+    void report(std::ostream& os);
+};
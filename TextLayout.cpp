@@ -0,0 +1,97 @@
+
+#include "stdafx.h"
+#include "TextLayout.h"
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+//
+//   prepareFont
+//
+
+void TextLayout::prepareFont(unsigned char* pPixels)
+{
+    typedef unsigned char font_row[STB_FONT_consolas_24_latin1_BITMAP_WIDTH];
+
+    // The bitmap is padded to a square power of two, the rows past the glyphs stay untouched
+    stb_font_consolas_24_latin1(_stbFontData, reinterpret_cast<font_row*>(pPixels), TEXTLAYOUT_FONT_SIZE);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+//
+//   layout
+//
+
+uint32_t TextLayout::layout(const char* text, float x, float y, TextAlign align, uint32_t width, uint32_t height, float* pVertex, uint32_t maxLetters) const
+{
+    const uint32_t firstChar = STB_FONT_consolas_24_latin1_FIRST_CHAR;
+
+    const float charW = 1.5f / width;
+    const float charH = 1.5f / height;
+
+    float fbW = (float)width;
+    float fbH = (float)height;
+    x = (x / fbW * 2.0f) - 1.0f;
+    y = (y / fbH * 2.0f) - 1.0f;
+
+    // Calculate text width
+    float textWidth = 0;
+    for (const char* pLetter = text; *pLetter != '\0'; pLetter++)
+    {
+        const stb_fontchar* charData = &_stbFontData[(uint32_t)*pLetter - firstChar];
+        textWidth += charData->advance * charW;
+    }
+
+    switch (align)
+    {
+    case alignRight:
+        x -= textWidth;
+        break;
+    case alignCenter:
+        x -= textWidth / 2.0f;
+        break;
+    default:
+        break;
+    }
+
+    uint32_t numLetters = 0;
+
+    // Generate a uv mapped quad per char in the new text
+    for (const char* pLetter = text; *pLetter != '\0'; pLetter++)
+    {
+        if (numLetters == maxLetters)
+        {
+            break;
+        }
+
+        const stb_fontchar* charData = &_stbFontData[(uint32_t)*pLetter - firstChar];
+
+        pVertex[0] = (x + (float)charData->x0 * charW);
+        pVertex[1] = (y + (float)charData->y0 * charH);
+        pVertex[2] = charData->s0;
+        pVertex[3] = charData->t0;
+
+        pVertex[4] = (x + (float)charData->x1 * charW);
+        pVertex[5] = (y + (float)charData->y0 * charH);
+        pVertex[6] = charData->s1;
+        pVertex[7] = charData->t0;
+
+        pVertex[8] = (x + (float)charData->x0 * charW);
+        pVertex[9] = (y + (float)charData->y1 * charH);
+        pVertex[10] = charData->s0;
+        pVertex[11] = charData->t1;
+
+        pVertex[12] = (x + (float)charData->x1 * charW);
+        pVertex[13] = (y + (float)charData->y1 * charH);
+        pVertex[14] = charData->s1;
+        pVertex[15] = charData->t1;
+
+        pVertex += 16;
+
+        x += charData->advance * charW;
+
+        numLetters++;
+    }
+
+    return numLetters;
+}
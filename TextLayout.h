@@ -0,0 +1,35 @@
+#pragma once
+
+
+#include "stb_font_consolas_24_latin1.inl"
+
+#include <cstdint>
+
+/*
+* TextLayout:
+*
+* Glyph metrics of the overlay font and the layout of strings into letter quads. Does not
+* depend on Vulkan, TextOverlay writes the quads into its mapped vertex buffer and the
+* microbenchmarks lay out into plain memory.
+*/
+
+// Width and height of the font bitmap written by prepareFont()
+#define TEXTLAYOUT_FONT_SIZE STB_FONT_consolas_24_latin1_BITMAP_WIDTH
+
+class TextLayout
+{
+private:
+    stb_fontchar _stbFontData[STB_FONT_consolas_24_latin1_NUM_CHARS];
+
+public:
+
+    enum TextAlign { alignLeft, alignCenter, alignRight };
+
+    // Generates the glyph metrics and writes the font bitmap, TEXTLAYOUT_FONT_SIZE squared bytes, to pPixels
+    void prepareFont(unsigned char* pPixels);
+
+    // Writes four vertices (x, y, s, t) per letter of the null terminated text to pVertex, in normalized
+    // device coordinates for a width x height framebuffer. x and y are the framebuffer position of the
+    // text. Stops after maxLetters letters and returns the number of letters written
+    uint32_t layout(const char* text, float x, float y, TextAlign align, uint32_t width, uint32_t height, float* pVertex, uint32_t maxLetters) const;
+};
@@ -13,34 +13,26 @@
 
 TextOverlay::TextOverlay(
     vks::VulkanDevice* vulkanDevice,
-    VkQueue queue,
-    std::vector<VkFramebuffer>& framebuffers,
-    VkFormat colorformat,
-    VkFormat depthformat,
+    UploadService* uploadService,
+    VkPipelineCache pipelineCache,
+    VkRenderPass renderPass,
+    uint32_t bufferCount,
     uint32_t* framebufferwidth,
     uint32_t* framebufferheight,
     std::vector<VkPipelineShaderStageCreateInfo> shaderstages)
 {
     this->_vulkanDevice = vulkanDevice;
-    this->_queue = queue;
-    this->_colorFormat = colorformat;
-    this->_depthFormat = depthformat;
-
-    this->_frameBuffers.resize(framebuffers.size());
-    for (uint32_t i = 0; i < framebuffers.size(); i++)
-    {
-        this->_frameBuffers[i] = &framebuffers[i];
-    }
+    this->_uploadService = uploadService;
+    this->_renderPass = renderPass;
+    this->_bufferCount = bufferCount;
 
     this->_shaderStages = shaderstages;
 
     this->_frameBufferWidth = framebufferwidth;
     this->_frameBufferHeight = framebufferheight;
 
-    _cmdBuffers.resize(framebuffers.size());
     prepareResources();
-    prepareRenderPass();
-    preparePipeline();
+    preparePipeline(pipelineCache);
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////
@@ -56,15 +48,18 @@ TextOverlay:: ~TextOverlay()
     vkDestroyImage(_vulkanDevice->logicalDevice, _image, nullptr);
     vkDestroyImageView(_vulkanDevice->logicalDevice, _view, nullptr);
     vkDestroyBuffer(_vulkanDevice->logicalDevice, _buffer, nullptr);
-    vkFreeMemory(_vulkanDevice->logicalDevice, _memory, nullptr);
-    vkFreeMemory(_vulkanDevice->logicalDevice, _imageMemory, nullptr);
+    vkUnmapMemory(_vulkanDevice->logicalDevice, _memory);
+    vks::memory::freeMemory(_vulkanDevice->logicalDevice, _memory);
+    vks::memory::freeMemory(_vulkanDevice->logicalDevice, _imageMemory);
+    vkDestroyBuffer(_vulkanDevice->logicalDevice, _indexBuffer, nullptr);
+    vks::memory::freeMemory(_vulkanDevice->logicalDevice, _indexMemory);
+    vkDestroyBuffer(_vulkanDevice->logicalDevice, _indirectBuffer, nullptr);
+    vkUnmapMemory(_vulkanDevice->logicalDevice, _indirectMemory);
+    vks::memory::freeMemory(_vulkanDevice->logicalDevice, _indirectMemory);
     vkDestroyDescriptorSetLayout(_vulkanDevice->logicalDevice, _descriptorSetLayout, nullptr);
     vkDestroyDescriptorPool(_vulkanDevice->logicalDevice, _descriptorPool, nullptr);
     vkDestroyPipelineLayout(_vulkanDevice->logicalDevice, _pipelineLayout, nullptr);
-    vkDestroyPipelineCache(_vulkanDevice->logicalDevice, _pipelineCache, nullptr);
     vkDestroyPipeline(_vulkanDevice->logicalDevice, _pipeline, nullptr);
-    vkDestroyRenderPass(_vulkanDevice->logicalDevice, _renderPass, nullptr);
-    vkDestroyCommandPool(_vulkanDevice->logicalDevice, _commandPool, nullptr);
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////
@@ -73,7 +68,8 @@ TextOverlay:: ~TextOverlay()
 //   prepareResources
 //
 //   Prepare all vulkan resources required to render the font
-//   The text overlay uses separate resources for descriptors (pool, sets, layouts), pipelines and command buffers
+//   The text overlay uses separate resources for descriptors (pool, sets, layouts) and pipelines,
+//   its draw is recorded into the application's command buffers
 //
 
 void TextOverlay::prepareResources()
@@ -82,42 +78,41 @@ void TextOverlay::prepareResources()
     const uint32_t fontHeight = STB_FONT_consolas_24_latin1_BITMAP_WIDTH;
 
     static unsigned char font24pixels[fontWidth][fontHeight];
-    stb_font_consolas_24_latin1(_stbFontData, font24pixels, fontHeight);
-
-    // Command buffer
-
-    // Pool
-    VkCommandPoolCreateInfo cmdPoolInfo = {};
-
-    cmdPoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-    cmdPoolInfo.queueFamilyIndex = _vulkanDevice->queueFamilyIndices.graphics;
-    cmdPoolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
-    VK_CHECK_RESULT(vkCreateCommandPool(_vulkanDevice->logicalDevice, &cmdPoolInfo, nullptr, &_commandPool));
-
-    VkCommandBufferAllocateInfo cmdBufAllocateInfo =
-        vks::initializers::commandBufferAllocateInfo(
-            _commandPool,
-            VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-            (uint32_t)_cmdBuffers.size());
+    _layout.prepareFont(&font24pixels[0][0]);
 
-    VK_CHECK_RESULT(vkAllocateCommandBuffers(_vulkanDevice->logicalDevice, &cmdBufAllocateInfo, _cmdBuffers.data()));
+    prepareSlices();
 
-    // Vertex buffer
-    VkDeviceSize bufferSize = TEXTOVERLAY_MAX_CHAR_COUNT * sizeof(glm::vec4);
+    // Index buffer, quad i uses vertices 4i .. 4i + 3 in the order addText writes them
+    std::vector<uint16_t> indices(TEXTOVERLAY_MAX_CHAR_COUNT / 4 * 6);
+    for (uint32_t i = 0; i < TEXTOVERLAY_MAX_CHAR_COUNT / 4; i++)
+    {
+        uint16_t v = uint16_t(i * 4);
+        indices[i * 6 + 0] = v;
+        indices[i * 6 + 1] = v + 1;
+        indices[i * 6 + 2] = v + 2;
+        indices[i * 6 + 3] = v + 2;
+        indices[i * 6 + 4] = v + 1;
+        indices[i * 6 + 5] = v + 3;
+    }
 
-    VkBufferCreateInfo bufferInfo = vks::initializers::bufferCreateInfo(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, bufferSize);
-    VK_CHECK_RESULT(vkCreateBuffer(_vulkanDevice->logicalDevice, &bufferInfo, nullptr, &_buffer));
+    VK_CHECK_RESULT(_vulkanDevice->createBuffer(
+        VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        indices.size() * sizeof(uint16_t),
+        &_indexBuffer,
+        &_indexMemory));
+
+    _uploadService->uploadBuffer(
+        _indexBuffer,
+        0,
+        indices.data(),
+        indices.size() * sizeof(uint16_t),
+        VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+        VK_ACCESS_INDEX_READ_BIT);
 
     VkMemoryRequirements memReqs;
     VkMemoryAllocateInfo allocInfo = vks::initializers::memoryAllocateInfo();
 
-    vkGetBufferMemoryRequirements(_vulkanDevice->logicalDevice, _buffer, &memReqs);
-    allocInfo.allocationSize = memReqs.size;
-    allocInfo.memoryTypeIndex = _vulkanDevice->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-
-    VK_CHECK_RESULT(vkAllocateMemory(_vulkanDevice->logicalDevice, &allocInfo, nullptr, &_memory));
-    VK_CHECK_RESULT(vkBindBufferMemory(_vulkanDevice->logicalDevice, _buffer, _memory, 0));
-
     // Font texture
     VkImageCreateInfo imageInfo = vks::initializers::imageCreateInfo();
     imageInfo.imageType = VK_IMAGE_TYPE_2D;
@@ -139,109 +134,20 @@ void TextOverlay::prepareResources()
     allocInfo.allocationSize = memReqs.size;
     allocInfo.memoryTypeIndex = _vulkanDevice->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
-    VK_CHECK_RESULT(vkAllocateMemory(_vulkanDevice->logicalDevice, &allocInfo, nullptr, &_imageMemory));
+    VK_CHECK_RESULT(vks::memory::allocateMemory(_vulkanDevice->logicalDevice, &allocInfo, &_imageMemory));
     VK_CHECK_RESULT(vkBindImageMemory(_vulkanDevice->logicalDevice, _image, _imageMemory, 0));
 
-    // Staging
-
-    struct {
-        VkDeviceMemory memory;
-        VkBuffer buffer;
-    } stagingBuffer;
-
-    VkBufferCreateInfo bufferCreateInfo = vks::initializers::bufferCreateInfo();
-    bufferCreateInfo.size = allocInfo.allocationSize;
-    bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-    bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-
-    VK_CHECK_RESULT(vkCreateBuffer(_vulkanDevice->logicalDevice, &bufferCreateInfo, nullptr, &stagingBuffer.buffer));
-
-    // Get memory requirements for the staging buffer (alignment, memory type bits)
-    vkGetBufferMemoryRequirements(_vulkanDevice->logicalDevice, stagingBuffer.buffer, &memReqs);
-
-    allocInfo.allocationSize = memReqs.size;
-    // Get memory type index for a host visible buffer
-    allocInfo.memoryTypeIndex = _vulkanDevice->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-
-    VK_CHECK_RESULT(vkAllocateMemory(_vulkanDevice->logicalDevice, &allocInfo, nullptr, &stagingBuffer.memory));
-    VK_CHECK_RESULT(vkBindBufferMemory(_vulkanDevice->logicalDevice, stagingBuffer.buffer, stagingBuffer.memory, 0));
-
-    uint8_t* data;
-
-    VK_CHECK_RESULT(vkMapMemory(_vulkanDevice->logicalDevice, stagingBuffer.memory, 0, allocInfo.allocationSize, 0, (void**)&data));
-    // Size of the font texture is WIDTH * HEIGHT * 1 byte (only one channel)
-    memcpy(data, &font24pixels[0][0], fontWidth * fontHeight);
-    vkUnmapMemory(_vulkanDevice->logicalDevice, stagingBuffer.memory);
-
-    // Copy to image
-
-    VkCommandBuffer copyCmd;
-    cmdBufAllocateInfo.commandBufferCount = 1;
-    VK_CHECK_RESULT(vkAllocateCommandBuffers(_vulkanDevice->logicalDevice, &cmdBufAllocateInfo, &copyCmd));
-
-    VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
-    VK_CHECK_RESULT(vkBeginCommandBuffer(copyCmd, &cmdBufInfo));
+    // Copy to image, submitted with the other startup uploads
 
-    // Prepare for transfer
-    vks::tools::setImageLayout(
-        copyCmd,
+    _uploadService->uploadImage(
         _image,
-        VK_IMAGE_ASPECT_COLOR_BIT,
-        VK_IMAGE_LAYOUT_UNDEFINED,
-        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-
-    VkBufferImageCopy bufferCopyRegion = {};
-    bufferCopyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    bufferCopyRegion.imageSubresource.mipLevel = 0;
-    bufferCopyRegion.imageSubresource.layerCount = 1;
-    bufferCopyRegion.imageExtent.width = fontWidth;
-    bufferCopyRegion.imageExtent.height = fontHeight;
-    bufferCopyRegion.imageExtent.depth = 1;
-
-    vkCmdCopyBufferToImage(
-        copyCmd,
-        stagingBuffer.buffer,
-        _image,
-        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-        1,
-        &bufferCopyRegion
-    );
-
-    // Prepare for shader read
-    vks::tools::setImageLayout(
-        copyCmd,
-        _image,
-        VK_IMAGE_ASPECT_COLOR_BIT,
-        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-
-    VK_CHECK_RESULT(vkEndCommandBuffer(copyCmd));
-
-    VkSubmitInfo submitInfo = vks::initializers::submitInfo();
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &copyCmd;
-
-
-    // Create fence to ensure that the command buffer has finished executing
-    VkFenceCreateInfo fenceCreateInfo = {};
-    fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-    fenceCreateInfo.flags = 0;
-
-    VkFence fence;
-    
-    VK_CHECK_RESULT(vkCreateFence(_vulkanDevice->logicalDevice, &fenceCreateInfo, nullptr, &fence));
-
-    VK_CHECK_RESULT(vkQueueSubmit(_queue, 1, &submitInfo, fence));
-
-    // Wait for the fence to signal that command buffer has finished executing
-    VK_CHECK_RESULT(vkWaitForFences(_vulkanDevice->logicalDevice, 1, &fence, VK_TRUE, DEFAULT_FENCE_TIMEOUT));
-
-    vkDestroyFence(_vulkanDevice->logicalDevice, fence, nullptr);
-
-
-    vkFreeCommandBuffers(_vulkanDevice->logicalDevice, _commandPool, 1, &copyCmd);
-    vkFreeMemory(_vulkanDevice->logicalDevice, stagingBuffer.memory, nullptr);
-    vkDestroyBuffer(_vulkanDevice->logicalDevice, stagingBuffer.buffer, nullptr);
+        fontWidth,
+        fontHeight,
+        &font24pixels[0][0],
+        fontWidth * fontHeight,
+        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+        VK_ACCESS_SHADER_READ_BIT);
 
     VkImageViewCreateInfo imageViewInfo = vks::initializers::imageViewCreateInfo();
     imageViewInfo.image = _image;
@@ -314,14 +220,82 @@ void TextOverlay::prepareResources()
     std::array<VkWriteDescriptorSet, 1> writeDescriptorSets;
     writeDescriptorSets[0] = vks::initializers::writeDescriptorSet(_descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, &texDescriptor);
     vkUpdateDescriptorSets(_vulkanDevice->logicalDevice, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, NULL);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+//
+//   prepareSlices
+//
+//   The vertex slices and indirect commands, one of each per framebuffer
+//
+
+void TextOverlay::prepareSlices()
+{
+    // Vertex buffer, one slice per framebuffer so a frame in flight never sees the next update
+    VkDeviceSize bufferSize = TEXTOVERLAY_MAX_CHAR_COUNT * sizeof(glm::vec4) * _bufferCount;
+
+    VkBufferCreateInfo bufferInfo = vks::initializers::bufferCreateInfo(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, bufferSize);
+    VK_CHECK_RESULT(vkCreateBuffer(_vulkanDevice->logicalDevice, &bufferInfo, nullptr, &_buffer));
+
+    VkMemoryRequirements memReqs;
+    VkMemoryAllocateInfo allocInfo = vks::initializers::memoryAllocateInfo();
+
+    vkGetBufferMemoryRequirements(_vulkanDevice->logicalDevice, _buffer, &memReqs);
+    allocInfo.allocationSize = memReqs.size;
+    allocInfo.memoryTypeIndex = _vulkanDevice->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+    VK_CHECK_RESULT(vks::memory::allocateMemory(_vulkanDevice->logicalDevice, &allocInfo, &_memory));
+    VK_CHECK_RESULT(vkBindBufferMemory(_vulkanDevice->logicalDevice, _buffer, _memory, 0));
+
+    // Host coherent, stays mapped for the lifetime of the overlay
+    VK_CHECK_RESULT(vkMapMemory(_vulkanDevice->logicalDevice, _memory, 0, VK_WHOLE_SIZE, 0, (void**)&_mappedBase));
+
+    // Indirect commands, host coherent and mapped like the vertex buffer
+    VK_CHECK_RESULT(_vulkanDevice->createBuffer(
+        VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        _bufferCount * sizeof(VkDrawIndexedIndirectCommand),
+        &_indirectBuffer,
+        &_indirectMemory));
+
+    VK_CHECK_RESULT(vkMapMemory(_vulkanDevice->logicalDevice, _indirectMemory, 0, VK_WHOLE_SIZE, 0, (void**)&_indirect));
 
-    // Pipeline cache
-    VkPipelineCacheCreateInfo pipelineCacheCreateInfo = {};
-    pipelineCacheCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
-    VK_CHECK_RESULT(vkCreatePipelineCache(_vulkanDevice->logicalDevice, &pipelineCacheCreateInfo, nullptr, &_pipelineCache));
+    for (uint32_t i = 0; i < _bufferCount; i++)
+    {
+        _indirect[i].indexCount = 0;
+        _indirect[i].instanceCount = 1;
+        _indirect[i].firstIndex = 0;
+        _indirect[i].vertexOffset = 0;
+        _indirect[i].firstInstance = 0;
+    }
 }
 
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+//
+//   resize
+//
+//   A recreated swap chain can have a different image count. The slices start out empty, the
+//   caller rebuilds the text of every framebuffer before drawing it
+//
 
+void TextOverlay::resize(uint32_t bufferCount)
+{
+    vkDestroyBuffer(_vulkanDevice->logicalDevice, _buffer, nullptr);
+    vkUnmapMemory(_vulkanDevice->logicalDevice, _memory);
+    vks::memory::freeMemory(_vulkanDevice->logicalDevice, _memory);
+    vkDestroyBuffer(_vulkanDevice->logicalDevice, _indirectBuffer, nullptr);
+    vkUnmapMemory(_vulkanDevice->logicalDevice, _indirectMemory);
+    vks::memory::freeMemory(_vulkanDevice->logicalDevice, _indirectMemory);
+
+    _bufferCount = bufferCount;
+    _current = 0;
+
+    prepareSlices();
+}
 
 ///////////////////////////////////////////////////////////////////////////////////////////////
 //
@@ -329,9 +303,9 @@ void TextOverlay::prepareResources()
 //   preparePipeline
 //
 
-// Prepare a separate pipeline for the font rendering decoupled from the main application
+// Prepare the font pipeline for subpass 0 of the application's render pass
 void
-TextOverlay::preparePipeline()
+TextOverlay::preparePipeline(VkPipelineCache pipelineCache)
 {
     // Enable blending, using alpha from red channel of the font texture (see text.frag)
     VkPipelineColorBlendAttachmentState blendAttachmentState{};
@@ -344,10 +318,11 @@ TextOverlay::preparePipeline()
     blendAttachmentState.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
     blendAttachmentState.alphaBlendOp = VK_BLEND_OP_ADD;
 
-    VkPipelineInputAssemblyStateCreateInfo inputAssemblyState = vks::initializers::pipelineInputAssemblyStateCreateInfo(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP, 0, VK_FALSE);
+    VkPipelineInputAssemblyStateCreateInfo inputAssemblyState = vks::initializers::pipelineInputAssemblyStateCreateInfo(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, 0, VK_FALSE);
     VkPipelineRasterizationStateCreateInfo rasterizationState = vks::initializers::pipelineRasterizationStateCreateInfo(VK_POLYGON_MODE_FILL, VK_CULL_MODE_BACK_BIT, VK_FRONT_FACE_CLOCKWISE, 0);
     VkPipelineColorBlendStateCreateInfo colorBlendState = vks::initializers::pipelineColorBlendStateCreateInfo(1, &blendAttachmentState);
-    VkPipelineDepthStencilStateCreateInfo depthStencilState = vks::initializers::pipelineDepthStencilStateCreateInfo(VK_TRUE, VK_TRUE, VK_COMPARE_OP_LESS_OR_EQUAL);
+    // The scene's depth is still bound, text is drawn on top of it
+    VkPipelineDepthStencilStateCreateInfo depthStencilState = vks::initializers::pipelineDepthStencilStateCreateInfo(VK_FALSE, VK_FALSE, VK_COMPARE_OP_LESS_OR_EQUAL);
     VkPipelineViewportStateCreateInfo viewportState = vks::initializers::pipelineViewportStateCreateInfo(1, 1, 0);
     VkPipelineMultisampleStateCreateInfo multisampleState = vks::initializers::pipelineMultisampleStateCreateInfo(VK_SAMPLE_COUNT_1_BIT, 0);
     std::vector<VkDynamicState> dynamicStateEnables = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
@@ -380,95 +355,7 @@ TextOverlay::preparePipeline()
     pipelineCreateInfo.stageCount = static_cast<uint32_t>(_shaderStages.size());
     pipelineCreateInfo.pStages = _shaderStages.data();
 
-    VK_CHECK_RESULT(vkCreateGraphicsPipelines(_vulkanDevice->logicalDevice, _pipelineCache, 1, &pipelineCreateInfo, nullptr, &_pipeline));
-}
-
-
-///////////////////////////////////////////////////////////////////////////////////////////////
-//
-//
-//   prepareRenderPass
-//
-
-// Prepare a separate render pass for rendering the text as an overlay
-void
-TextOverlay::prepareRenderPass()
-{
-    VkAttachmentDescription attachments[2] = {};
-
-    // Color attachment
-    attachments[0].format = _colorFormat;
-    attachments[0].samples = VK_SAMPLE_COUNT_1_BIT;
-    // Don't clear the framebuffer (like the renderpass from the example does)
-    attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
-    attachments[0].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-    attachments[0].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-    attachments[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    attachments[0].initialLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-    attachments[0].finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-
-    // Depth attachment
-    attachments[1].format = _depthFormat;
-    attachments[1].samples = VK_SAMPLE_COUNT_1_BIT;
-    attachments[1].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    attachments[1].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-    attachments[1].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-    attachments[1].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    attachments[1].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    attachments[1].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-
-    VkAttachmentReference colorReference = {};
-    colorReference.attachment = 0;
-    colorReference.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-
-    VkAttachmentReference depthReference = {};
-    depthReference.attachment = 1;
-    depthReference.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-
-    // Use subpass dependencies for image layout transitions
-    VkSubpassDependency subpassDependencies[2] = {};
-
-    // Transition from final to initial (VK_SUBPASS_EXTERNAL refers to all commmands executed outside of the actual renderpass)
-    subpassDependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
-    subpassDependencies[0].dstSubpass = 0;
-    subpassDependencies[0].srcStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-    subpassDependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    subpassDependencies[0].srcAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-    subpassDependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-    subpassDependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
-
-    // Transition from initial to final
-    subpassDependencies[1].srcSubpass = 0;
-    subpassDependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
-    subpassDependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    subpassDependencies[1].dstStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-    subpassDependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-    subpassDependencies[1].dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-    subpassDependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
-
-    VkSubpassDescription subpassDescription = {};
-    subpassDescription.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-    subpassDescription.flags = 0;
-    subpassDescription.inputAttachmentCount = 0;
-    subpassDescription.pInputAttachments = NULL;
-    subpassDescription.colorAttachmentCount = 1;
-    subpassDescription.pColorAttachments = &colorReference;
-    subpassDescription.pResolveAttachments = NULL;
-    subpassDescription.pDepthStencilAttachment = &depthReference;
-    subpassDescription.preserveAttachmentCount = 0;
-    subpassDescription.pPreserveAttachments = NULL;
-
-    VkRenderPassCreateInfo renderPassInfo = {};
-    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-    renderPassInfo.pNext = NULL;
-    renderPassInfo.attachmentCount = 2;
-    renderPassInfo.pAttachments = attachments;
-    renderPassInfo.subpassCount = 1;
-    renderPassInfo.pSubpasses = &subpassDescription;
-    renderPassInfo.dependencyCount = 2;
-    renderPassInfo.pDependencies = subpassDependencies;
-
-    VK_CHECK_RESULT(vkCreateRenderPass(_vulkanDevice->logicalDevice, &renderPassInfo, nullptr, &_renderPass));
+    VK_CHECK_RESULT(vkCreateGraphicsPipelines(_vulkanDevice->logicalDevice, pipelineCache, 1, &pipelineCreateInfo, nullptr, &_pipeline));
 }
 
 
@@ -481,71 +368,15 @@ TextOverlay::prepareRenderPass()
 // Add text to the current buffer
     // todo : drop shadow? color attribute?
 void
-TextOverlay::addText(std::string text, float x, float y, TextAlign align)
+TextOverlay::addText(const char* text, float x, float y, TextAlign align)
 {
-    const uint32_t firstChar = STB_FONT_consolas_24_latin1_FIRST_CHAR;
-
     assert(_mapped != nullptr);
 
-    const float charW = 1.5f / *_frameBufferWidth;
-    const float charH = 1.5f / *_frameBufferHeight;
-
-    float fbW = (float)*_frameBufferWidth;
-    float fbH = (float)*_frameBufferHeight;
-    x = (x / fbW * 2.0f) - 1.0f;
-    y = (y / fbH * 2.0f) - 1.0f;
-
-    // Calculate text width
-    float textWidth = 0;
-    for (auto letter : text)
-    {
-        stb_fontchar* charData = &_stbFontData[(uint32_t)letter - firstChar];
-        textWidth += charData->advance * charW;
-    }
-
-    switch (align)
-    {
-    case alignRight:
-        x -= textWidth;
-        break;
-    case alignCenter:
-        x -= textWidth / 2.0f;
-        break;
-    }
+    // The slice holds TEXTOVERLAY_MAX_CHAR_COUNT vertices
+    uint32_t n = _layout.layout(text, x, y, align, *_frameBufferWidth, *_frameBufferHeight, &_mapped->x, TEXTOVERLAY_MAX_CHAR_COUNT / 4 - _numLetters);
 
-    // Generate a uv mapped quad per char in the new text
-    for (auto letter : text)
-    {
-        stb_fontchar* charData = &_stbFontData[(uint32_t)letter - firstChar];
-
-        _mapped->x = (x + (float)charData->x0 * charW);
-        _mapped->y = (y + (float)charData->y0 * charH);
-        _mapped->z = charData->s0;
-        _mapped->w = charData->t0;
-        _mapped++;
-
-        _mapped->x = (x + (float)charData->x1 * charW);
-        _mapped->y = (y + (float)charData->y0 * charH);
-        _mapped->z = charData->s1;
-        _mapped->w = charData->t0;
-        _mapped++;
-
-        _mapped->x = (x + (float)charData->x0 * charW);
-        _mapped->y = (y + (float)charData->y1 * charH);
-        _mapped->z = charData->s0;
-        _mapped->w = charData->t1;
-        _mapped++;
-
-        _mapped->x = (x + (float)charData->x1 * charW);
-        _mapped->y = (y + (float)charData->y1 * charH);
-        _mapped->z = charData->s1;
-        _mapped->w = charData->t1;
-        _mapped++;
-
-        x += charData->advance * charW;
-
-        _numLetters++;
-    }
+    _mapped += n * 4;
+    _numLetters += n;
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////
@@ -553,12 +384,15 @@ TextOverlay::addText(std::string text, float x, float y, TextAlign align)
 //
 //   beginTextUpdate
 //
-//   Map buffer 
+//   Point the writer at the slice of framebuffer iBuffer
 
 void
-TextOverlay::beginTextUpdate()
+TextOverlay::beginTextUpdate(uint32_t iBuffer)
 {
-    VK_CHECK_RESULT(vkMapMemory(_vulkanDevice->logicalDevice, _memory, 0, VK_WHOLE_SIZE, 0, (void**)&_mapped));
+    assert(iBuffer < _bufferCount);
+
+    _current = iBuffer;
+    _mapped = _mappedBase + iBuffer * TEXTOVERLAY_MAX_CHAR_COUNT;
     _numLetters = 0;
 }
 
@@ -566,71 +400,34 @@ TextOverlay::beginTextUpdate()
 //
 //
 //   endTextUpdate
-//  // Unmap buffer and update command buffers
+//
+//   The memory is host coherent, the next submit of the framebuffer sees the new count
 
 void
 TextOverlay::endTextUpdate()
 {
-    vkUnmapMemory(_vulkanDevice->logicalDevice, _memory);
     _mapped = nullptr;
-    updateCommandBuffers();
+    _indirect[_current].indexCount = _visible ? _numLetters * 6 : 0;
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////
 //
 //
-//   updateCommandBuffers
-
-// Needs to be called by the application
+//   recordDraw
+//
+//   Draws from the framebuffer's slice with the letter count in its indirect command, so text
+//   updates never invalidate the command buffer. Viewport and scissor are left to the caller
 
 void
-TextOverlay::updateCommandBuffers()
+TextOverlay::recordDraw(VkCommandBuffer cmdBuffer, uint32_t iBuffer)
 {
-    const VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
+    vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _pipeline);
+    vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _pipelineLayout, 0, 1, &_descriptorSet, 0, NULL);
 
-    VkClearValue clearValues[2];
-    clearValues[1].color = { { 0.0f, 0.0f, 0.0f, 0.0f } };
+    VkDeviceSize offsets = iBuffer * TEXTOVERLAY_MAX_CHAR_COUNT * sizeof(glm::vec4);
+    vkCmdBindVertexBuffers(cmdBuffer, 0, 1, &_buffer, &offsets);
+    vkCmdBindVertexBuffers(cmdBuffer, 1, 1, &_buffer, &offsets);
+    vkCmdBindIndexBuffer(cmdBuffer, _indexBuffer, 0, VK_INDEX_TYPE_UINT16);
 
-    VkRenderPassBeginInfo renderPassBeginInfo = vks::initializers::renderPassBeginInfo();
-    renderPassBeginInfo.renderPass = _renderPass;
-    renderPassBeginInfo.renderArea.extent.width = *_frameBufferWidth;
-    renderPassBeginInfo.renderArea.extent.height = *_frameBufferHeight;
-    renderPassBeginInfo.clearValueCount = 2;
-    renderPassBeginInfo.pClearValues = clearValues;
-
-    for (int32_t i = 0; i < _cmdBuffers.size(); ++i)
-    {
-
-        VkCommandBuffer& cmdBuffer = _cmdBuffers[i];
-    
-        renderPassBeginInfo.framebuffer = *_frameBuffers[i];
-
-        VK_CHECK_RESULT(vkBeginCommandBuffer(cmdBuffer, &cmdBufInfo));
-
-        vkCmdBeginRenderPass(cmdBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-
-        VkViewport viewport = vks::initializers::viewport((float)*_frameBufferWidth, (float)*_frameBufferHeight, 0.0f, 1.0f);
-        vkCmdSetViewport(cmdBuffer, 0, 1, &viewport);
-
-        VkRect2D scissor = vks::initializers::rect2D(*_frameBufferWidth, *_frameBufferHeight, 0, 0);
-        vkCmdSetScissor(cmdBuffer, 0, 1, &scissor);
-
-        vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _pipeline);
-        vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _pipelineLayout, 0, 1, &_descriptorSet, 0, NULL);
-
-        VkDeviceSize offsets = 0;
-        vkCmdBindVertexBuffers(cmdBuffer, 0, 1, &_buffer, &offsets);
-        vkCmdBindVertexBuffers(cmdBuffer, 1, 1, &_buffer, &offsets);
-        for (uint32_t j = 0; j < _numLetters; j++)
-        {
-            vkCmdDraw(_cmdBuffers[i], 4, 1, j * 4, 0);
-        }
-
-
-        vkCmdEndRenderPass(_cmdBuffers[i]);
-
-        VK_CHECK_RESULT(vkEndCommandBuffer(_cmdBuffers[i]));
-    }
+    vkCmdDrawIndexedIndirect(cmdBuffer, _indirectBuffer, iBuffer * sizeof(VkDrawIndexedIndirectCommand), 1, sizeof(VkDrawIndexedIndirectCommand));
 }
-
-
@@ -5,7 +5,9 @@
 #include "VulkanDevice.hpp"
 #include <glm/glm.hpp>
 
-#include "stb_font_consolas_24_latin1.inl"
+#include "UploadService.h"
+
+#include "TextLayout.h"
 
 
 #include <array>
@@ -26,9 +28,13 @@ class TextOverlay
 private:
     vks::VulkanDevice* _vulkanDevice;
 
-    VkQueue _queue;
-    VkFormat _colorFormat;
-    VkFormat _depthFormat;
+    UploadService* _uploadService;
+
+    // Main render pass the text is drawn in, owned by the application
+    VkRenderPass _renderPass;
+
+    // Number of framebuffers, each has its own vertex slice and indirect command
+    uint32_t _bufferCount;
 
     uint32_t* _frameBufferWidth;
     uint32_t* _frameBufferHeight;
@@ -39,36 +45,52 @@ private:
     VkBuffer _buffer;
     VkDeviceMemory _memory;
     VkDeviceMemory _imageMemory;
+
+    // Two triangles per letter quad, shared by all slices
+    VkBuffer _indexBuffer;
+    VkDeviceMemory _indexMemory;
+
+    // One VkDrawIndexedIndirectCommand per framebuffer, indexCount is written by endTextUpdate
+    VkBuffer _indirectBuffer;
+    VkDeviceMemory _indirectMemory;
+    VkDrawIndexedIndirectCommand* _indirect = nullptr;
+
     VkDescriptorPool _descriptorPool;
     VkDescriptorSetLayout _descriptorSetLayout;
     VkDescriptorSet _descriptorSet;
     VkPipelineLayout _pipelineLayout;
-    VkPipelineCache _pipelineCache;
     VkPipeline _pipeline;
-    VkRenderPass _renderPass;
-    VkCommandPool _commandPool;
 
-    std::vector<VkFramebuffer*> _frameBuffers;
     std::vector<VkPipelineShaderStageCreateInfo> _shaderStages;
 
-    // Pointer to mapped vertex buffer
+    // Vertex buffer, persistently mapped. Every framebuffer owns a slice of TEXTOVERLAY_MAX_CHAR_COUNT vertices
+    glm::vec4* _mappedBase = nullptr;
+
+    // Write position inside the slice being updated
     glm::vec4* _mapped = nullptr;
 
-    stb_fontchar _stbFontData[STB_FONT_consolas_24_latin1_NUM_CHARS];
+    TextLayout _layout;
     uint32_t _numLetters;
+
+    // Framebuffer whose slice and indirect command the current update writes
+    uint32_t _current = 0;
+
+    void prepareSlices();
 public:
 
-    enum TextAlign { alignLeft, alignCenter, alignRight };
+    typedef TextLayout::TextAlign TextAlign;
+    static const TextAlign alignLeft = TextLayout::alignLeft;
+    static const TextAlign alignCenter = TextLayout::alignCenter;
+    static const TextAlign alignRight = TextLayout::alignRight;
 
     bool _visible = true;
-    std::vector<VkCommandBuffer> _cmdBuffers;
 
     TextOverlay(
         vks::VulkanDevice* vulkanDevice,
-        VkQueue queue,
-        std::vector<VkFramebuffer>& framebuffers,
-        VkFormat colorformat,
-        VkFormat depthformat,
+        UploadService* uploadService,
+        VkPipelineCache pipelineCache,
+        VkRenderPass renderPass,
+        uint32_t bufferCount,
         uint32_t* framebufferwidth,
         uint32_t* framebufferheight,
         std::vector<VkPipelineShaderStageCreateInfo> shaderstages);
@@ -77,25 +99,25 @@ public:
     
     void prepareResources();
 
-    // Prepare a separate pipeline for the font rendering decoupled from the main application
-    void preparePipeline();
+    // Frees the slices and creates bufferCount new ones, the device must be idle
+    void resize(uint32_t bufferCount);
 
-    // Prepare a separate render pass for rendering the text as an overlay
-    void prepareRenderPass();
+    // Prepare the font pipeline for subpass 0 of the application's render pass
+    void preparePipeline(VkPipelineCache pipelineCache);
 
-    // Map buffer 
-    void beginTextUpdate();
+    // Start writing the slice of framebuffer iBuffer. Its previous submission must have completed
+    void beginTextUpdate(uint32_t iBuffer);
 
     // Add text to the current buffer
     // todo : drop shadow? color attribute?
-    void addText(std::string text, float x, float y, TextAlign align);
+    void addText(const char* text, float x, float y, TextAlign align);
 
-    
+    // Publishes the letter count of the framebuffer being updated, hidden text draws nothing
     void endTextUpdate();
-    
 
-    // Needs to be called by the application
-    void updateCommandBuffers();
+    // Records the text draw for framebuffer iBuffer inside the application's render pass.
+    // The command buffer stays valid across text updates
+    void recordDraw(VkCommandBuffer cmdBuffer, uint32_t iBuffer);
 
 };
 
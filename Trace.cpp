@@ -0,0 +1,224 @@
+
+#include "stdafx.h"
+#include "Trace.h"
+#include "benchmarkstats.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+
+bool Trace::s_enabled = false;
+std::chrono::steady_clock::time_point Trace::s_origin = std::chrono::steady_clock::now();
+
+// Buffers outlive their threads
+static std::mutex s_mutex;
+static std::vector<std::unique_ptr<trace_buffer>> s_lcBuffer;
+static thread_local trace_buffer* t_buffer = nullptr;
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+//
+//   buffer
+//
+
+trace_buffer* Trace::buffer()
+{
+    if (t_buffer == nullptr) {
+        std::unique_ptr<trace_buffer> b(new trace_buffer());
+        b->lcEvent.resize(TRACE_BUFFER_EVENTS);
+        b->count.store(0, std::memory_order_relaxed);
+
+        std::lock_guard<std::mutex> lock(s_mutex);
+        b->thread = uint32_t(s_lcBuffer.size());
+        b->name = "thread " + std::to_string(b->thread);
+        t_buffer = b.get();
+        s_lcBuffer.push_back(std::move(b));
+    }
+    return t_buffer;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+//
+//   enable
+//
+//   The enabling thread is named main
+//
+
+void Trace::enable()
+{
+    s_origin = std::chrono::steady_clock::now();
+    setThreadName("main");
+    s_enabled = true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+//
+//   record
+//
+
+void Trace::record(const char* name, uint64_t begin, uint64_t end, uint32_t allocations, uint64_t allocatedBytes)
+{
+    trace_buffer* b = buffer();
+
+    uint64_t n = b->count.load(std::memory_order_relaxed);
+
+    trace_event& e = b->lcEvent[n & (TRACE_BUFFER_EVENTS - 1)];
+    e.name = name;
+    e.begin = begin;
+    e.end = end;
+    e.kind = TRACE_KIND_ZONE;
+    e.allocations = allocations;
+    e.allocatedBytes = allocatedBytes;
+
+    b->count.store(n + 1, std::memory_order_release);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+//
+//   recordValue
+//
+
+void Trace::recordValue(trace_kind kind, const char* name, double value)
+{
+    trace_buffer* b = buffer();
+
+    uint64_t n = b->count.load(std::memory_order_relaxed);
+
+    trace_event& e = b->lcEvent[n & (TRACE_BUFFER_EVENTS - 1)];
+    e.name = name;
+    e.begin = now();
+    e.value = value;
+    e.kind = kind;
+    e.allocations = 0;
+    e.allocatedBytes = 0;
+
+    b->count.store(n + 1, std::memory_order_release);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+//
+//   setThreadName
+//
+
+void Trace::setThreadName(const std::string& name)
+{
+    trace_buffer* b = buffer();
+
+    std::lock_guard<std::mutex> lock(s_mutex);
+    b->name = name;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+//
+//   collect
+//
+
+void Trace::collect(std::vector<trace_thread>& lcThread, uint64_t from)
+{
+    std::lock_guard<std::mutex> lock(s_mutex);
+
+    lcThread.clear();
+
+    for (const std::unique_ptr<trace_buffer>& b : s_lcBuffer) {
+        uint64_t count = b->count.load(std::memory_order_acquire);
+        uint64_t first = (count > TRACE_BUFFER_EVENTS) ? count - TRACE_BUFFER_EVENTS : 0;
+
+        std::vector<trace_event> lcEvent;
+        lcEvent.reserve(size_t(count - first));
+
+        for (uint64_t i = first; i < count; ++i) {
+            lcEvent.push_back(b->lcEvent[i & (TRACE_BUFFER_EVENTS - 1)]);
+        }
+
+        // The owner kept recording, the oldest slots copied may have been rewritten meanwhile. Events
+        // before after - TRACE_BUFFER_EVENTS were published over, the one at that index may be in the
+        // middle of being written
+        uint64_t after = b->count.load(std::memory_order_acquire);
+        uint64_t overwritten = (after >= first + TRACE_BUFFER_EVENTS) ? std::min(after - first - TRACE_BUFFER_EVENTS + 1, count - first) : 0;
+
+        lcEvent.erase(lcEvent.begin(), lcEvent.begin() + size_t(overwritten));
+
+        lcEvent.erase(std::remove_if(lcEvent.begin(), lcEvent.end(), [from](const trace_event& e) {
+            return ((e.kind == TRACE_KIND_ZONE) ? e.end : e.begin) < from;
+        }), lcEvent.end());
+
+        lcThread.push_back({ b->thread, b->name, std::move(lcEvent) });
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+//
+//   write
+//
+//   Complete ("X"), counter ("C") and instant ("i") events in microseconds, one thread_name
+//   metadata event per thread. Zones that allocated carry the counts as args
+//
+
+bool Trace::write(const std::string& filename, const std::vector<trace_thread>& lcThread)
+{
+    std::ofstream os(filename, std::ios::out);
+
+    if (!os.is_open()) {
+        return false;
+    }
+
+    os << std::fixed << std::setprecision(3);
+    os << "{ \"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+
+    bool first = true;
+
+    for (const trace_thread& thread : lcThread) {
+        os << (first ? "" : ",") << std::endl;
+        os << "{ \"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << thread.thread
+            << ", \"args\": { \"name\": " << vks::stats::jsonString(thread.name) << " } }";
+        first = false;
+
+        for (const trace_event& e : thread.lcEvent) {
+            os << "," << std::endl;
+            os << "{ \"name\": " << vks::stats::jsonString(e.name) << ", \"pid\": 1, \"tid\": " << thread.thread
+                << ", \"ts\": " << double(e.begin) / 1000.0;
+
+            switch (e.kind) {
+            case TRACE_KIND_COUNTER:
+                os << ", \"ph\": \"C\", \"args\": { \"value\": " << e.value << " } }";
+                break;
+            case TRACE_KIND_INSTANT:
+                os << ", \"ph\": \"i\", \"s\": \"g\", \"args\": { \"value\": " << e.value << " } }";
+                break;
+            default:
+                os << ", \"ph\": \"X\", \"dur\": " << double(e.end - e.begin) / 1000.0;
+                if (e.allocations > 0) {
+                    os << ", \"args\": { \"allocations\": " << e.allocations << ", \"bytes\": " << e.allocatedBytes << " }";
+                }
+                os << " }";
+                break;
+            }
+        }
+    }
+
+    os << std::endl << "] }" << std::endl;
+
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+//
+//   save
+//
+
+bool Trace::save(const std::string& filename, uint64_t from)
+{
+    std::vector<trace_thread> lcThread;
+    collect(lcThread, from);
+
+    return write(filename, lcThread);
+}
@@ -0,0 +1,159 @@
+#pragma once
+
+
+#include "AllocationCounter.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+* Trace:
+*
+* Scoped CPU zones for finding where frame time goes. A TraceZone records its name, begin and end
+* into a buffer owned by the calling thread, so recording takes no lock and threads never share a
+* cache line. Each buffer is a ring of TRACE_BUFFER_EVENTS, a long run keeps the most recent
+* events. save() writes Chrome trace events, which load in chrome://tracing and ui.perfetto.dev.
+*
+* Zones are named with string literals, only the pointer is stored. Tracing is off until enable(),
+* a zone then costs one well predicted branch when it opens and one when it closes.
+*
+* With AllocationCounter enabled a zone also stores the allocations its thread made while it was
+* open, nested zones included.
+*
+* Timestamps are steady_clock ns since enable(). rdtsc would be cheaper to read but needs its
+* frequency measured and is not monotonic across cores on every machine.
+*/
+
+// Events kept per thread, a power of two
+#define TRACE_BUFFER_EVENTS (1 << 16)
+
+enum trace_kind {
+    TRACE_KIND_ZONE,
+    // A value at begin, drawn as a graph
+    TRACE_KIND_COUNTER,
+    // A marker at begin with a value
+    TRACE_KIND_INSTANT
+};
+
+struct trace_event {
+    const char* name;
+    uint64_t begin;
+    // Zones end at end, counters and instants carry a value instead
+    union {
+        uint64_t end;
+        double value;
+    };
+    trace_kind kind;
+    // Zones only, operator new calls and bytes on the zone's thread
+    uint32_t allocations;
+    uint64_t allocatedBytes;
+};
+
+// Written only by its thread. count is published after the event, readers load it first
+struct trace_buffer {
+    uint32_t thread;
+    std::string name;
+    std::vector<trace_event> lcEvent;
+    std::atomic<uint64_t> count;
+};
+
+// Copy of one thread's events, owned by whoever collected it
+struct trace_thread {
+    uint32_t thread;
+    std::string name;
+    std::vector<trace_event> lcEvent;
+};
+
+class Trace
+{
+private:
+    static std::chrono::steady_clock::time_point s_origin;
+
+    // The calling thread's buffer, created on its first event
+    static trace_buffer* buffer();
+
+public:
+
+    // Tested by every zone, set once before the first frame
+    static bool s_enabled;
+
+    static void enable();
+
+    // ns since enable()
+    static uint64_t now()
+    {
+        return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - s_origin).count());
+    }
+
+    static void record(const char* name, uint64_t begin, uint64_t end, uint32_t allocations = 0, uint64_t allocatedBytes = 0);
+
+    // Adds a value to the graph name, a no-op while tracing is off
+    static void counter(const char* name, double value)
+    {
+        if (s_enabled) {
+            recordValue(TRACE_KIND_COUNTER, name, value);
+        }
+    }
+
+    // Marks the current time, a no-op while tracing is off
+    static void instant(const char* name, double value)
+    {
+        if (s_enabled) {
+            recordValue(TRACE_KIND_INSTANT, name, value);
+        }
+    }
+
+    static void recordValue(trace_kind kind, const char* name, double value);
+
+    // Names the calling thread in the exported trace
+    static void setThreadName(const std::string& name);
+
+    // Events of every thread that end at or after from, oldest first per thread. Can run while other
+    // threads record, events they overwrite during the copy are dropped
+    static void collect(std::vector<trace_thread>& lcThread, uint64_t from = 0);
+
+    // Writes collected events as Chrome trace event JSON, returns false if the file cannot be written.
+    // Touches no trace state, so it can run on any thread
+    static bool write(const std::string& filename, const std::vector<trace_thread>& lcThread);
+
+    // collect() and write() on the calling thread
+    static bool save(const std::string& filename, uint64_t from = 0);
+};
+
+class TraceZone
+{
+private:
+    const char* _name;
+    uint64_t _begin;
+    allocation_count _allocations;
+
+public:
+
+    explicit TraceZone(const char* name)
+    {
+        if (Trace::s_enabled) {
+            _name = name;
+            _allocations = AllocationCounter::thread();
+            _begin = Trace::now();
+        }
+        else {
+            _name = nullptr;
+        }
+    }
+
+    ~TraceZone()
+    {
+        if (_name != nullptr) {
+            uint64_t end = Trace::now();
+            allocation_count allocations = AllocationCounter::thread();
+
+            Trace::record(_name, _begin, end, uint32_t(allocations.allocations - _allocations.allocations), allocations.bytes - _allocations.bytes);
+        }
+    }
+
+    TraceZone(const TraceZone&) = delete;
+    TraceZone& operator=(const TraceZone&) = delete;
+};
@@ -0,0 +1,349 @@
+
+
+#include "stdafx.h"
+#include "UploadService.h"
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+//
+//   UploadService
+//
+//   Constructor
+//
+
+UploadService::UploadService(vks::VulkanDevice* vulkanDevice, VkQueue graphicsQueue, VkQueue transferQueue)
+{
+    this->_vulkanDevice = vulkanDevice;
+    this->_graphicsQueue = graphicsQueue;
+    this->_transferQueue = transferQueue;
+
+    _graphicsFamily = _vulkanDevice->queueFamilyIndices.graphics;
+    _transferFamily = _vulkanDevice->queueFamilyIndices.transfer;
+
+    _transferPool = _vulkanDevice->createCommandPool(_transferFamily, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+
+    if (dedicated()) {
+        _graphicsPool = _vulkanDevice->createCommandPool(_graphicsFamily, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+//
+//   ~UploadService
+//
+
+UploadService::~UploadService()
+{
+    waitIdle();
+
+    VkDevice device = _vulkanDevice->logicalDevice;
+
+    if (_cmdBuffer != VK_NULL_HANDLE) {
+        // Recorded but never submitted
+        vkFreeCommandBuffers(device, _transferPool, 1, &_cmdBuffer);
+
+        for (const staging_buffer& s : _lcStaging) {
+            vkDestroyBuffer(device, s.buffer, nullptr);
+            vks::memory::freeMemory(device, s.memory);
+        }
+    }
+
+    vkDestroyCommandPool(device, _transferPool, nullptr);
+
+    if (_graphicsPool != VK_NULL_HANDLE) {
+        vkDestroyCommandPool(device, _graphicsPool, nullptr);
+    }
+}
+
+bool UploadService::dedicated()
+{
+    return _transferFamily != _graphicsFamily;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+//
+//   begin
+//
+//   Starts a new batch on first use after a submit
+//
+
+void UploadService::begin()
+{
+    if (_cmdBuffer != VK_NULL_HANDLE) {
+        return;
+    }
+
+    VkCommandBufferAllocateInfo cmdBufAllocateInfo = vks::initializers::commandBufferAllocateInfo(_transferPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, 1);
+    VK_CHECK_RESULT(vkAllocateCommandBuffers(_vulkanDevice->logicalDevice, &cmdBufAllocateInfo, &_cmdBuffer));
+
+    VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
+    cmdBufInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    VK_CHECK_RESULT(vkBeginCommandBuffer(_cmdBuffer, &cmdBufInfo));
+}
+
+UploadService::staging_buffer UploadService::createStaging(const void* data, VkDeviceSize size)
+{
+    staging_buffer s;
+
+    // Charged to staging whichever subsystem uploads, they are freed once the upload is done
+    MemoryScope scope(MEMORY_STAGING);
+
+    VK_CHECK_RESULT(_vulkanDevice->createBuffer(
+        VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        size,
+        &s.buffer,
+        &s.memory,
+        const_cast<void*>(data)));
+
+    _lcStaging.push_back(s);
+
+    return s;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+//
+//   uploadBuffer
+//
+
+void UploadService::uploadBuffer(VkBuffer dst, VkDeviceSize dstOffset, const void* data, VkDeviceSize size, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess)
+{
+    begin();
+
+    staging_buffer s = createStaging(data, size);
+
+    VkBufferCopy copyRegion = {};
+    copyRegion.dstOffset = dstOffset;
+    copyRegion.size = size;
+    vkCmdCopyBuffer(_cmdBuffer, s.buffer, dst, 1, &copyRegion);
+
+    VkBufferMemoryBarrier barrier = vks::initializers::bufferMemoryBarrier();
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.buffer = dst;
+    barrier.offset = dstOffset;
+    barrier.size = size;
+
+    if (dedicated()) {
+        // Release on the transfer queue, the matching acquire is recorded for the graphics queue
+        barrier.dstAccessMask = 0;
+        barrier.srcQueueFamilyIndex = _transferFamily;
+        barrier.dstQueueFamilyIndex = _graphicsFamily;
+
+        vkCmdPipelineBarrier(_cmdBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = dstAccess;
+        _lcBufferAcquire.push_back(barrier);
+    }
+    else {
+        barrier.dstAccessMask = dstAccess;
+
+        vkCmdPipelineBarrier(_cmdBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, dstStage, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+//
+//   uploadImage
+//
+
+void UploadService::uploadImage(VkImage image, uint32_t width, uint32_t height, const void* data, VkDeviceSize size, VkImageLayout finalLayout, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess)
+{
+    begin();
+
+    staging_buffer s = createStaging(data, size);
+
+    VkImageMemoryBarrier barrier = vks::initializers::imageMemoryBarrier();
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+
+    // Prepare for transfer
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+
+    vkCmdPipelineBarrier(_cmdBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+    VkBufferImageCopy bufferCopyRegion = {};
+    bufferCopyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    bufferCopyRegion.imageSubresource.mipLevel = 0;
+    bufferCopyRegion.imageSubresource.layerCount = 1;
+    bufferCopyRegion.imageExtent.width = width;
+    bufferCopyRegion.imageExtent.height = height;
+    bufferCopyRegion.imageExtent.depth = 1;
+
+    vkCmdCopyBufferToImage(_cmdBuffer, s.buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &bufferCopyRegion);
+
+    // Transition to the final layout, on a dedicated family as part of the ownership transfer
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = finalLayout;
+
+    if (dedicated()) {
+        barrier.dstAccessMask = 0;
+        barrier.srcQueueFamilyIndex = _transferFamily;
+        barrier.dstQueueFamilyIndex = _graphicsFamily;
+
+        vkCmdPipelineBarrier(_cmdBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = dstAccess;
+        _lcImageAcquire.push_back(barrier);
+    }
+    else {
+        barrier.dstAccessMask = dstAccess;
+
+        vkCmdPipelineBarrier(_cmdBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, dstStage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+//
+//   submit
+//
+//   With a dedicated transfer family the graphics queue gets a small command buffer holding the
+//   acquire barriers. It waits on the batch semaphore, everything submitted to the graphics queue
+//   after it is ordered behind the acquires. The CPU does not wait.
+//
+
+void UploadService::submit()
+{
+    if (_cmdBuffer == VK_NULL_HANDLE) {
+        return;
+    }
+
+    VkDevice device = _vulkanDevice->logicalDevice;
+
+    VK_CHECK_RESULT(vkEndCommandBuffer(_cmdBuffer));
+
+    batch b = {};
+    b.transferCmd = _cmdBuffer;
+    b.graphicsCmd = VK_NULL_HANDLE;
+    b.semaphore = VK_NULL_HANDLE;
+    b.lcStaging.swap(_lcStaging);
+
+    VkFenceCreateInfo fenceInfo = vks::initializers::fenceCreateInfo(VK_FLAGS_NONE);
+    VK_CHECK_RESULT(vkCreateFence(device, &fenceInfo, nullptr, &b.fence));
+
+    VkSubmitInfo submitInfo = vks::initializers::submitInfo();
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &b.transferCmd;
+
+    if (!dedicated()) {
+        VK_CHECK_RESULT(vkQueueSubmit(_transferQueue, 1, &submitInfo, b.fence));
+    }
+    else {
+        VkSemaphoreCreateInfo semaphoreInfo = vks::initializers::semaphoreCreateInfo();
+        VK_CHECK_RESULT(vkCreateSemaphore(device, &semaphoreInfo, nullptr, &b.semaphore));
+
+        submitInfo.signalSemaphoreCount = 1;
+        submitInfo.pSignalSemaphores = &b.semaphore;
+
+        VK_CHECK_RESULT(vkQueueSubmit(_transferQueue, 1, &submitInfo, VK_NULL_HANDLE));
+
+        VkCommandBufferAllocateInfo cmdBufAllocateInfo = vks::initializers::commandBufferAllocateInfo(_graphicsPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, 1);
+        VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &cmdBufAllocateInfo, &b.graphicsCmd));
+
+        VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
+        cmdBufInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        VK_CHECK_RESULT(vkBeginCommandBuffer(b.graphicsCmd, &cmdBufInfo));
+
+        vkCmdPipelineBarrier(
+            b.graphicsCmd,
+            VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+            VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+            0,
+            0, nullptr,
+            uint32_t(_lcBufferAcquire.size()), _lcBufferAcquire.data(),
+            uint32_t(_lcImageAcquire.size()), _lcImageAcquire.data());
+
+        VK_CHECK_RESULT(vkEndCommandBuffer(b.graphicsCmd));
+
+        VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+
+        VkSubmitInfo acquireInfo = vks::initializers::submitInfo();
+        acquireInfo.waitSemaphoreCount = 1;
+        acquireInfo.pWaitSemaphores = &b.semaphore;
+        acquireInfo.pWaitDstStageMask = &waitStage;
+        acquireInfo.commandBufferCount = 1;
+        acquireInfo.pCommandBuffers = &b.graphicsCmd;
+
+        // The fence covers both halves, staging is only read by the transfer half
+        VK_CHECK_RESULT(vkQueueSubmit(_graphicsQueue, 1, &acquireInfo, b.fence));
+
+        _lcBufferAcquire.clear();
+        _lcImageAcquire.clear();
+    }
+
+    _lcInFlight.push_back(std::move(b));
+
+    _cmdBuffer = VK_NULL_HANDLE;
+}
+
+void UploadService::release(batch& b)
+{
+    VkDevice device = _vulkanDevice->logicalDevice;
+
+    for (const staging_buffer& s : b.lcStaging) {
+        vkDestroyBuffer(device, s.buffer, nullptr);
+        vks::memory::freeMemory(device, s.memory);
+    }
+
+    vkFreeCommandBuffers(device, _transferPool, 1, &b.transferCmd);
+
+    if (b.graphicsCmd != VK_NULL_HANDLE) {
+        vkFreeCommandBuffers(device, _graphicsPool, 1, &b.graphicsCmd);
+    }
+
+    if (b.semaphore != VK_NULL_HANDLE) {
+        vkDestroySemaphore(device, b.semaphore, nullptr);
+    }
+
+    vkDestroyFence(device, b.fence, nullptr);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//
+//
+//   collect
+//
+//   Non blocking, called once per frame
+//
+
+void UploadService::collect()
+{
+    size_t nKeep = 0;
+
+    for (size_t i = 0; i < _lcInFlight.size(); i++) {
+        batch& b = _lcInFlight[i];
+
+        if (vkGetFenceStatus(_vulkanDevice->logicalDevice, b.fence) == VK_SUCCESS) {
+            release(b);
+        }
+        else {
+            _lcInFlight[nKeep++] = std::move(b);
+        }
+    }
+
+    _lcInFlight.resize(nKeep);
+}
+
+void UploadService::waitIdle()
+{
+    for (batch& b : _lcInFlight) {
+        VK_CHECK_RESULT(vkWaitForFences(_vulkanDevice->logicalDevice, 1, &b.fence, VK_TRUE, UINT64_MAX));
+        release(b);
+    }
+
+    _lcInFlight.clear();
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+
+#include <vulkan/vulkan.h>
+#include "VulkanDevice.hpp"
+
+#include <vector>
+
+/*
+* UploadService:
+*
+* Batches staging copies into buffers and images and submits them to the transfer queue. When the
+* transfer queue belongs to its own family the uploaded resources are released by the transfer
+* queue and acquired by the graphics queue, which waits on a semaphore instead of the CPU waiting
+* on a fence. On devices without a separate transfer family the copies go to the graphics queue
+* and submission order is enough.
+*
+* Staging memory is freed by collect() once the batch's fence has signaled.
+*/
+
+class UploadService
+{
+private:
+    vks::VulkanDevice* _vulkanDevice;
+
+    VkQueue _graphicsQueue;
+    VkQueue _transferQueue;
+    uint32_t _graphicsFamily;
+    uint32_t _transferFamily;
+
+    VkCommandPool _transferPool;
+    VkCommandPool _graphicsPool = VK_NULL_HANDLE;
+
+    struct staging_buffer {
+        VkBuffer buffer;
+        VkDeviceMemory memory;
+    };
+
+    // Batch being recorded
+    VkCommandBuffer _cmdBuffer = VK_NULL_HANDLE;
+    std::vector<staging_buffer> _lcStaging;
+
+    // Ownership acquires for the graphics queue, only used with a dedicated transfer family
+    std::vector<VkBufferMemoryBarrier> _lcBufferAcquire;
+    std::vector<VkImageMemoryBarrier> _lcImageAcquire;
+
+    struct batch {
+        VkFence fence;
+        VkSemaphore semaphore;
+        VkCommandBuffer transferCmd;
+        VkCommandBuffer graphicsCmd;
+        std::vector<staging_buffer> lcStaging;
+    };
+
+    std::vector<batch> _lcInFlight;
+
+    void begin();
+    staging_buffer createStaging(const void* data, VkDeviceSize size);
+    void release(batch& b);
+
+public:
+
+    UploadService(vks::VulkanDevice* vulkanDevice, VkQueue graphicsQueue, VkQueue transferQueue);
+
+    ~UploadService();
+
+    // True when copies run on a transfer only queue family
+    bool dedicated();
+
+    // Queue a copy of data into dst. dstStage / dstAccess describe the first use on the graphics queue
+    void uploadBuffer(VkBuffer dst, VkDeviceSize dstOffset, const void* data, VkDeviceSize size, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess);
+
+    // Queue a copy into mip 0 of a 2D color image in VK_IMAGE_LAYOUT_UNDEFINED, leaving it in finalLayout
+    void uploadImage(VkImage image, uint32_t width, uint32_t height, const void* data, VkDeviceSize size, VkImageLayout finalLayout, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess);
+
+    // Submit the recorded batch without waiting for it. Graphics work submitted afterwards sees the data
+    void submit();
+
+    // Free the staging memory of completed batches
+    void collect();
+
+    // Block until every submitted batch has completed
+    void waitIdle();
+};
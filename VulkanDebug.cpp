@@ -309,6 +309,22 @@ namespace vks
 		{
 			setObjectName(device, (uint64_t)_event, VK_DEBUG_REPORT_OBJECT_TYPE_EVENT_EXT, name);
 		}
+
+		Zone::Zone(VkCommandBuffer cmdBuffer, const char* name, glm::vec4 color) : zone(name), cmdBuffer(active ? cmdBuffer : VK_NULL_HANDLE)
+		{
+			if (this->cmdBuffer != VK_NULL_HANDLE)
+			{
+				beginRegion(cmdBuffer, name, color);
+			}
+		}
+
+		Zone::~Zone()
+		{
+			if (cmdBuffer != VK_NULL_HANDLE)
+			{
+				endRegion(cmdBuffer);
+			}
+		}
 	};
 }
 
@@ -22,6 +22,8 @@
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
 #include <glm/glm.hpp>
 
+#include "Trace.h"
+
 namespace vks
 {
 	namespace debug
@@ -98,5 +100,18 @@ namespace vks
 		void setSemaphoreName(VkDevice device, VkSemaphore semaphore, const char * name);
 		void setFenceName(VkDevice device, VkFence fence, const char * name);
 		void setEventName(VkDevice device, VkEvent _event, const char * name);
+
+		// Trace zone whose name also brackets the commands recorded in its scope as a marker region,
+		// so CPU traces and GPU captures show the same zones. The region needs active debug markers,
+		// the zone enabled tracing
+		class Zone
+		{
+		private:
+			TraceZone zone;
+			VkCommandBuffer cmdBuffer;
+		public:
+			Zone(VkCommandBuffer cmdBuffer, const char* name, glm::vec4 color = glm::vec4(1.0f));
+			~Zone();
+		};
 	};
 }
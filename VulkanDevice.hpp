@@ -15,6 +15,7 @@
 #include <algorithm>
 #include "vulkan/vulkan.h"
 #include "VulkanTools.h"
+#include "VulkanMemory.h"
 #include "VulkanBuffer.hpp"
 
 namespace vks
@@ -350,7 +351,7 @@ namespace vks
 			memAlloc.allocationSize = memReqs.size;
 			// Find a memory type index that fits the properties of the buffer
 			memAlloc.memoryTypeIndex = getMemoryType(memReqs.memoryTypeBits, memoryPropertyFlags);
-			VK_CHECK_RESULT(vkAllocateMemory(logicalDevice, &memAlloc, nullptr, memory));
+			VK_CHECK_RESULT(vks::memory::allocateMemory(logicalDevice, &memAlloc, memory));
 			
 			// If a pointer to the buffer data has been passed, map the buffer and copy over the data
 			if (data != nullptr)
@@ -402,7 +403,7 @@ namespace vks
 			memAlloc.allocationSize = memReqs.size;
 			// Find a memory type index that fits the properties of the buffer
 			memAlloc.memoryTypeIndex = getMemoryType(memReqs.memoryTypeBits, memoryPropertyFlags);
-			VK_CHECK_RESULT(vkAllocateMemory(logicalDevice, &memAlloc, nullptr, &buffer->memory));
+			VK_CHECK_RESULT(vks::memory::allocateMemory(logicalDevice, &memAlloc, &buffer->memory));
 
 			buffer->alignment = memReqs.alignment;
 			buffer->size = memAlloc.allocationSize;
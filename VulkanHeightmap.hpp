@@ -246,9 +246,9 @@ namespace vks
 			device->flushCommandBuffer(copyCmd, copyQueue, true);
 
 			vkDestroyBuffer(device->logicalDevice, vertexStaging.buffer, nullptr);
-			vkFreeMemory(device->logicalDevice, vertexStaging.memory, nullptr);
+			vks::memory::freeMemory(device->logicalDevice, vertexStaging.memory);
 			vkDestroyBuffer(device->logicalDevice, indexStaging.buffer, nullptr);
-			vkFreeMemory(device->logicalDevice, indexStaging.memory, nullptr);
+			vks::memory::freeMemory(device->logicalDevice, indexStaging.memory);
 		}
 	};
 }
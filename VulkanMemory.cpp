@@ -0,0 +1,154 @@
+
+#include "stdafx.h"
+
+#include "VulkanMemory.h"
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace vks
+{
+	namespace memory
+	{
+		struct allocation {
+			VkDeviceSize size;
+			memory_subsystem subsystem;
+			uint32_t heap;
+		};
+
+		const char* instanceExtension = "VK_KHR_get_physical_device_properties2";
+		const char* budgetExtension = "VK_EXT_memory_budget";
+
+		static std::mutex allocationMutex;
+		static std::unordered_map<uint64_t, allocation> allocations;
+		// Bytes allocated here per heap
+		static std::vector<VkDeviceSize> heapUsage;
+
+		static VkPhysicalDevice budgetPhysicalDevice = VK_NULL_HANDLE;
+		static VkPhysicalDeviceMemoryProperties memoryProperties = {};
+		static PFN_vkGetPhysicalDeviceMemoryProperties2KHR pfnGetPhysicalDeviceMemoryProperties2 = nullptr;
+
+		bool instanceExtensionSupported(const char* extension)
+		{
+			uint32_t count = 0;
+			vkEnumerateInstanceExtensionProperties(nullptr, &count, nullptr);
+			std::vector<VkExtensionProperties> extensions(count);
+			vkEnumerateInstanceExtensionProperties(nullptr, &count, extensions.data());
+			for (const VkExtensionProperties& e : extensions)
+			{
+				if (std::string(e.extensionName) == extension)
+				{
+					return true;
+				}
+			}
+			return false;
+		}
+
+		void setup(VkInstance instance, VkPhysicalDevice physicalDevice, bool budgetEnabled)
+		{
+			vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+
+			std::lock_guard<std::mutex> lock(allocationMutex);
+			heapUsage.resize(memoryProperties.memoryHeapCount, 0);
+
+			budgetPhysicalDevice = physicalDevice;
+			if (budgetEnabled)
+			{
+				pfnGetPhysicalDeviceMemoryProperties2 = reinterpret_cast<PFN_vkGetPhysicalDeviceMemoryProperties2KHR>(vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceMemoryProperties2KHR"));
+			}
+		}
+
+		bool budgetAvailable()
+		{
+#if defined(VK_EXT_memory_budget)
+			return pfnGetPhysicalDeviceMemoryProperties2 != nullptr;
+#else
+			return false;
+#endif
+		}
+
+		VkResult allocateMemory(VkDevice device, const VkMemoryAllocateInfo* pAllocateInfo, VkDeviceMemory* pMemory)
+		{
+			VkResult result = vkAllocateMemory(device, pAllocateInfo, nullptr, pMemory);
+			if (result != VK_SUCCESS)
+			{
+				return result;
+			}
+
+			allocation a;
+			a.size = pAllocateInfo->allocationSize;
+			a.subsystem = MemoryAccounting::current();
+			a.heap = (pAllocateInfo->memoryTypeIndex < memoryProperties.memoryTypeCount) ? memoryProperties.memoryTypes[pAllocateInfo->memoryTypeIndex].heapIndex : UINT32_MAX;
+
+			MemoryAccounting::allocated(MEMORY_DEVICE, a.subsystem, a.size);
+
+			std::lock_guard<std::mutex> lock(allocationMutex);
+			allocations[(uint64_t)*pMemory] = a;
+			if (a.heap < heapUsage.size())
+			{
+				heapUsage[a.heap] += a.size;
+			}
+			return result;
+		}
+
+		void freeMemory(VkDevice device, VkDeviceMemory memory)
+		{
+			if (memory == VK_NULL_HANDLE)
+			{
+				return;
+			}
+			{
+				std::lock_guard<std::mutex> lock(allocationMutex);
+				auto it = allocations.find((uint64_t)memory);
+				if (it != allocations.end())
+				{
+					MemoryAccounting::freed(MEMORY_DEVICE, it->second.subsystem, it->second.size);
+					if (it->second.heap < heapUsage.size())
+					{
+						heapUsage[it->second.heap] -= it->second.size;
+					}
+					allocations.erase(it);
+				}
+			}
+			vkFreeMemory(device, memory, nullptr);
+		}
+
+		std::vector<heap_budget> getBudget()
+		{
+			std::vector<heap_budget> heaps(memoryProperties.memoryHeapCount);
+
+			{
+				std::lock_guard<std::mutex> lock(allocationMutex);
+				for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; i++)
+				{
+					heaps[i].size = memoryProperties.memoryHeaps[i].size;
+					heaps[i].usage = heapUsage[i];
+					heaps[i].budget = memoryProperties.memoryHeaps[i].size;
+					heaps[i].deviceLocal = (memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0;
+				}
+			}
+
+#if defined(VK_EXT_memory_budget)
+			if (pfnGetPhysicalDeviceMemoryProperties2 != nullptr)
+			{
+				VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties = {};
+				budgetProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+
+				VkPhysicalDeviceMemoryProperties2KHR properties = {};
+				properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2_KHR;
+				properties.pNext = &budgetProperties;
+
+				pfnGetPhysicalDeviceMemoryProperties2(budgetPhysicalDevice, &properties);
+
+				for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; i++)
+				{
+					heaps[i].usage = budgetProperties.heapUsage[i];
+					heaps[i].budget = budgetProperties.heapBudget[i];
+				}
+			}
+#endif
+			return heaps;
+		}
+	}
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "vulkan/vulkan.h"
+
+#include "MemoryAccounting.h"
+
+#include <vector>
+
+/*
+* Vulkan device memory accounting
+*
+* Every vkAllocateMemory and vkFreeMemory goes through these, the size of each allocation is charged
+* to the subsystem of the allocating thread's MemoryScope and released again when it is freed.
+* With VK_EXT_memory_budget the heaps report the usage and budget of the whole process as the
+* driver sees it, without it usage is what was allocated here and the budget is the heap size.
+*/
+
+namespace vks
+{
+	namespace memory
+	{
+		struct heap_budget {
+			VkDeviceSize size;
+			VkDeviceSize usage;
+			VkDeviceSize budget;
+			bool deviceLocal;
+		};
+
+		// Instance extension the budget query needs, enable it when the instance supports it
+		extern const char* instanceExtension;
+		// Device extension to enable, when supported, for budgets reported by the driver
+		extern const char* budgetExtension;
+
+		// Returns true if the extension is among the instance extensions
+		bool instanceExtensionSupported(const char* extension);
+
+		// Maps memory types to heaps. budgetEnabled tells whether both extensions were enabled
+		void setup(VkInstance instance, VkPhysicalDevice physicalDevice, bool budgetEnabled);
+
+		// True if the heaps report driver budgets
+		bool budgetAvailable();
+
+		// vkAllocateMemory charging the allocation to MemoryAccounting::current()
+		VkResult allocateMemory(VkDevice device, const VkMemoryAllocateInfo* pAllocateInfo, VkDeviceMemory* pMemory);
+
+		// vkFreeMemory of memory from allocateMemory(), VK_NULL_HANDLE is ignored like by vkFreeMemory
+		void freeMemory(VkDevice device, VkDeviceMemory memory);
+
+		std::vector<heap_budget> getBudget();
+	}
+}
@@ -135,11 +135,11 @@ namespace vks
 		{		
 			assert(device);
 			vkDestroyBuffer(device, vertices.buffer, nullptr);
-			vkFreeMemory(device, vertices.memory, nullptr);
+			vks::memory::freeMemory(device, vertices.memory);
 			if (indices.buffer != VK_NULL_HANDLE)
 			{
 				vkDestroyBuffer(device, indices.buffer, nullptr);
-				vkFreeMemory(device, indices.memory, nullptr);
+				vks::memory::freeMemory(device, indices.memory);
 			}
 		}
 
@@ -361,9 +361,9 @@ namespace vks
 
 				// Destroy staging resources
 				vkDestroyBuffer(device->logicalDevice, vertexStaging.buffer, nullptr);
-				vkFreeMemory(device->logicalDevice, vertexStaging.memory, nullptr);
+				vks::memory::freeMemory(device->logicalDevice, vertexStaging.memory);
 				vkDestroyBuffer(device->logicalDevice, indexStaging.buffer, nullptr);
-				vkFreeMemory(device->logicalDevice, indexStaging.memory, nullptr);
+				vks::memory::freeMemory(device->logicalDevice, indexStaging.memory);
 
 				return true;
 			}
@@ -79,11 +79,16 @@ public:
 		VkResult err = VK_SUCCESS;
 
 		// Create the os-specific surface
+#if defined(_WIN32)
 		VkWin32SurfaceCreateInfoKHR surfaceCreateInfo = {};
 		surfaceCreateInfo.sType = VK_STRUCTURE_TYPE_WIN32_SURFACE_CREATE_INFO_KHR;
 		surfaceCreateInfo.hinstance = (HINSTANCE)platformHandle;
 		surfaceCreateInfo.hwnd = (HWND)platformWindow;
 		err = vkCreateWin32SurfaceKHR(instance, &surfaceCreateInfo, nullptr, &surface);
+#else
+		// Only Win32 windows are supported, other platforms render headless
+		err = VK_ERROR_EXTENSION_NOT_PRESENT;
+#endif
 
 		if (err != VK_SUCCESS) {
 			vks::tools::exitFatal("Could not create surface", err);
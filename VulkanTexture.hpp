@@ -60,7 +60,7 @@ namespace vks
 			{
 				vkDestroySampler(device->logicalDevice, sampler, nullptr);
 			}
-			vkFreeMemory(device->logicalDevice, deviceMemory, nullptr);
+			vks::memory::freeMemory(device->logicalDevice, deviceMemory);
 		}
 	};
 
@@ -156,7 +156,7 @@ namespace vks
 				// Get memory type index for a host visible buffer
 				memAllocInfo.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
 
-				VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &stagingMemory));
+				VK_CHECK_RESULT(vks::memory::allocateMemory(device->logicalDevice, &memAllocInfo, &stagingMemory));
 				VK_CHECK_RESULT(vkBindBufferMemory(device->logicalDevice, stagingBuffer, stagingMemory, 0));
 
 				// Copy texture data into staging buffer
@@ -210,7 +210,7 @@ namespace vks
 				memAllocInfo.allocationSize = memReqs.size;
 
 				memAllocInfo.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-				VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &deviceMemory));
+				VK_CHECK_RESULT(vks::memory::allocateMemory(device->logicalDevice, &memAllocInfo, &deviceMemory));
 				VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, image, deviceMemory, 0));
 
 				VkImageSubresourceRange subresourceRange = {};
@@ -250,7 +250,7 @@ namespace vks
 				device->flushCommandBuffer(copyCmd, copyQueue);
 
 				// Clean up staging resources
-				vkFreeMemory(device->logicalDevice, stagingMemory, nullptr);
+				vks::memory::freeMemory(device->logicalDevice, stagingMemory);
 				vkDestroyBuffer(device->logicalDevice, stagingBuffer, nullptr);
 			}
 			else
@@ -290,7 +290,7 @@ namespace vks
 				memAllocInfo.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
 
 				// Allocate host memory
-				VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &mappableMemory));
+				VK_CHECK_RESULT(vks::memory::allocateMemory(device->logicalDevice, &memAllocInfo, &mappableMemory));
 
 				// Bind allocated image for use
 				VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, mappableImage, mappableMemory, 0));
@@ -426,7 +426,7 @@ namespace vks
 			// Get memory type index for a host visible buffer
 			memAllocInfo.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
 
-			VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &stagingMemory));
+			VK_CHECK_RESULT(vks::memory::allocateMemory(device->logicalDevice, &memAllocInfo, &stagingMemory));
 			VK_CHECK_RESULT(vkBindBufferMemory(device->logicalDevice, stagingBuffer, stagingMemory, 0));
 
 			// Copy texture data into staging buffer
@@ -469,7 +469,7 @@ namespace vks
 			memAllocInfo.allocationSize = memReqs.size;
 
 			memAllocInfo.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-			VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &deviceMemory));
+			VK_CHECK_RESULT(vks::memory::allocateMemory(device->logicalDevice, &memAllocInfo, &deviceMemory));
 			VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, image, deviceMemory, 0));
 
 			VkImageSubresourceRange subresourceRange = {};
@@ -509,7 +509,7 @@ namespace vks
 			device->flushCommandBuffer(copyCmd, copyQueue);
 
 			// Clean up staging resources
-			vkFreeMemory(device->logicalDevice, stagingMemory, nullptr);
+			vks::memory::freeMemory(device->logicalDevice, stagingMemory);
 			vkDestroyBuffer(device->logicalDevice, stagingBuffer, nullptr);
 
 			// Create sampler
@@ -621,7 +621,7 @@ namespace vks
 			// Get memory type index for a host visible buffer
 			memAllocInfo.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
 
-			VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &stagingMemory));
+			VK_CHECK_RESULT(vks::memory::allocateMemory(device->logicalDevice, &memAllocInfo, &stagingMemory));
 			VK_CHECK_RESULT(vkBindBufferMemory(device->logicalDevice, stagingBuffer, stagingMemory, 0));
 
 			// Copy texture data into staging buffer
@@ -680,7 +680,7 @@ namespace vks
 			memAllocInfo.allocationSize = memReqs.size;
 			memAllocInfo.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
-			VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &deviceMemory));
+			VK_CHECK_RESULT(vks::memory::allocateMemory(device->logicalDevice, &memAllocInfo, &deviceMemory));
 			VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, image, deviceMemory, 0));
 
 			// Use a separate command buffer for texture loading
@@ -750,7 +750,7 @@ namespace vks
 			VK_CHECK_RESULT(vkCreateImageView(device->logicalDevice, &viewCreateInfo, nullptr, &view));
 
 			// Clean up staging resources
-			vkFreeMemory(device->logicalDevice, stagingMemory, nullptr);
+			vks::memory::freeMemory(device->logicalDevice, stagingMemory);
 			vkDestroyBuffer(device->logicalDevice, stagingBuffer, nullptr);
 
 			// Update descriptor image info member that can be used for setting up descriptor sets
@@ -832,7 +832,7 @@ namespace vks
 			// Get memory type index for a host visible buffer
 			memAllocInfo.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
 
-			VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &stagingMemory));
+			VK_CHECK_RESULT(vks::memory::allocateMemory(device->logicalDevice, &memAllocInfo, &stagingMemory));
 			VK_CHECK_RESULT(vkBindBufferMemory(device->logicalDevice, stagingBuffer, stagingMemory, 0));
 
 			// Copy texture data into staging buffer
@@ -895,7 +895,7 @@ namespace vks
 			memAllocInfo.allocationSize = memReqs.size;
 			memAllocInfo.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
-			VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &deviceMemory));
+			VK_CHECK_RESULT(vks::memory::allocateMemory(device->logicalDevice, &memAllocInfo, &deviceMemory));
 			VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, image, deviceMemory, 0));
 
 			// Use a separate command buffer for texture loading
@@ -965,7 +965,7 @@ namespace vks
 			VK_CHECK_RESULT(vkCreateImageView(device->logicalDevice, &viewCreateInfo, nullptr, &view));
 
 			// Clean up staging resources
-			vkFreeMemory(device->logicalDevice, stagingMemory, nullptr);
+			vks::memory::freeMemory(device->logicalDevice, stagingMemory);
 			vkDestroyBuffer(device->logicalDevice, stagingBuffer, nullptr);
 
 			// Update descriptor image info member that can be used for setting up descriptor sets
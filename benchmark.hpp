@@ -13,24 +13,345 @@
 #include <functional>
 #include <chrono>
 #include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <utility>
+#include <cstdlib>
+
+#if !defined(_WIN32)
+#include <sys/wait.h>
+#endif
+
+#include "benchmarkstats.hpp"
 
 namespace vks
 {
 	class Benchmark {
+	public:
+		typedef stats::Statistics Statistics;
+
 	private:
 		FILE *stream;
 		VkPhysicalDeviceProperties deviceProps;
+
+		// Stage times of the frame being rendered and the end of the last stage
+		std::vector<double> stageFrame;
+		std::chrono::high_resolution_clock::time_point stageStart;
+		// Set during the benchmark phase, warm up samples are dropped
+		bool measuring = false;
+
+		typedef std::vector<std::string> Names;
+		typedef std::vector<std::vector<double>> Series;
+
+		static void printSeries(const Names &names, const Series &times) {
+			for (size_t s = 0; s < names.size(); s++) {
+				Statistics stats = computeStatistics(times[s]);
+				std::cout << "  " << std::left << std::setw(13) << names[s] << std::right << ": mean " << stats.mean << " ms, p50 " << stats.p50
+					<< " ms, p99 " << stats.p99 << " ms, max " << stats.max << " ms" << std::endl;
+			}
+		}
+
+		// Compares the samples of each named series that the baseline also has
+		void compareSeries(std::vector<stats::Comparison> &comparisons, const stats::JsonValue *base, const std::string &prefix, const Names &names, const Series &times) {
+			if (base == nullptr) {
+				return;
+			}
+			for (size_t s = 0; s < names.size(); s++) {
+				const stats::JsonValue *samples = base->find(names[s]);
+				if ((samples == nullptr) || samples->items.empty() || times[s].empty()) {
+					continue;
+				}
+				comparisons.push_back(stats::compare(prefix + names[s], samples->numbers(), times[s], threshold, BENCHMARK_COMPARE_ALPHA, minDelta));
+			}
+		}
+
+		static void saveCSVSeries(std::ofstream &result, const std::string &column, const Names &names, const Series &times) {
+			if (names.empty()) {
+				return;
+			}
+			result << std::endl << column << ",mean (ms),p50 (ms),p90 (ms),p99 (ms),max (ms)" << std::endl;
+			for (size_t s = 0; s < names.size(); s++) {
+				Statistics stats = computeStatistics(times[s]);
+				result << names[s] << "," << stats.mean << "," << stats.p50 << "," << stats.p90 << "," << stats.p99 << "," << stats.max << std::endl;
+			}
+		}
+
+		static void saveJSONSeries(std::ofstream &result, const std::string &key, const Names &names, const Series &times) {
+			if (names.empty()) {
+				return;
+			}
+			result << "," << std::endl << "  " << stats::jsonString(key) << ": {";
+			for (size_t s = 0; s < names.size(); s++) {
+				Statistics stats = computeStatistics(times[s]);
+				result << (s > 0 ? "," : "") << std::endl << "    " << stats::jsonString(names[s]) << ": { "
+					<< "\"mean\": " << stats.mean << ", \"p50\": " << stats.p50 << ", \"p90\": " << stats.p90
+					<< ", \"p99\": " << stats.p99 << ", \"max\": " << stats.max << " }";
+			}
+			result << std::endl << "  }";
+		}
+
+		static void saveJSONSamples(std::ofstream &result, const std::string &key, const Names &names, const Series &times) {
+			if (names.empty()) {
+				return;
+			}
+			result << "," << std::endl << "  " << stats::jsonString(key) << ": {";
+			for (size_t s = 0; s < names.size(); s++) {
+				result << (s > 0 ? "," : "") << std::endl << "    " << stats::jsonString(names[s]) << ": [";
+				for (size_t i = 0; i < times[s].size(); i++) {
+					result << (i > 0 ? ", " : "") << times[s][i];
+				}
+				result << "]";
+			}
+			result << std::endl << "  }";
+		}
+
+		size_t allocatingFrames() const {
+			return frameAllocations.size() - std::count(frameAllocations.begin(), frameAllocations.end(), 0.0);
+		}
+
+		void saveCSV(std::ofstream &result, const Statistics &stats) {
+			result << "device,driverversion,duration (ms),frames,fps,min (ms),max (ms),mean (ms),stddev (ms),p50 (ms),p90 (ms),p99 (ms),p99.9 (ms),hitches" << std::endl;
+			result << deviceProps.deviceName << "," << deviceProps.driverVersion << "," << runtime << "," << frameCount << "," << frameCount / (runtime / 1000.0) << ","
+				<< stats.min << "," << stats.max << "," << stats.mean << "," << stats.stddev << ","
+				<< stats.p50 << "," << stats.p90 << "," << stats.p99 << "," << stats.p999 << "," << stats.hitches << std::endl;
+
+			result << std::endl << "bucket (ms),frames" << std::endl;
+			for (size_t i = 0; i < stats.histogram.size(); i++) {
+				if (stats.histogram[i] > 0) {
+					result << stats::histogramLowerBound(i) << "," << stats.histogram[i] << std::endl;
+				}
+			}
+
+			saveCSVSeries(result, "stage", stageNames, stageTimes);
+			saveCSVSeries(result, "gpu pass", gpuPassNames, gpuPassTimes);
+
+			if (!frameAllocations.empty()) {
+				Statistics allocs = computeStatistics(frameAllocations);
+				result << std::endl << "allocating frames,allocations/frame,max allocations/frame,bytes/frame" << std::endl;
+				result << allocatingFrames() << "," << allocs.mean << "," << allocs.max << "," << computeStatistics(frameAllocatedBytes).mean << std::endl;
+			}
+			if (!memory.empty()) {
+				result << std::endl << "memory,current (bytes),peak (bytes),allocations/s,bytes/s" << std::endl;
+				for (const MemoryUse &m : memory) {
+					result << m.name << "," << m.current << "," << m.peak << "," << m.allocationsPerSecond << "," << m.bytesPerSecond << std::endl;
+				}
+			}
+			if (!heaps.empty()) {
+				result << std::endl << "heap,size (bytes),usage (bytes),budget (bytes)" << std::endl;
+				for (const HeapUse &h : heaps) {
+					result << h.name << "," << h.size << "," << h.usage << "," << h.budget << std::endl;
+				}
+			}
+
+			if (outputFrameTimes) {
+				result << std::endl << "frame,ms";
+				for (const std::string &name : stageNames) {
+					result << "," << name << " (ms)";
+				}
+				result << std::endl;
+				for (size_t i = 0; i < frameTimes.size(); i++) {
+					result << i << "," << frameTimes[i];
+					for (size_t s = 0; s < stageNames.size(); s++) {
+						result << "," << stageTimes[s][i];
+					}
+					result << std::endl;
+				}
+			}
+		}
+
+		void saveJSON(std::ofstream &result, const Statistics &stats) {
+			result << "{" << std::endl;
+
+			result << "  \"build\": {" << std::endl;
+			result << "    \"configuration\": " << stats::jsonString(stats::buildConfiguration()) << "," << std::endl;
+			result << "    \"compiler\": " << stats::jsonString(stats::compiler()) << "," << std::endl;
+			result << "    \"date\": " << stats::jsonString(std::string(__DATE__) + " " + __TIME__) << std::endl;
+			result << "  }," << std::endl;
+
+			result << "  \"device\": {" << std::endl;
+			result << "    \"name\": " << stats::jsonString(deviceProps.deviceName) << "," << std::endl;
+			result << "    \"driverVersion\": " << deviceProps.driverVersion << "," << std::endl;
+			result << "    \"apiVersion\": " << deviceProps.apiVersion << "," << std::endl;
+			result << "    \"vendorID\": " << deviceProps.vendorID << "," << std::endl;
+			result << "    \"deviceID\": " << deviceProps.deviceID << std::endl;
+			result << "  }," << std::endl;
+
+			result << "  \"config\": {" << std::endl;
+			result << "    \"warmup\": " << warmup << "," << std::endl;
+			result << "    \"duration\": " << duration;
+			for (auto &entry : config) {
+				result << "," << std::endl << "    " << stats::jsonString(entry.first) << ": " << stats::jsonString(entry.second);
+			}
+			result << std::endl << "  }," << std::endl;
+
+			result << "  \"results\": {" << std::endl;
+			result << "    \"runtime\": " << runtime << "," << std::endl;
+			result << "    \"frames\": " << frameCount << "," << std::endl;
+			result << "    \"fps\": " << frameCount / (runtime / 1000.0) << "," << std::endl;
+			result << "    \"min\": " << stats.min << "," << std::endl;
+			result << "    \"max\": " << stats.max << "," << std::endl;
+			result << "    \"mean\": " << stats.mean << "," << std::endl;
+			result << "    \"stddev\": " << stats.stddev << "," << std::endl;
+			result << "    \"p50\": " << stats.p50 << "," << std::endl;
+			result << "    \"p90\": " << stats.p90 << "," << std::endl;
+			result << "    \"p99\": " << stats.p99 << "," << std::endl;
+			result << "    \"p99.9\": " << stats.p999 << "," << std::endl;
+			result << "    \"hitches\": " << stats.hitches << "," << std::endl;
+			result << "    \"hitchThreshold\": " << stats.p50 * BENCHMARK_HITCH_FACTOR << std::endl;
+			result << "  }," << std::endl;
+
+			// Only occupied buckets, each with its lower bound in ms
+			result << "  \"histogram\": [";
+			bool first = true;
+			for (size_t i = 0; i < stats.histogram.size(); i++) {
+				if (stats.histogram[i] > 0) {
+					result << (first ? "" : ",") << std::endl << "    { \"ms\": " << stats::histogramLowerBound(i) << ", \"frames\": " << stats.histogram[i] << " }";
+					first = false;
+				}
+			}
+			result << std::endl << "  ]";
+
+			saveJSONSeries(result, "stages", stageNames, stageTimes);
+			saveJSONSeries(result, "gpuPasses", gpuPassNames, gpuPassTimes);
+
+			if (!frameAllocations.empty()) {
+				Statistics allocs = computeStatistics(frameAllocations);
+				result << "," << std::endl << "  \"allocations\": {" << std::endl;
+				result << "    \"allocatingFrames\": " << allocatingFrames() << "," << std::endl;
+				result << "    \"mean\": " << allocs.mean << "," << std::endl;
+				result << "    \"p99\": " << allocs.p99 << "," << std::endl;
+				result << "    \"max\": " << allocs.max << "," << std::endl;
+				result << "    \"bytesMean\": " << computeStatistics(frameAllocatedBytes).mean << std::endl;
+				result << "  }";
+			}
+			if (!memory.empty()) {
+				result << "," << std::endl << "  \"memory\": {";
+				for (size_t i = 0; i < memory.size(); i++) {
+					const MemoryUse &m = memory[i];
+					result << (i > 0 ? "," : "") << std::endl << "    " << stats::jsonString(m.name) << ": { "
+						<< "\"current\": " << m.current << ", \"peak\": " << m.peak
+						<< ", \"allocationsPerSecond\": " << m.allocationsPerSecond << ", \"bytesPerSecond\": " << m.bytesPerSecond << " }";
+				}
+				result << std::endl << "  }";
+			}
+			if (!heaps.empty()) {
+				result << "," << std::endl << "  \"heaps\": [";
+				for (size_t i = 0; i < heaps.size(); i++) {
+					const HeapUse &h = heaps[i];
+					result << (i > 0 ? "," : "") << std::endl << "    { \"name\": " << stats::jsonString(h.name)
+						<< ", \"size\": " << h.size << ", \"usage\": " << h.usage << ", \"budget\": " << h.budget << " }";
+				}
+				result << std::endl << "  ]";
+			}
+
+			if (outputFrameTimes) {
+				result << "," << std::endl << "  \"frameTimes\": [";
+				for (size_t i = 0; i < frameTimes.size(); i++) {
+					result << (i > 0 ? ", " : "") << frameTimes[i];
+				}
+				result << "]";
+
+				saveJSONSamples(result, "stageTimes", stageNames, stageTimes);
+				saveJSONSamples(result, "gpuPassTimes", gpuPassNames, gpuPassTimes);
+			}
+
+			result << std::endl << "}" << std::endl;
+		}
+
 	public:
 		bool active = false;
 		bool outputFrameTimes = false;
+		// Measure the complete frame including view, camera and overlay updates instead of render() only
+		bool fullFrame = false;
 		uint32_t warmup = 1;
 		uint32_t duration = 10;
 		std::vector<double> frameTimes;
+		// Results are written as JSON if the name ends in .json, as CSV otherwise
 		std::string filename = "";
+		// Settings of the run, written to the JSON results as name/value pairs
+		std::vector<std::pair<std::string, std::string>> config;
+
+		// Results of an earlier run with frame times (-bt), compared by compareBaseline()
+		std::string baseline = "";
+		// Regression threshold in percent of the baseline median
+		double threshold = BENCHMARK_COMPARE_THRESHOLD;
+		// Changes of less than this many ms are never reported, stages that take microseconds are all noise
+		double minDelta = 0.01;
+		// Process exit code, BENCHMARK_EXIT_REGRESSION or BENCHMARK_EXIT_ERROR after a failed comparison
+		int exitCode = 0;
+
+		// Names of the CPU stages a frame is split into, set before run()
+		std::vector<std::string> stageNames;
+		// Time spent in each stage, stageTimes[stage][frame] in ms
+		std::vector<std::vector<double>> stageTimes;
 
 		double runtime = 0.0;
 		uint32_t frameCount = 0;
 
+		// Names of the GPU passes, set before run() if the device supports timestamps
+		std::vector<std::string> gpuPassNames;
+		// gpuPassTimes[pass][sample] in ms. A sample is read frames after it was rendered, so the
+		// samples are not aligned with frameTimes
+		std::vector<std::vector<double>> gpuPassTimes;
+
+		// Memory in use at the end of the run, set by the caller after run(). Rates are over the measured frames
+		struct MemoryUse {
+			std::string name;
+			uint64_t current;
+			uint64_t peak;
+			double allocationsPerSecond;
+			double bytesPerSecond;
+		};
+		std::vector<MemoryUse> memory;
+
+		struct HeapUse {
+			std::string name;
+			uint64_t size;
+			uint64_t usage;
+			uint64_t budget;
+		};
+		std::vector<HeapUse> heaps;
+
+		// Called when the measured frames begin, after the warm up
+		std::function<void()> measureStart;
+
+		// Operator new calls and bytes of each measured frame, empty unless counted (-allocs)
+		std::vector<double> frameAllocations;
+		std::vector<double> frameAllocatedBytes;
+
+		// Adds the allocations of the frame
+		void allocations(uint64_t count, uint64_t bytes) {
+			if (!measuring) {
+				return;
+			}
+			frameAllocations.push_back(double(count));
+			frameAllocatedBytes.push_back(double(bytes));
+		}
+
+		// Adds one sample per GPU pass
+		void gpuPasses(const double *ms) {
+			if (!measuring) {
+				return;
+			}
+			for (size_t p = 0; p < gpuPassNames.size(); p++) {
+				gpuPassTimes[p].push_back(ms[p]);
+			}
+		}
+
+		// Ends a stage of the current frame, adding the time since the previous stage ended or the frame started
+		void stage(uint32_t index) {
+			if (!active || (index >= stageFrame.size())) {
+				return;
+			}
+			auto tNow = std::chrono::high_resolution_clock::now();
+			stageFrame[index] += std::chrono::duration<double, std::milli>(tNow - stageStart).count();
+			stageStart = tNow;
+		}
+
+		static Statistics computeStatistics(const std::vector<double> &times) {
+			return stats::compute(times);
+		}
+
 		void run(std::function<void()> renderFunc, VkPhysicalDeviceProperties deviceProps) {
 			active = true;
 			this->deviceProps = deviceProps;
@@ -41,33 +362,113 @@ namespace vks
 #endif
 			std::cout << std::fixed << std::setprecision(3);
 
+			stageFrame.assign(stageNames.size(), 0.0);
+			stageTimes.assign(stageNames.size(), std::vector<double>());
+			gpuPassTimes.assign(gpuPassNames.size(), std::vector<double>());
+
 			// Warm up phase to get more stable frame rates
 			{
 				double tMeasured = 0.0;
 				while (tMeasured < (warmup * 1000)) {
 					auto tStart = std::chrono::high_resolution_clock::now();
+					stageStart = tStart;
 					renderFunc();
 					auto tDiff = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
 					tMeasured += tDiff;
+					std::fill(stageFrame.begin(), stageFrame.end(), 0.0);
 				};
 			}
 
 			// Benchmark phase
 			{
+				if (measureStart) {
+					measureStart();
+				}
+				measuring = true;
 				while (runtime < (duration * 1000.0)) {
 					auto tStart = std::chrono::high_resolution_clock::now();
+					stageStart = tStart;
 					renderFunc();
 					auto tDiff = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
 					runtime += tDiff;
 					frameTimes.push_back(tDiff);
 					frameCount++;
+					for (size_t s = 0; s < stageFrame.size(); s++) {
+						stageTimes[s].push_back(stageFrame[s]);
+						stageFrame[s] = 0.0;
+					}
 				};
+				measuring = false;
 				std::cout << "Benchmark finished" << std::endl;
 				std::cout << "device : " << deviceProps.deviceName << " (driver version: " << deviceProps.driverVersion << ")" << std::endl;
 				std::cout << "runtime: " << (runtime / 1000.0) << std::endl;
 				std::cout << "frames : " << frameCount << std::endl;
 				std::cout << "fps    : " << frameCount / (runtime / 1000.0) << std::endl;
+
+				Statistics stats = computeStatistics(frameTimes);
+				std::cout << "best   : " << (1000.0 / stats.min) << " fps (" << stats.min << " ms)" << std::endl;
+				std::cout << "worst  : " << (1000.0 / stats.max) << " fps (" << stats.max << " ms)" << std::endl;
+				std::cout << "avg    : " << (1000.0 / stats.mean) << " fps (" << stats.mean << " ms, stddev " << stats.stddev << " ms)" << std::endl;
+				std::cout << "p50    : " << stats.p50 << " ms" << std::endl;
+				std::cout << "p90    : " << stats.p90 << " ms" << std::endl;
+				std::cout << "p99    : " << stats.p99 << " ms" << std::endl;
+				std::cout << "p99.9  : " << stats.p999 << " ms" << std::endl;
+				std::cout << "hitches: " << stats.hitches << " (> " << stats.p50 * BENCHMARK_HITCH_FACTOR << " ms)" << std::endl;
+				printSeries(stageNames, stageTimes);
+				if (!gpuPassNames.empty()) {
+					std::cout << "gpu    :" << std::endl;
+					printSeries(gpuPassNames, gpuPassTimes);
+				}
+				if (!frameAllocations.empty()) {
+					Statistics allocs = computeStatistics(frameAllocations);
+					std::cout << "allocs : " << allocatingFrames() << " of " << frameAllocations.size() << " frames allocated, "
+						<< allocs.mean << " per frame (max " << allocs.max << "), " << computeStatistics(frameAllocatedBytes).mean << " bytes per frame" << std::endl;
+				}
+				std::cout << std::endl;
+			}
+		}
+
+		// Compares frame, stage and GPU pass times with the baseline and prints the difference of every metric
+		void compareBaseline() {
+			stats::JsonValue base;
+			if (!stats::loadJson(baseline, base)) {
+				std::cerr << "Could not read benchmark baseline " << baseline << std::endl;
+				exitCode = BENCHMARK_EXIT_ERROR;
+				return;
+			}
+			const stats::JsonValue *baseFrames = base.find("frameTimes");
+			if (baseFrames == nullptr) {
+				std::cerr << "Benchmark baseline " << baseline << " has no frame times, it must be saved as JSON with -bt" << std::endl;
+				exitCode = BENCHMARK_EXIT_ERROR;
+				return;
+			}
+
+			// Runs on another device or with other settings are still compared, the differences are listed first
+			const stats::JsonValue *baseDevice = base.find("device");
+			const stats::JsonValue *baseName = (baseDevice != nullptr) ? baseDevice->find("name") : nullptr;
+			if ((baseName != nullptr) && (baseName->text() != deviceProps.deviceName)) {
+				std::cout << "warning: baseline device " << baseName->text() << std::endl;
+			}
+			const stats::JsonValue *baseConfig = base.find("config");
+			for (auto &entry : config) {
+				const stats::JsonValue *value = (baseConfig != nullptr) ? baseConfig->find(entry.first) : nullptr;
+				if ((value != nullptr) && (value->text() != entry.second)) {
+					std::cout << "warning: baseline " << entry.first << " " << value->text() << ", now " << entry.second << std::endl;
+				}
+			}
+
+			std::vector<stats::Comparison> comparisons;
+			comparisons.push_back(stats::compare("frame", baseFrames->numbers(), frameTimes, threshold, BENCHMARK_COMPARE_ALPHA, minDelta));
+			compareSeries(comparisons, base.find("stageTimes"), "stage ", stageNames, stageTimes);
+			compareSeries(comparisons, base.find("gpuPassTimes"), "gpu ", gpuPassNames, gpuPassTimes);
+
+			std::cout << "Comparison with " << baseline << " (median ms, Mann-Whitney p)" << std::endl;
+			uint32_t regressions = stats::printComparisons(std::cout, comparisons);
+			if (regressions > 0) {
+				std::cout << regressions << " metric(s) regressed by more than " << std::setprecision(1) << threshold << " %" << std::endl;
+				exitCode = BENCHMARK_EXIT_REGRESSION;
 			}
+			std::cout << std::endl;
 		}
 
 		void saveResults() {
@@ -75,21 +476,14 @@ namespace vks
 			if (result.is_open()) {
 				result << std::fixed << std::setprecision(4);
 
-				result << "device,driverversion,duration (ms),frames,fps" << std::endl;
-				result << deviceProps.deviceName << "," << deviceProps.driverVersion << "," << runtime << "," << frameCount << "," << frameCount / (runtime / 1000.0) << std::endl;
+				Statistics stats = computeStatistics(frameTimes);
 
-				if (outputFrameTimes) {
-					result << std::endl << "frame,ms" << std::endl;
-					for (size_t i = 0; i < frameTimes.size(); i++) {
-						result << i << "," << frameTimes[i] << std::endl;
-					}
-					double tMin = *std::min_element(frameTimes.begin(), frameTimes.end());
-					double tMax = *std::max_element(frameTimes.begin(), frameTimes.end());
-					double tAvg = std::accumulate(frameTimes.begin(), frameTimes.end(), 0.0) / (double)frameTimes.size();
-					std::cout << "best   : " << (1000.0 / tMin) << " fps (" << tMin << " ms)" << std::endl;
-					std::cout << "worst  : " << (1000.0 / tMax) << " fps (" << tMax << " ms)" << std::endl;
-					std::cout << "avg    : " << (1000.0 / tAvg) << " fps (" << tAvg << " ms)" << std::endl;
-					std::cout << std::endl;
+				const std::string extension = ".json";
+				if ((filename.size() >= extension.size()) && (filename.compare(filename.size() - extension.size(), extension.size(), extension) == 0)) {
+					saveJSON(result, stats);
+				}
+				else {
+					saveCSV(result, stats);
 				}
 
 				result.flush();
@@ -99,4 +493,210 @@ namespace vks
 			}
 		}
 	};
-}
\ No newline at end of file
+
+	// Runs the benchmark once per combination of robot count, thread count and text overlay. Each run
+	// is a child process with the command line of this one, so it starts from a fresh device. Results
+	// and baseline file names get the settings of the run appended, e.g. results_r10000_t4.json
+	class BenchmarkSweep {
+	private:
+		std::string executable;
+		// Command line without the sweep, results and baseline arguments
+		std::vector<std::string> args;
+		std::vector<std::string> robots;
+		std::vector<std::string> threads;
+		std::vector<bool> overlay;
+		std::string filename;
+		std::string baseline;
+		// First sweep value that is not a plain count, run() refuses to start
+		std::string invalid;
+
+		// Counts go into the child command line and the file names, so only digits are taken
+		std::vector<std::string> split(const std::string &list) {
+			std::vector<std::string> values;
+			std::stringstream ss(list);
+			std::string value;
+			while (std::getline(ss, value, ',')) {
+				if (value.empty()) {
+					continue;
+				}
+				if (value.find_first_not_of("0123456789") != std::string::npos) {
+					if (invalid.empty()) {
+						invalid = value;
+					}
+					continue;
+				}
+				values.push_back(value);
+			}
+			return values;
+		}
+
+		static std::string quote(const std::string &arg) {
+			return "\"" + arg + "\"";
+		}
+
+		static std::string suffixed(const std::string &name, const std::string &suffix) {
+			size_t dot = name.find_last_of('.');
+			size_t slash = name.find_last_of("/\\");
+			if ((dot == std::string::npos) || ((slash != std::string::npos) && (dot < slash))) {
+				return name + suffix;
+			}
+			return name.substr(0, dot) + suffix + name.substr(dot);
+		}
+
+		static int runProcess(const std::string &command) {
+#if defined(_WIN32)
+			// cmd /c strips the outer quotes
+			return std::system(("\"" + command + "\"").c_str());
+#else
+			int status = std::system(command.c_str());
+			return ((status != -1) && WIFEXITED(status)) ? WEXITSTATUS(status) : BENCHMARK_EXIT_ERROR;
+#endif
+		}
+
+	public:
+		// Takes the sweep arguments from the command line, returns true if a sweep was requested
+		bool parse(const std::vector<const char*> &argv) {
+			executable = argv.empty() ? "" : argv[0];
+			for (size_t i = 1; i < argv.size(); i++) {
+				std::string arg(argv[i]);
+				bool hasValue = (i + 1 < argv.size());
+				if (((arg == "-bsr") || (arg == "--benchsweeprobots")) && hasValue) {
+					robots = split(argv[++i]);
+				}
+				else if (((arg == "-bst") || (arg == "--benchsweepthreads")) && hasValue) {
+					threads = split(argv[++i]);
+				}
+				else if ((arg == "-bso") || (arg == "--benchsweepoverlay")) {
+					overlay = { true, false };
+				}
+				else if (((arg == "-bf") || (arg == "--benchfilename")) && hasValue) {
+					filename = argv[++i];
+				}
+				else if (((arg == "-bb") || (arg == "--benchbaseline")) && hasValue) {
+					baseline = argv[++i];
+				}
+				else {
+					args.push_back(arg);
+				}
+			}
+			return !(robots.empty() && threads.empty() && overlay.empty() && invalid.empty());
+		}
+
+		// Returns BENCHMARK_EXIT_REGRESSION or BENCHMARK_EXIT_ERROR if any run failed, 0 otherwise
+		int run() {
+#if defined(_WIN32)
+			AttachConsole(ATTACH_PARENT_PROCESS);
+			FILE *stream;
+			freopen_s(&stream, "CONOUT$", "w+", stdout);
+			freopen_s(&stream, "CONOUT$", "w+", stderr);
+#endif
+			if (!invalid.empty()) {
+				std::cout << "Sweep value \"" << invalid << "\" is not a count" << std::endl;
+#if defined(_WIN32)
+				FreeConsole();
+#endif
+				return BENCHMARK_EXIT_ERROR;
+			}
+
+			// An empty entry keeps the setting of the command line
+			std::vector<std::string> robotRuns = robots.empty() ? std::vector<std::string>{ "" } : robots;
+			std::vector<std::string> threadRuns = threads.empty() ? std::vector<std::string>{ "" } : threads;
+			std::vector<int> overlayRuns;
+			for (bool on : overlay) {
+				overlayRuns.push_back(on ? 1 : 0);
+			}
+			if (overlayRuns.empty()) {
+				overlayRuns.push_back(-1);
+			}
+
+			struct sweep_run {
+				std::string name;
+				std::string filename;
+				int exitCode;
+			};
+			std::vector<sweep_run> runs;
+
+			for (const std::string &r : robotRuns) {
+				for (const std::string &t : threadRuns) {
+					for (int o : overlayRuns) {
+						std::string suffix;
+						std::string name;
+						std::string command = quote(executable);
+						for (const std::string &arg : args) {
+							command += " " + quote(arg);
+						}
+						command += " -b";
+						if (!r.empty()) {
+							command += " -robots " + quote(r);
+							suffix += "_r" + r;
+							name += "robots " + r + " ";
+						}
+						if (!t.empty()) {
+							command += " -threads " + quote(t);
+							suffix += "_t" + t;
+							name += "threads " + t + " ";
+						}
+						if (o >= 0) {
+							command += (o > 0) ? "" : " -notext";
+							suffix += (o > 0) ? "_text" : "_notext";
+							name += (o > 0) ? "text" : "no text";
+						}
+
+						sweep_run run;
+						run.name = name.substr(0, name.find_last_not_of(' ') + 1);
+						if (!filename.empty()) {
+							run.filename = suffixed(filename, suffix);
+							command += " -bf " + quote(run.filename);
+						}
+						if (!baseline.empty()) {
+							command += " -bb " + quote(suffixed(baseline, suffix));
+						}
+
+						std::cout << "Sweep run: " << name << std::endl;
+						std::cout.flush();
+						run.exitCode = runProcess(command);
+						runs.push_back(run);
+					}
+				}
+			}
+
+			int exitCode = 0;
+			std::cout << std::fixed << std::setprecision(3);
+			std::cout << "Sweep results" << std::endl;
+			std::cout << std::left << std::setw(32) << "run" << std::right << std::setw(12) << "fps"
+				<< std::setw(12) << "p50 (ms)" << std::setw(12) << "p99 (ms)" << "  result" << std::endl;
+			for (const sweep_run &run : runs) {
+				std::cout << std::left << std::setw(32) << run.name << std::right;
+				// Only JSON results can be read back
+				stats::JsonValue result;
+				const stats::JsonValue *values = nullptr;
+				if (!run.filename.empty() && stats::loadJson(run.filename, result)) {
+					values = result.find("results");
+				}
+				const char *keys[] = { "fps", "p50", "p99" };
+				for (const char *key : keys) {
+					const stats::JsonValue *value = (values != nullptr) ? values->find(key) : nullptr;
+					if (value != nullptr) {
+						std::cout << std::setw(12) << value->number;
+					}
+					else {
+						std::cout << std::setw(12) << "-";
+					}
+				}
+				switch (run.exitCode) {
+				case 0: std::cout << "  ok"; break;
+				case BENCHMARK_EXIT_REGRESSION: std::cout << "  REGRESSED"; break;
+				default: std::cout << "  failed (" << run.exitCode << ")"; break;
+				}
+				std::cout << std::endl;
+				if (run.exitCode != 0) {
+					exitCode = std::max(exitCode, (run.exitCode == BENCHMARK_EXIT_REGRESSION) ? BENCHMARK_EXIT_REGRESSION : BENCHMARK_EXIT_ERROR);
+				}
+			}
+#if defined(_WIN32)
+			FreeConsole();
+#endif
+			return exitCode;
+		}
+	};
+}
@@ -0,0 +1,496 @@
+/*
+* Benchmark statistics
+*
+* Sample statistics and result formatting shared by vks::Benchmark and the microbenchmarks.
+* Does not depend on Vulkan, so it builds without an SDK.
+*/
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <numeric>
+#include <ostream>
+#include <sstream>
+
+// Time histogram, bucket i holds samples from BENCHMARK_HISTOGRAM_BASE * 2^(i/2) ms up to the next bucket
+#define BENCHMARK_HISTOGRAM_BUCKETS 32
+#define BENCHMARK_HISTOGRAM_BASE 0.0625
+// A sample taking longer than this multiple of the median is counted as a hitch
+#define BENCHMARK_HITCH_FACTOR 2.0
+// A metric regresses when its median grew by more than this many percent and the samples differ with
+// a p value below BENCHMARK_COMPARE_ALPHA
+#define BENCHMARK_COMPARE_THRESHOLD 5.0
+#define BENCHMARK_COMPARE_ALPHA 0.01
+// Exit codes of a benchmark compared with a baseline
+#define BENCHMARK_EXIT_REGRESSION 1
+#define BENCHMARK_EXIT_ERROR 2
+
+namespace vks
+{
+	namespace stats
+	{
+		struct Statistics {
+			size_t count = 0;
+			double min = 0.0;
+			double max = 0.0;
+			double mean = 0.0;
+			double stddev = 0.0;
+			double p50 = 0.0;
+			double p90 = 0.0;
+			double p99 = 0.0;
+			double p999 = 0.0;
+			uint32_t hitches = 0;
+			std::vector<uint32_t> histogram;
+		};
+
+		// Linear interpolation between the closest ranks of a sorted sample
+		inline double percentile(const std::vector<double> &sorted, double p) {
+			if (sorted.empty()) {
+				return 0.0;
+			}
+			double rank = p * (double)(sorted.size() - 1);
+			size_t lower = (size_t)rank;
+			size_t upper = std::min(lower + 1, sorted.size() - 1);
+			return sorted[lower] + (sorted[upper] - sorted[lower]) * (rank - (double)lower);
+		}
+
+		inline double histogramLowerBound(size_t bucket) {
+			return BENCHMARK_HISTOGRAM_BASE * std::pow(2.0, (double)bucket * 0.5);
+		}
+
+		// Sample times in ms
+		inline Statistics compute(const std::vector<double> &times) {
+			Statistics stats;
+			stats.histogram.assign(BENCHMARK_HISTOGRAM_BUCKETS, 0);
+			if (times.empty()) {
+				return stats;
+			}
+
+			std::vector<double> sorted(times);
+			std::sort(sorted.begin(), sorted.end());
+
+			stats.count = sorted.size();
+			stats.min = sorted.front();
+			stats.max = sorted.back();
+			stats.mean = std::accumulate(sorted.begin(), sorted.end(), 0.0) / (double)sorted.size();
+
+			double variance = 0.0;
+			for (double t : sorted) {
+				variance += (t - stats.mean) * (t - stats.mean);
+			}
+			stats.stddev = (sorted.size() > 1) ? std::sqrt(variance / (double)(sorted.size() - 1)) : 0.0;
+
+			stats.p50 = percentile(sorted, 0.5);
+			stats.p90 = percentile(sorted, 0.9);
+			stats.p99 = percentile(sorted, 0.99);
+			stats.p999 = percentile(sorted, 0.999);
+
+			for (double t : sorted) {
+				if (t > stats.p50 * BENCHMARK_HITCH_FACTOR) {
+					stats.hitches++;
+				}
+				// Two buckets per octave, everything outside the range goes to the first or last bucket
+				int bucket = (t > BENCHMARK_HISTOGRAM_BASE) ? (int)(2.0 * std::log2(t / BENCHMARK_HISTOGRAM_BASE)) : 0;
+				bucket = std::min(std::max(bucket, 0), BENCHMARK_HISTOGRAM_BUCKETS - 1);
+				stats.histogram[bucket]++;
+			}
+
+			return stats;
+		}
+
+		inline std::string jsonString(const std::string &value) {
+			std::string s = "\"";
+			for (char c : value) {
+				switch (c) {
+				case '"': s += "\\\""; break;
+				case '\\': s += "\\\\"; break;
+				case '\n': s += "\\n"; break;
+				case '\r': s += "\\r"; break;
+				case '\t': s += "\\t"; break;
+				default:
+					if ((unsigned char)c < 0x20) {
+						char code[8];
+						snprintf(code, sizeof(code), "\\u%04x", c);
+						s += code;
+					}
+					else {
+						s += c;
+					}
+				}
+			}
+			return s + "\"";
+		}
+
+		inline std::string buildConfiguration() {
+#if defined(NDEBUG)
+			return "release";
+#else
+			return "debug";
+#endif
+		}
+
+		inline std::string compiler() {
+#if defined(_MSC_VER)
+			return "msvc " + std::to_string(_MSC_VER);
+#elif defined(__clang__)
+			return "clang " + std::to_string(__clang_major__) + "." + std::to_string(__clang_minor__);
+#elif defined(__GNUC__)
+			return "gcc " + std::to_string(__GNUC__) + "." + std::to_string(__GNUC_MINOR__);
+#else
+			return "unknown";
+#endif
+		}
+
+		struct MannWhitney {
+			double u = 0.0;
+			// Positive when the second sample tends to be larger
+			double z = 0.0;
+			// Two sided
+			double p = 1.0;
+		};
+
+		// Mann-Whitney U test of two samples, normal approximation with tie and continuity correction.
+		// Makes no assumption about the distribution, frame times are skewed and have long tails
+		inline MannWhitney mannWhitney(const std::vector<double> &a, const std::vector<double> &b) {
+			MannWhitney result;
+			const double na = (double)a.size();
+			const double nb = (double)b.size();
+			if (a.empty() || b.empty()) {
+				return result;
+			}
+
+			// Value and the sample it came from
+			std::vector<std::pair<double, bool>> pooled;
+			pooled.reserve(a.size() + b.size());
+			for (double t : a) {
+				pooled.push_back({ t, false });
+			}
+			for (double t : b) {
+				pooled.push_back({ t, true });
+			}
+			std::sort(pooled.begin(), pooled.end());
+
+			// Rank sum of b, ties get the average of their ranks
+			double rankSum = 0.0;
+			double tieTerm = 0.0;
+			for (size_t i = 0; i < pooled.size();) {
+				size_t j = i;
+				while ((j < pooled.size()) && (pooled[j].first == pooled[i].first)) {
+					j++;
+				}
+				double rank = 0.5 * (double)(i + 1 + j);
+				for (size_t k = i; k < j; k++) {
+					if (pooled[k].second) {
+						rankSum += rank;
+					}
+				}
+				double t = (double)(j - i);
+				tieTerm += t * t * t - t;
+				i = j;
+			}
+
+			const double n = na + nb;
+			result.u = rankSum - nb * (nb + 1.0) * 0.5;
+			double mean = na * nb * 0.5;
+			double variance = na * nb / 12.0 * ((n + 1.0) - tieTerm / (n * (n - 1.0)));
+			if (variance <= 0.0) {
+				return result;
+			}
+			double delta = result.u - mean;
+			delta -= (delta > 0.0) ? 0.5 : ((delta < 0.0) ? -0.5 : 0.0);
+			result.z = delta / std::sqrt(variance);
+			result.p = std::erfc(std::fabs(result.z) / std::sqrt(2.0));
+			return result;
+		}
+
+		// A metric of a run compared with the same metric of a baseline run, times in ms
+		struct Comparison {
+			std::string name;
+			double baseline = 0.0;
+			double current = 0.0;
+			// Relative change of the median in percent
+			double change = 0.0;
+			double p = 1.0;
+			bool regressed = false;
+			bool improved = false;
+		};
+
+		// Compares the medians, a change only counts if it is larger than threshold percent and minDelta ms
+		// and the test says the samples differ. Long runs make tiny differences significant, short noisy
+		// ones make large differences insignificant, both conditions are needed
+		inline Comparison compare(const std::string &name, const std::vector<double> &baseline, const std::vector<double> &current,
+			double threshold = BENCHMARK_COMPARE_THRESHOLD, double alpha = BENCHMARK_COMPARE_ALPHA, double minDelta = 0.0) {
+			Comparison result;
+			result.name = name;
+			result.baseline = compute(baseline).p50;
+			result.current = compute(current).p50;
+			result.change = (result.baseline > 0.0) ? 100.0 * (result.current - result.baseline) / result.baseline : 0.0;
+			result.p = mannWhitney(baseline, current).p;
+
+			bool significant = (result.p < alpha) && (std::fabs(result.current - result.baseline) > minDelta);
+			result.regressed = significant && (result.change > threshold);
+			result.improved = significant && (result.change < -threshold);
+			return result;
+		}
+
+		// Prints a table of the comparisons, returns the number of regressions
+		inline uint32_t printComparisons(std::ostream &os, const std::vector<Comparison> &comparisons) {
+			uint32_t regressions = 0;
+			os << std::fixed << std::left << std::setw(40) << "metric" << std::right << std::setw(12) << "baseline"
+				<< std::setw(12) << "current" << std::setw(11) << "change" << std::setw(10) << "p" << std::endl;
+			for (const Comparison &c : comparisons) {
+				std::ostringstream change;
+				change << std::fixed << std::setprecision(1) << std::showpos << c.change << " %";
+				std::ostringstream p;
+				if (c.p < 0.001) {
+					p << "<0.001";
+				}
+				else {
+					p << std::fixed << std::setprecision(3) << c.p;
+				}
+				os << std::left << std::setw(40) << c.name << std::right << std::setprecision(4)
+					<< std::setw(12) << c.baseline << std::setw(12) << c.current
+					<< std::setw(11) << change.str() << std::setw(10) << p.str();
+				if (c.regressed) {
+					os << "  REGRESSED";
+					regressions++;
+				}
+				else if (c.improved) {
+					os << "  improved";
+				}
+				os << std::endl;
+			}
+			return regressions;
+		}
+
+		// Value of a results file. Objects keep their keys in order, keys[i] names items[i]
+		struct JsonValue {
+			enum Type { Null, Bool, Number, String, Array, Object };
+			Type type = Null;
+			bool boolean = false;
+			double number = 0.0;
+			std::string string;
+			std::vector<std::string> keys;
+			std::vector<JsonValue> items;
+
+			// Member of an object, nullptr if missing
+			const JsonValue *find(const std::string &key) const {
+				for (size_t i = 0; i < keys.size(); i++) {
+					if (keys[i] == key) {
+						return &items[i];
+					}
+				}
+				return nullptr;
+			}
+
+			// Numbers of an array, other items are skipped
+			std::vector<double> numbers() const {
+				std::vector<double> values;
+				for (const JsonValue &item : items) {
+					if (item.type == Number) {
+						values.push_back(item.number);
+					}
+				}
+				return values;
+			}
+
+			// Numbers and booleans as they are written to the results, strings unquoted
+			std::string text() const {
+				switch (type) {
+				case Bool: return boolean ? "true" : "false";
+				case Number: { std::ostringstream os; os << number; return os.str(); }
+				case String: return string;
+				default: return "";
+				}
+			}
+		};
+
+		// Reader for the results files written by the benchmarks. Accepts standard JSON, \u escapes
+		// outside ASCII are replaced by '?'
+		class JsonReader {
+		private:
+			const char *pos;
+			const char *end;
+
+			void skipSpace() {
+				while ((pos < end) && ((*pos == ' ') || (*pos == '\t') || (*pos == '\n') || (*pos == '\r'))) {
+					pos++;
+				}
+			}
+
+			bool literal(const char *word) {
+				size_t length = strlen(word);
+				if (((size_t)(end - pos) < length) || (strncmp(pos, word, length) != 0)) {
+					return false;
+				}
+				pos += length;
+				return true;
+			}
+
+			bool parseString(std::string &s) {
+				if ((pos >= end) || (*pos != '"')) {
+					return false;
+				}
+				pos++;
+				while ((pos < end) && (*pos != '"')) {
+					char c = *pos++;
+					if (c != '\\') {
+						s += c;
+						continue;
+					}
+					if (pos >= end) {
+						return false;
+					}
+					c = *pos++;
+					switch (c) {
+					case 'n': s += '\n'; break;
+					case 'r': s += '\r'; break;
+					case 't': s += '\t'; break;
+					case 'b': s += '\b'; break;
+					case 'f': s += '\f'; break;
+					case 'u': {
+						if (end - pos < 4) {
+							return false;
+						}
+						unsigned long code = strtoul(std::string(pos, 4).c_str(), nullptr, 16);
+						s += (code < 0x80) ? (char)code : '?';
+						pos += 4;
+						break;
+					}
+					default: s += c; break;
+					}
+				}
+				if (pos >= end) {
+					return false;
+				}
+				pos++;
+				return true;
+			}
+
+			bool parseValue(JsonValue &value, uint32_t depth) {
+				skipSpace();
+				if ((pos >= end) || (depth > 64)) {
+					return false;
+				}
+				if (*pos == '{') {
+					value.type = JsonValue::Object;
+					pos++;
+					skipSpace();
+					if ((pos < end) && (*pos == '}')) {
+						pos++;
+						return true;
+					}
+					while (true) {
+						std::string key;
+						skipSpace();
+						if (!parseString(key)) {
+							return false;
+						}
+						skipSpace();
+						if ((pos >= end) || (*pos++ != ':')) {
+							return false;
+						}
+						value.keys.push_back(key);
+						value.items.push_back(JsonValue());
+						if (!parseValue(value.items.back(), depth + 1)) {
+							return false;
+						}
+						skipSpace();
+						if (pos >= end) {
+							return false;
+						}
+						char c = *pos++;
+						if (c == '}') {
+							return true;
+						}
+						if (c != ',') {
+							return false;
+						}
+					}
+				}
+				if (*pos == '[') {
+					value.type = JsonValue::Array;
+					pos++;
+					skipSpace();
+					if ((pos < end) && (*pos == ']')) {
+						pos++;
+						return true;
+					}
+					while (true) {
+						value.items.push_back(JsonValue());
+						if (!parseValue(value.items.back(), depth + 1)) {
+							return false;
+						}
+						skipSpace();
+						if (pos >= end) {
+							return false;
+						}
+						char c = *pos++;
+						if (c == ']') {
+							return true;
+						}
+						if (c != ',') {
+							return false;
+						}
+					}
+				}
+				if (*pos == '"') {
+					value.type = JsonValue::String;
+					return parseString(value.string);
+				}
+				if (literal("true")) {
+					value.type = JsonValue::Bool;
+					value.boolean = true;
+					return true;
+				}
+				if (literal("false")) {
+					value.type = JsonValue::Bool;
+					return true;
+				}
+				if (literal("null")) {
+					return true;
+				}
+				char *numberEnd = nullptr;
+				std::string number(pos, std::min<size_t>(end - pos, 64));
+				value.number = strtod(number.c_str(), &numberEnd);
+				if (numberEnd == number.c_str()) {
+					return false;
+				}
+				value.type = JsonValue::Number;
+				pos += numberEnd - number.c_str();
+				return true;
+			}
+
+		public:
+			bool parse(const std::string &text, JsonValue &value) {
+				pos = text.data();
+				end = text.data() + text.size();
+				value = JsonValue();
+				if (!parseValue(value, 0)) {
+					return false;
+				}
+				skipSpace();
+				return pos == end;
+			}
+		};
+
+		inline bool loadJson(const std::string &filename, JsonValue &value) {
+			std::ifstream is(filename, std::ios::in | std::ios::binary);
+			if (!is.is_open()) {
+				return false;
+			}
+			std::stringstream buffer;
+			buffer << is.rdbuf();
+			return JsonReader().parse(buffer.str(), value);
+		}
+	}
+}
@@ -0,0 +1,38 @@
+#version 450
+
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+
+layout (location = 0) in vec3 inPos;
+layout (location = 1) in vec4 inColor;
+
+// compact_instance_data: position steps from the tile origin at the tile time, velocity in units per second
+layout (location = 2) in vec2 instancePos;
+layout (location = 3) in vec2 instanceVel;
+
+layout (binding = 0) uniform UBO 
+{
+	mat4 projectionMatrix;
+	mat4 modelMatrix;
+	mat4 viewMatrix;
+	vec4 colorParams;
+	vec4 frustumPlanes[6];
+	vec4 tileParams;
+} ubo;
+
+layout (location = 0) out vec4 outColor;
+
+out gl_PerVertex 
+{
+    vec4 gl_Position;   
+};
+
+
+void main()  
+{
+	vec2 velocity = 0.001 * instanceVel;
+	vec2 position = ubo.tileParams.xy + ubo.tileParams.z * instancePos + ubo.tileParams.w * velocity;
+
+	outColor = inColor + vec4(velocity.x, 0 , 0, 0);
+	gl_Position = ubo.projectionMatrix * ubo.viewMatrix * vec4(inPos.x + position.x, inPos.y + position.y, inPos.z, 1.0);
+}
@@ -47,12 +47,16 @@ VkResult VulkanExampleBase::createInstance(bool enableValidation)
 	appInfo.pEngineName = _name.c_str();
 	appInfo.apiVersion = _apiVersion;
 
-	std::vector<const char*> instanceExtensions = { VK_KHR_SURFACE_EXTENSION_NAME };
+	std::vector<const char*> instanceExtensions;
 
-	// Enable surface extensions depending on os
+	// Enable surface extensions depending on os, headless runs never create a surface
+	if (!_settings.headless)
+	{
+		instanceExtensions.push_back(VK_KHR_SURFACE_EXTENSION_NAME);
 #if defined(_WIN32)
-	instanceExtensions.push_back(VK_KHR_WIN32_SURFACE_EXTENSION_NAME);
+		instanceExtensions.push_back(VK_KHR_WIN32_SURFACE_EXTENSION_NAME);
 #endif
+	}
 
 	if (_enabledInstanceExtensions.size() > 0) {
 		for (auto enabledExtension : _enabledInstanceExtensions) {
@@ -60,16 +64,22 @@ VkResult VulkanExampleBase::createInstance(bool enableValidation)
 		}
 	}
 
+	// Heap budgets are queried through vkGetPhysicalDeviceMemoryProperties2KHR
+	_memoryBudget = vks::memory::instanceExtensionSupported(vks::memory::instanceExtension);
+	if (_memoryBudget) {
+		instanceExtensions.push_back(vks::memory::instanceExtension);
+	}
+
 	VkInstanceCreateInfo instanceCreateInfo = {};
 	instanceCreateInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
 	instanceCreateInfo.pNext = NULL;
 	instanceCreateInfo.pApplicationInfo = &appInfo;
+	if (_settings.validation)
+	{
+		instanceExtensions.push_back(VK_EXT_DEBUG_REPORT_EXTENSION_NAME);
+	}
 	if (instanceExtensions.size() > 0)
 	{
-		if (_settings.validation)
-		{
-			instanceExtensions.push_back(VK_EXT_DEBUG_REPORT_EXTENSION_NAME);
-		}
 		instanceCreateInfo.enabledExtensionCount = (uint32_t)instanceExtensions.size();
 		instanceCreateInfo.ppEnabledExtensionNames = instanceExtensions.data();
 	}
@@ -251,13 +261,13 @@ void VulkanExampleBase::transitionImageLayout(VkImage image, VkFormat format, Vk
 }
 
 
-void VulkanExampleBase::createTextureImage() {
-	int texWidth, texHeight, texChannels;
+// Decodes the arena texture to RGBA, touches no Vulkan state
+unsigned char* VulkanExampleBase::loadTexturePixels(int& texWidth, int& texHeight) {
+	int texChannels;
 
 	std::string s = getAssetPath() + "textures/texture.jpg";
 
 	stbi_uc* pixels = stbi_load(s.c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
-	VkDeviceSize imageSize = uint64_t(texWidth) * uint64_t(texHeight) * 4;
 
 	if (pixels) {
 		;
@@ -266,25 +276,12 @@ void VulkanExampleBase::createTextureImage() {
 		throw std::runtime_error("failed to load texture image");
 	}
 
-	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingBufferMemory;
-
-	VkResult r = _vulkanDevice->createBuffer(
-		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		imageSize,
-		&stagingBuffer,
-		&stagingBufferMemory);
-
-	VK_CHECK_RESULT(r);
-
-	void* data;
-	vkMapMemory(_device, stagingBufferMemory, 0, imageSize, 0, &data);
-	memcpy(data, pixels, static_cast<size_t>(imageSize));
-	vkUnmapMemory(_device, stagingBufferMemory);
-
-	stbi_image_free(pixels);
+	return pixels;
+}
 
+// Takes ownership of pixels from loadTexturePixels
+void VulkanExampleBase::createTextureImage(unsigned char* pixels, int texWidth, int texHeight) {
+	VkDeviceSize imageSize = uint64_t(texWidth) * uint64_t(texHeight) * 4;
 
 	VkImageCreateInfo imageInfo{};
 
@@ -321,20 +318,31 @@ void VulkanExampleBase::createTextureImage() {
 	allocInfo.allocationSize = memRequirements.size;
 	allocInfo.memoryTypeIndex = getMemoryTypeIndex(memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
-	if (vkAllocateMemory(_device, &allocInfo, nullptr, &_textureImageMemory) != VK_SUCCESS) {
+	if (vks::memory::allocateMemory(_device, &allocInfo, &_textureImageMemory) != VK_SUCCESS) {
 		throw std::runtime_error("failed to allocate image memory!");
 	}
 
 	vkBindImageMemory(_device, _textureImage, _textureImageMemory, 0);
 
+	// The pixels are copied to staging memory right away, the transfer itself is batched
+	uploadService->uploadImage(
+		_textureImage,
+		static_cast<uint32_t>(texWidth),
+		static_cast<uint32_t>(texHeight),
+		pixels,
+		imageSize,
+		VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+		VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+		VK_ACCESS_SHADER_READ_BIT);
 
+	stbi_image_free(pixels);
 }
 
 
 void VulkanExampleBase::createCommandBuffers()
 {
 	// Create one command buffer for each swap chain image and reuse for rendering
-	_drawCmdBuffers.resize(_swapChain.imageCount);
+	_drawCmdBuffers.resize(_imageCount);
 
 	VkCommandBufferAllocateInfo cmdBufAllocateInfo =
 		vks::initializers::commandBufferAllocateInfo(
@@ -372,54 +380,284 @@ VkCommandBuffer VulkanExampleBase::createCommandBuffer(VkCommandBufferLevel leve
 	return cmdBuffer;
 }
 
+// Layout of the header the driver puts in front of the cache data (VK_PIPELINE_CACHE_HEADER_VERSION_ONE)
+struct pipeline_cache_header {
+	uint32_t headerSize;
+	uint32_t headerVersion;
+	uint32_t vendorID;
+	uint32_t deviceID;
+	uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+};
+
+// True when the data was written by the driver and device in use. Drivers should ignore foreign data,
+// not all of them do, so it is checked before being handed over
+bool VulkanExampleBase::validPipelineCache(const std::vector<uint8_t>& data)
+{
+	pipeline_cache_header header;
+
+	if (data.size() < sizeof(header))
+	{
+		return false;
+	}
+
+	memcpy(&header, data.data(), sizeof(header));
+
+	return (header.headerSize >= sizeof(header)) &&
+		(header.headerSize <= data.size()) &&
+		(header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE) &&
+		(header.vendorID == _deviceProperties.vendorID) &&
+		(header.deviceID == _deviceProperties.deviceID) &&
+		(memcmp(header.pipelineCacheUUID, _deviceProperties.pipelineCacheUUID, VK_UUID_SIZE) == 0);
+}
+
 void VulkanExampleBase::createPipelineCache()
 {
+	// Pipelines compiled by an earlier run are reused
+	std::ifstream file(PIPELINE_CACHE_FILE, std::ios::binary);
+
+	if (file.is_open())
+	{
+		_pipelineCacheData.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+
+		if (!validPipelineCache(_pipelineCacheData))
+		{
+			std::cerr << "Ignoring " << PIPELINE_CACHE_FILE << ", it was written for another device or driver" << std::endl;
+			_pipelineCacheData.clear();
+		}
+	}
+
 	VkPipelineCacheCreateInfo pipelineCacheCreateInfo = {};
 	pipelineCacheCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	pipelineCacheCreateInfo.initialDataSize = _pipelineCacheData.size();
+	pipelineCacheCreateInfo.pInitialData = _pipelineCacheData.data();
 	VK_CHECK_RESULT(vkCreatePipelineCache(_device, &pipelineCacheCreateInfo, nullptr, &_pipelineCache));
 }
 
+// The data goes to a temporary file that then replaces PIPELINE_CACHE_FILE, so an interrupted write
+// leaves the previous cache intact. Failing to save only costs the next startup, it is not fatal
+void VulkanExampleBase::savePipelineCache()
+{
+	size_t size = 0;
+	VK_CHECK_RESULT(vkGetPipelineCacheData(_device, _pipelineCache, &size, nullptr));
+
+	std::vector<uint8_t> data(size);
+	VK_CHECK_RESULT(vkGetPipelineCacheData(_device, _pipelineCache, &size, data.data()));
+	data.resize(size);
+
+	if (data == _pipelineCacheData)
+	{
+		return;
+	}
+
+	const std::string tmpFile = std::string(PIPELINE_CACHE_FILE) + ".tmp";
+
+	std::ofstream file(tmpFile, std::ios::binary | std::ios::trunc);
+	file.write(reinterpret_cast<const char*>(data.data()), std::streamsize(data.size()));
+	file.close();
+
+	if (file.fail())
+	{
+		std::cerr << "Could not write " << tmpFile << std::endl;
+		std::remove(tmpFile.c_str());
+		return;
+	}
+
+#if defined(_WIN32)
+	// rename() does not replace an existing file on Windows
+	bool replaced = MoveFileExA(tmpFile.c_str(), PIPELINE_CACHE_FILE, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+	bool replaced = std::rename(tmpFile.c_str(), PIPELINE_CACHE_FILE) == 0;
+#endif
+
+	if (!replaced)
+	{
+		std::cerr << "Could not replace " << PIPELINE_CACHE_FILE << std::endl;
+		std::remove(tmpFile.c_str());
+		return;
+	}
+
+	_pipelineCacheData.swap(data);
+}
+
+// The swap chain, command pool and upload service are set up in order, the remaining steps run as a
+// StartupGraph. Steps that record into the upload service or the main command pool are main thread steps,
+// geometry generation, texture decoding, shader loading and pipeline compilation go to the thread pool
 void VulkanExampleBase::prepare()
 {
 	if (_vulkanDevice->enableDebugMarkers) {
 		vks::debugmarker::setup(_device);
 	}
-	initSwapchain();
+	if (!_settings.headless) {
+		initSwapchain();
+	}
 	createCommandPool();
-	setupSwapChain();
+	uploadService = new UploadService(_vulkanDevice, _queue, _transferQueue);
+	if (_settings.headless) {
+		MemoryScope scope(MEMORY_FRAMEBUFFERS);
+		setupOffscreen();
+	} else {
+		setupSwapChain();
+	}
 	createCommandBuffers();
-	createTextureImage();
 
-    staticSetupDepthStencil(_device, _depthFormat, _width, _height, _depthStencil, _vulkanDevice);
-    staticSetupRenderPass(_device, _swapChain, _depthFormat, _renderPass);
-	createPipelineCache();
-	setupFrameBuffer();
+	frameArena = new FrameArena(_settings.framesInFlight, FRAMEARENA_SLOT_BYTES);
+
 	_settings.overlay = _settings.overlay && (!_benchmark.active);
+	// Culling on the GPU replaces the CPU cull
+	_settings.cull = _settings.cull && (!_settings.gpucull);
+	// The compute passes and the cpu cull all read or write float records
+	_settings.compact = _settings.compact && (!_settings.gpusim) && (!_settings.cull) && (!_settings.gpucull);
+	// The gpu simulation owns the robot state after startup
+	_settings.morton = _settings.morton && (!_settings.gpusim);
+	// Shared by the startup steps, the robot park reorder and command buffer recording
+	_threadPool.setThreadCount((_settings.threads > 0) ? _settings.threads : std::max(1u, std::thread::hardware_concurrency()));
+	if (_settings.morton) {
+		robotPark->reorder(_threadPool);
+		_reorderTime = sessionTime->getTimeMS();
+	}
+
+	typedef StartupGraph::task_id task_id;
+	const bool mainThread = true;
+
+	StartupGraph graph;
+
+	// Filled by worker steps, consumed by the main thread steps that upload them
+	std::vector<arena_vertex> lcVertex;
+	std::vector<uint32_t> lcIndex;
+	unsigned char* texturePixels = nullptr;
+	int textureWidth = 0;
+	int textureHeight = 0;
+
+	task_id textureDecode = graph.add("texture decode", [&] {
+		texturePixels = loadTexturePixels(textureWidth, textureHeight);
+	});
+	task_id texture = graph.add("texture upload", [&] {
+		MemoryScope scope(MEMORY_TEXTURES);
+		createTextureImage(texturePixels, textureWidth, textureHeight);
+	}, { textureDecode }, mainThread);
+
+	task_id depth = graph.add("depth buffer", [this] {
+		MemoryScope scope(MEMORY_FRAMEBUFFERS);
+		staticSetupDepthStencil(_device, _depthFormat, _width, _height, _depthStencil, _vulkanDevice);
+	});
+	task_id renderPass = graph.add("render pass", [this] {
+		// Offscreen images are left ready for a readback instead of the presentation engine
+		VkImageLayout colorFinalLayout = _settings.headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+		staticSetupRenderPass(_device, _colorFormat, colorFinalLayout, _depthFormat, _renderPass);
+	});
+	task_id pipelineCache = graph.add("pipeline cache", [this] {
+		createPipelineCache();
+	});
+	task_id frameBuffers = graph.add("frame buffers", [this] {
+		setupFrameBuffer();
+	}, { depth, renderPass });
+	task_id sync = graph.add("synchronization", [this] {
+		prepareSynchronizationPrimitives();
+	});
+
+	task_id uiOverlay = StartupGraph::none;
 	if (_settings.overlay) {
-		_UIOverlay.device = _vulkanDevice;
-		_UIOverlay.queue = _queue;
-		_UIOverlay.shaders = {
-			loadShader(getAssetPath() + "shaders/base/uioverlay.vert.spv", VK_SHADER_STAGE_VERTEX_BIT),
-			loadShader(getAssetPath() + "shaders/base/uioverlay.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT),
-		};
-		_UIOverlay.prepareResources();
-		_UIOverlay.preparePipeline(_pipelineCache, _renderPass);
-	}
-	prepareSynchronizationPrimitives();
-	arena_prepareVertices();
-	prepare_instanced_buffer();
-	arena_prepareUniformBuffers();
-	arena_setupDescriptorSetLayout();
-
-	// Renderpass this pipeline is attached to
-	// The layout used for this pipeline (can be shared among multiple pipelines using the same layout)
-	arena_pl = arena_createPipeline(_renderPass, arena_pipelineLayout);
-	setupDescriptorPool();
-	arena_setupDescriptorSet();
-	buildCommandBuffers();
-	prepareTextOverlay();
-	_prepared = true;
+		uiOverlay = graph.add("ui overlay", [this] {
+			MemoryScope scope(MEMORY_UI);
+			_UIOverlay.device = _vulkanDevice;
+			_UIOverlay.queue = _queue;
+			_UIOverlay.shaders = {
+				loadShader(getAssetPath() + "shaders/base/uioverlay.vert.spv", VK_SHADER_STAGE_VERTEX_BIT),
+				loadShader(getAssetPath() + "shaders/base/uioverlay.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT),
+			};
+			_UIOverlay.prepareResources();
+			_UIOverlay.preparePipeline(_pipelineCache, _renderPass);
+		}, { renderPass, pipelineCache }, mainThread);
+	}
+
+	task_id geometry = graph.add("arena geometry", [&] {
+		arena_generateGeometry(lcVertex, lcIndex);
+	});
+	task_id vertices = graph.add("arena vertices", [&] {
+		MemoryScope scope(MEMORY_ARENA);
+		arena_prepareVertices(lcVertex, lcIndex);
+	}, { geometry }, mainThread);
+
+	task_id instances = StartupGraph::none;
+	task_id indirect = StartupGraph::none;
+	if (!_settings.gpusim) {
+		instances = graph.add("instance buffer", [this] {
+			MemoryScope scope(MEMORY_INSTANCES);
+			prepare_instanced_buffer();
+		});
+		if (_settings.cull) {
+			indirect = graph.add("indirect buffer", [this] {
+				MemoryScope scope(MEMORY_INSTANCES);
+				prepare_indirect_buffer();
+			}, { vertices });
+		}
+	}
+	// The compact tile is taken by the instance buffer, writing the slices may rebase it
+	task_id uniforms = graph.add("uniform buffers", [this] {
+		MemoryScope scope(MEMORY_ARENA);
+		arena_prepareUniformBuffers();
+	}, { instances });
+
+	task_id robotSim = StartupGraph::none;
+	if (_settings.gpusim) {
+		robotSim = graph.add("robot simulation", [this] {
+			MemoryScope scope(MEMORY_ROBOTS);
+			prepareRobotSimCompute();
+		}, { uniforms, pipelineCache }, mainThread);
+	}
+	task_id cullCompute = StartupGraph::none;
+	if (_settings.gpucull) {
+		cullCompute = graph.add("cull compute", [this] {
+			MemoryScope scope(MEMORY_INSTANCES);
+			prepareInstanceCullCompute();
+		}, { vertices, instances, uniforms, robotSim, pipelineCache });
+	}
+
+	task_id layout = graph.add("descriptor layout", [this] {
+		arena_setupDescriptorSetLayout();
+	});
+	task_id pipeline = graph.add("arena pipeline", [this] {
+		arena_pl = arena_createPipeline(_renderPass, arena_pipelineLayout);
+	}, { layout, renderPass, pipelineCache });
+	task_id pool = graph.add("descriptor pool", [this] {
+		setupDescriptorPool();
+	});
+	task_id descriptors = graph.add("descriptor set", [this] {
+		arena_setupDescriptorSet();
+	}, { pool, layout, uniforms });
+
+	// The text draw is recorded into the arena command buffers
+	task_id text = graph.add("text overlay", [this] {
+		MemoryScope scope(MEMORY_OVERLAY);
+		prepareTextOverlay();
+	}, { renderPass, pipelineCache }, mainThread);
+
+	task_id recording = graph.add("recording threads", [this] {
+		prepareRecordingThreads();
+	}, { instances, indirect, cullCompute });
+
+	task_id timestamps = graph.add("gpu timer", [this] {
+		if (GpuTimer::supported(_vulkanDevice)) {
+			gpuTimer = new GpuTimer(_vulkanDevice, _imageCount);
+		}
+	});
+
+	// Records on the thread pool itself, so it runs last on the calling thread
+	graph.add("command buffers", [this] {
+		buildCommandBuffers();
+	}, { frameBuffers, sync, uiOverlay, vertices, indirect, robotSim, cullCompute, pipeline, descriptors, text, recording, texture, timestamps }, mainThread);
 
+	graph.run(_threadPool);
+
+	if (_settings.startupReport) {
+		graph.report(std::cout);
+	}
+
+	// Nothing above consumes the uploads, the first frame's submit is ordered behind them
+	uploadService->submit();
+	// Every pipeline exists now, the next start can skip their compilation
+	savePipelineCache();
+	_prepared = true;
 }
 
 VkPipelineShaderStageCreateInfo VulkanExampleBase::loadShader(std::string fileName, VkShaderStageFlagBits stage)
@@ -431,29 +669,39 @@ VkPipelineShaderStageCreateInfo VulkanExampleBase::loadShader(std::string fileNa
 	shaderStage.module = vks::tools::loadShader(fileName.c_str(), _device);
 	shaderStage.pName = "main"; // todo : make param
 	assert(shaderStage.module != VK_NULL_HANDLE);
+	// Startup steps load their shaders on different threads
+	std::lock_guard<std::mutex> lock(_shaderModuleMutex);
 	_shaderModules.push_back(shaderStage.module);
 	return shaderStage;
 }
 
 void VulkanExampleBase::renderFrame()
 {
+	TraceZone zone("renderFrame");
+
 	auto tStart = std::chrono::high_resolution_clock::now();
 	if (_viewUpdated)
 	{
 		_viewUpdated = false;
 		viewChanged();
 	}
-	viewChanged();
+	_benchmark.stage(FRAME_STAGE_CAMERA);
 	render();
 	_frameCounter++;
 	auto tEnd = std::chrono::high_resolution_clock::now();
 	auto tDiff = std::chrono::duration<double, std::milli>(tEnd - tStart).count();
 	_frameTimer = (float)tDiff / 1000.0f;
+	// Outside the measured time, a dump does not make the next frame a hitch
+	if (flightRecorder != nullptr)
+	{
+		flightRecorder->frame(tDiff);
+	}
 	_camera.update(_frameTimer);
 	if (_camera.moving())
 	{
 		_viewUpdated = true;
 	}
+	_benchmark.stage(FRAME_STAGE_CAMERA);
 	// Convert to clamped timer value
 	if (!_paused)
 	{
@@ -468,28 +716,83 @@ void VulkanExampleBase::renderFrame()
 	{
 		_lastFPS = static_cast<uint32_t>((float)_frameCounter * (1000.0f / _fpsTimer));
 
-		if (!_settings.overlay)	{
+		// The overlay shows the frame time sampled here, so its text only changes once a second
+		_statsFrameTimer = _frameTimer;
+		if (gpuTimer != nullptr) {
+			std::copy(gpuTimer->_ms, gpuTimer->_ms + GPU_PASS_COUNT, _statsGpuMs);
+		}
+		_version.stats = ++_versionClock;
+
+#if defined(_WIN32)
+		if ((!_settings.overlay) && (!_settings.headless))	{
 			std::string windowTitle = getWindowTitle();
 			SetWindowText(_window, windowTitle.c_str());
 		}
+#endif
 		_fpsTimer = 0.0f;
 		_frameCounter = 0;
 	}
 	// TODO: Cap UI overlay update rates
 	updateOverlay();
+	_benchmark.stage(FRAME_STAGE_OVERLAY);
 }
 
 void VulkanExampleBase::renderLoop()
 {
 	if (_benchmark.active) {
-		_benchmark.run([=] { render(); }, _vulkanDevice->properties);
+		_benchmark.config = {
+			{ "width", std::to_string(_width) },
+			{ "height", std::to_string(_height) },
+			{ "robots", std::to_string(robotPark->instances()) },
+			{ "threads", std::to_string(_threadPool.threads.size()) },
+			{ "framesInFlight", std::to_string(_settings.framesInFlight) },
+			{ "vsync", _settings.vsync ? "true" : "false" },
+			{ "headless", _settings.headless ? "true" : "false" },
+			{ "overlay", _settings.overlay ? "true" : "false" },
+			{ "text", _settings.text ? "true" : "false" },
+			{ "gpusim", _settings.gpusim ? "true" : "false" },
+			{ "cull", _settings.cull ? "true" : "false" },
+			{ "gpucull", _settings.gpucull ? "true" : "false" },
+			{ "compact", _settings.compact ? "true" : "false" },
+			{ "morton", _settings.morton ? "true" : "false" }
+		};
+		_benchmark.config.push_back({ "fullFrame", _benchmark.fullFrame ? "true" : "false" });
+		_benchmark.config.push_back({ "memoryBudget", _memoryBudget ? "true" : "false" });
+		_benchmark.stageNames = { "camera", "sim", "present wait", "instances", "upload", "overlay", "submit" };
+		if (gpuTimer != nullptr) {
+			// Indexed by gpu_pass
+			_benchmark.gpuPassNames = { "compute", "robots", "text", "total" };
+		}
+
+		// Allocation rates are taken over the measured frames only
+		std::vector<memory_counters> lcMemory;
+		_benchmark.measureStart = [&] {
+			lcMemory = MemoryAccounting::snapshot();
+		};
+
+		// The full frame also measures the view change, camera update and overlay
+		if (_benchmark.fullFrame) {
+			_benchmark.run([=] { renderFrame(); }, _vulkanDevice->properties);
+		}
+		else {
+			_benchmark.run([=] { render(); }, _vulkanDevice->properties);
+		}
 		vkDeviceWaitIdle(_device);
+		setBenchmarkMemory(lcMemory, _benchmark.runtime / 1000.0);
+		if (_settings.memoryReport) {
+			printMemoryReport(lcMemory, _benchmark.runtime / 1000.0);
+		}
+		// Before the results are saved, saving detaches the console
+		if (_benchmark.baseline != "") {
+			_benchmark.compareBaseline();
+		}
 		if (_benchmark.filename != "") {
 			_benchmark.saveResults();
 		}
 		return;
 	}
 
+#if defined(_WIN32)
 	_destWidth = _width;
 	_destHeight = _height;
 
@@ -508,6 +811,7 @@ void VulkanExampleBase::renderLoop()
 			renderFrame();
 		}
 	}
+#endif
 
 	// Flush device to make sure all resources can be freed
 	if (_device != VK_NULL_HANDLE) {
@@ -515,6 +819,63 @@ void VulkanExampleBase::renderLoop()
 	}
 }
 
+void VulkanExampleBase::printMemoryReport(const std::vector<memory_counters>& previous, double seconds)
+{
+	MemoryAccounting::report(std::cout, previous, seconds);
+
+	std::vector<vks::memory::heap_budget> lcHeap = vks::memory::getBudget();
+	std::cout << std::left << std::setw(20) << (_memoryBudget ? "heap (driver)" : "heap (tracked)") << std::right
+		<< std::setw(14) << "usage (MB)" << std::setw(12) << "budget (MB)" << std::setw(10) << "size (MB)" << std::endl;
+	for (size_t i = 0; i < lcHeap.size(); i++) {
+		const vks::memory::heap_budget& h = lcHeap[i];
+		std::cout << std::left << std::setw(20) << ("heap " + std::to_string(i) + (h.deviceLocal ? " local" : "")) << std::right
+			<< std::fixed << std::setprecision(2)
+			<< std::setw(14) << double(h.usage) / (1024.0 * 1024.0)
+			<< std::setw(12) << double(h.budget) / (1024.0 * 1024.0)
+			<< std::setw(10) << std::setprecision(0) << double(h.size) / (1024.0 * 1024.0) << std::endl;
+	}
+
+	if (frameArena != nullptr) {
+		std::cout << "frame arena: " << std::setprecision(2) << double(frameArena->highWater()) / 1024.0 << " KB of " << double(frameArena->slotBytes()) / 1024.0
+			<< " KB per slot used at most, " << frameArena->overflows() << " overflows" << std::endl;
+	}
+}
+
+void VulkanExampleBase::setBenchmarkMemory(const std::vector<memory_counters>& previous, double seconds)
+{
+	std::vector<memory_counters> lcNow = MemoryAccounting::snapshot();
+	double perSecond = (seconds > 0.0) ? 1.0 / seconds : 0.0;
+
+	_benchmark.memory.clear();
+	for (uint32_t d = 0; d < MEMORY_DOMAIN_COUNT; d++) {
+		for (uint32_t s = 0; s < MEMORY_SUBSYSTEM_COUNT; s++) {
+			size_t i = d * MEMORY_SUBSYSTEM_COUNT + s;
+			const memory_counters& c = lcNow[i];
+			if (c.allocations == 0) {
+				continue;
+			}
+			vks::Benchmark::MemoryUse m;
+			m.name = std::string(MemoryAccounting::name(memory_domain(d))) + " " + MemoryAccounting::name(memory_subsystem(s));
+			m.current = c.current;
+			m.peak = c.peak;
+			m.allocationsPerSecond = double(c.allocations - ((i < previous.size()) ? previous[i].allocations : 0)) * perSecond;
+			m.bytesPerSecond = double(c.allocatedBytes - ((i < previous.size()) ? previous[i].allocatedBytes : 0)) * perSecond;
+			_benchmark.memory.push_back(m);
+		}
+	}
+
+	_benchmark.heaps.clear();
+	std::vector<vks::memory::heap_budget> lcHeap = vks::memory::getBudget();
+	for (size_t i = 0; i < lcHeap.size(); i++) {
+		vks::Benchmark::HeapUse h;
+		h.name = "heap " + std::to_string(i) + (lcHeap[i].deviceLocal ? " local" : "");
+		h.size = lcHeap[i].size;
+		h.usage = lcHeap[i].usage;
+		h.budget = lcHeap[i].budget;
+		_benchmark.heaps.push_back(h);
+	}
+}
+
 void VulkanExampleBase::updateOverlay()
 {
 	if (!_settings.overlay)
@@ -548,6 +909,8 @@ void VulkanExampleBase::updateOverlay()
 	ImGui::Render();
 
 	if (_UIOverlay.update() || _UIOverlay.updated) {
+		// The command buffers are rerecorded in place, frames still in flight may be executing them
+		vkDeviceWaitIdle(_device);
 		buildCommandBuffers();
 		_UIOverlay.updated = false;
 	}
@@ -586,6 +949,7 @@ VulkanExampleBase::VulkanExampleBase(bool enableValidation)
 	_settings.validation = enableValidation;
 
 	char* numConvPtr;
+	bool hitchGiven = false;
 
 	// Parse command line arguments
 	for (size_t i = 0; i < _args.size(); i++)
@@ -596,6 +960,86 @@ VulkanExampleBase::VulkanExampleBase(bool enableValidation)
 		if (_args[i] == std::string("-vsync")) {
 			_settings.vsync = true;
 		}
+		if (_args[i] == std::string("-gpusim")) {
+			_settings.gpusim = true;
+		}
+		if (_args[i] == std::string("-cull")) {
+			_settings.cull = true;
+		}
+		if (_args[i] == std::string("-gpucull")) {
+			_settings.gpucull = true;
+		}
+		if (_args[i] == std::string("-compact")) {
+			_settings.compact = true;
+		}
+		if (_args[i] == std::string("-morton")) {
+			_settings.morton = true;
+		}
+		if (_args[i] == std::string("-headless")) {
+			_settings.headless = true;
+		}
+		if (_args[i] == std::string("-startupreport")) {
+			_settings.startupReport = true;
+		}
+		if (_args[i] == std::string("-memreport")) {
+			_settings.memoryReport = true;
+		}
+		if (_args[i] == std::string("-allocs")) {
+			_settings.countAllocations = true;
+		}
+		if (_args[i] == std::string("-allocassert")) {
+			_settings.countAllocations = true;
+			_settings.allocationAssert = true;
+		}
+		if (_args[i] == std::string("-robots")) {
+			if (_args.size() > i + 1) {
+				uint32_t num = strtol(_args[i + 1], &numConvPtr, 10);
+				if (numConvPtr != _args[i + 1]) {
+					_settings.robots = std::max(num, 1u);
+				} else {
+					std::cerr << "Number of robots must be specified as a number!" << std::endl;
+				}
+			}
+		}
+		if (_args[i] == std::string("-threads")) {
+			if (_args.size() > i + 1) {
+				uint32_t num = strtol(_args[i + 1], &numConvPtr, 10);
+				if (numConvPtr != _args[i + 1]) {
+					_settings.threads = num;
+				} else {
+					std::cerr << "Number of threads must be specified as a number!" << std::endl;
+				}
+			}
+		}
+		if (_args[i] == std::string("-notext")) {
+			_settings.text = false;
+		}
+		if (_args[i] == std::string("-trace")) {
+			if (_args.size() > i + 1) {
+				_settings.traceFile = _args[i + 1];
+			}
+		}
+		if (_args[i] == std::string("-hitch")) {
+			if (_args.size() > i + 1) {
+				float ms = strtof(_args[i + 1], &numConvPtr);
+				if (numConvPtr != _args[i + 1]) {
+					_settings.hitchMs = ms;
+					hitchGiven = true;
+				} else {
+					std::cerr << "Hitch threshold must be specified as a number of ms!" << std::endl;
+				}
+			}
+		}
+		if (_args[i] == std::string("-frames")) {
+			if (_args.size() > i + 1) {
+				uint32_t num = strtol(_args[i + 1], &numConvPtr, 10);
+				if (numConvPtr != _args[i + 1]) {
+					_settings.framesInFlight = std::min(std::max(num, 1u), 3u);
+				} else {
+					std::cerr << "Number of frames in flight must be specified as a number!" << std::endl;
+				}
+			}
+		}
 		if ((_args[i] == std::string("-f")) || (_args[i] == std::string("--fullscreen"))) {
 			_settings.fullscreen = true;
 		}
@@ -649,8 +1093,57 @@ VulkanExampleBase::VulkanExampleBase(bool enableValidation)
 		if ((_args[i] == std::string("-bt")) || (_args[i] == std::string("--benchframetimes"))) {
 			_benchmark.outputFrameTimes = true;
 		}
+		// Benchmark the complete frame including view, camera and overlay updates
+		if ((_args[i] == std::string("-bfull")) || (_args[i] == std::string("--benchfullframe"))) {
+			_benchmark.fullFrame = true;
+		}
+		// Results of an earlier run to compare with, the process exits nonzero on a regression
+		if ((_args[i] == std::string("-bb")) || (_args[i] == std::string("--benchbaseline"))) {
+			if (_args.size() > i + 1) {
+				_benchmark.baseline = _args[i + 1];
+			}
+		}
+		// Regression threshold (in percent)
+		if ((_args[i] == std::string("-bth")) || (_args[i] == std::string("--benchthreshold"))) {
+			if (_args.size() > i + 1) {
+				double num = strtod(_args[i + 1], &numConvPtr);
+				if (numConvPtr != _args[i + 1]) {
+					_benchmark.threshold = num;
+				}
+				else {
+					std::cerr << "Benchmark regression threshold must be specified as a number!" << std::endl;
+				}
+			}
+		}
 	}
 	
+#if !defined(_WIN32)
+	// Only the Win32 window and surface are implemented
+	_settings.headless = true;
+#endif
+
+	// Without a window the benchmark drives the frame loop
+	if (_settings.headless) {
+		_benchmark.active = true;
+		vks::tools::errorModeSilent = true;
+	}
+
+	if (!_settings.traceFile.empty()) {
+		Trace::enable();
+	}
+	if (_settings.countAllocations) {
+		AllocationCounter::enable();
+	}
+
+	// A dump in the middle of a measurement would be in its results
+	if (_benchmark.active && !hitchGiven) {
+		_settings.hitchMs = 0.0f;
+	}
+	if (_settings.hitchMs > 0.0f) {
+		flightRecorder = new FlightRecorder(_settings.hitchMs, "hitch_");
+	}
+
+#if defined(_WIN32)
 	// Enable console if validation is active
 	// Debug message callback will output to it
 	if (this->_settings.validation)
@@ -658,12 +1151,13 @@ VulkanExampleBase::VulkanExampleBase(bool enableValidation)
 		setupConsole("Vulkan validation output");
 	}
 	setupDPIAwareness();
+#endif
 
 	sessionTime = new SessionTime();
 
 	uint32_t t0 = sessionTime->getTimeMS();
 
-	robotPark = new RobotPark(1000, t0);
+	robotPark = new RobotPark(_settings.robots, t0);
 	_zoom = -125.0f;
 	_title = "THE GAME";
 	// Values not set here are initialized in the base class constructor
@@ -674,6 +1168,19 @@ VulkanExampleBase::VulkanExampleBase(bool enableValidation)
 
 VulkanExampleBase::~VulkanExampleBase()
 {
+	// The frame loop has ended and the pool threads are idle
+	if (!_settings.traceFile.empty() && !Trace::save(_settings.traceFile)) {
+		std::cerr << "Could not write trace " << _settings.traceFile << std::endl;
+	}
+	// Benchmark runs printed theirs over the measured frames
+	if (_settings.memoryReport && !_benchmark.active) {
+		printMemoryReport({}, sessionTime->getTimeMS() / 1000.0);
+	}
+	if (_settings.countAllocations && !_benchmark.active && (_frameAllocations.frames > 0)) {
+		std::cout << "Allocations: " << _frameAllocations.allocatingFrames << " of " << _frameAllocations.frames << " frames allocated, "
+			<< double(_frameAllocations.allocations) / double(_frameAllocations.frames) << " per frame (max " << _frameAllocations.max << "), "
+			<< double(_frameAllocations.bytes) / double(_frameAllocations.frames) << " bytes per frame" << std::endl;
+	}
 
 	// Clean up used Vulkan resources 
 		// Note : Inherited destructor cleans up resources stored in base class
@@ -686,16 +1193,60 @@ VulkanExampleBase::~VulkanExampleBase()
 	vkDestroyDescriptorSetLayout(_device, arena_descriptorSetLayout, nullptr);
 
 	vkDestroyBuffer(_device, arena_vertices.buffer, nullptr);
-	vkFreeMemory(_device, arena_vertices.memory, nullptr);
+	vks::memory::freeMemory(_device, arena_vertices.memory);
 
 	vkDestroyBuffer(_device, arena_indices.buffer, nullptr);
-	vkFreeMemory(_device, arena_indices.memory, nullptr);
+	vks::memory::freeMemory(_device, arena_indices.memory);
 
 	vkDestroyBuffer(_device, arena_uniformBufferVS.buffer, nullptr);
-	vkFreeMemory(_device, arena_uniformBufferVS.memory, nullptr);
+	vkUnmapMemory(_device, arena_uniformBufferVS.memory);
+	vks::memory::freeMemory(_device, arena_uniformBufferVS.memory);
+
+	if (robotSimCompute != nullptr)
+	{
+		delete(robotSimCompute);
+		robotSimCompute = nullptr;
+	}
+	else
+	{
+		vkDestroyBuffer(_device, arena_instance_data.buffer, nullptr);
+		vkUnmapMemory(_device, arena_instance_data.memory);
+		vks::memory::freeMemory(_device, arena_instance_data.memory);
+	}
+
+	if (instanceCullCompute != nullptr)
+	{
+		delete(instanceCullCompute);
+		instanceCullCompute = nullptr;
+	}
+
+	if (gpuTimer != nullptr)
+	{
+		delete(gpuTimer);
+		gpuTimer = nullptr;
+	}
+
+	if (frameArena != nullptr)
+	{
+		delete(frameArena);
+		frameArena = nullptr;
+	}
+
+	if (flightRecorder != nullptr)
+	{
+		delete(flightRecorder);
+		flightRecorder = nullptr;
+	}
+
+	if (instanceCulling != nullptr)
+	{
+		delete(instanceCulling);
+		instanceCulling = nullptr;
 
-	vkDestroyBuffer(_device, arena_instance_data.buffer, nullptr);
-	vkFreeMemory(_device, arena_instance_data.memory, nullptr);
+		vkDestroyBuffer(_device, arena_indirect.buffer, nullptr);
+		vkUnmapMemory(_device, arena_indirect.memory);
+		vks::memory::freeMemory(_device, arena_indirect.memory);
+	}
 
 	if (textOverlay != nullptr)
 	{
@@ -703,19 +1254,38 @@ VulkanExampleBase::~VulkanExampleBase()
 		textOverlay = nullptr;
 	}
 
-	vkDestroySemaphore(_device, presentCompleteSemaphore, nullptr);
-	vkDestroySemaphore(_device, renderCompleteSemaphore, nullptr);
+	if (uploadService != nullptr)
+	{
+		delete(uploadService);
+		uploadService = nullptr;
+	}
 
-	for (auto& fence : _waitFences)
+	vkDestroyImage(_device, _textureImage, nullptr);
+	vks::memory::freeMemory(_device, _textureImageMemory);
+
+	for (frame_sync& frame : _lcFrameSync)
 	{
-		vkDestroyFence(_device, fence, nullptr);
+		vkDestroySemaphore(_device, frame.presentComplete, nullptr);
+		vkDestroySemaphore(_device, frame.renderComplete, nullptr);
+		vkDestroyFence(_device, frame.fence, nullptr);
 	}
 
 	delete robotPark;
 	robotPark = nullptr;
 
 	// Clean up Vulkan resources
-	_swapChain.cleanup();
+	if (_settings.headless)
+	{
+		for (vks::Framebuffer* target : _offscreen)
+		{
+			delete target;
+		}
+		_offscreen.clear();
+	}
+	else
+	{
+		_swapChain.cleanup();
+	}
 	if (_descriptorPool != VK_NULL_HANDLE)
 	{
 		vkDestroyDescriptorPool(_device, _descriptorPool, nullptr);
@@ -733,12 +1303,20 @@ VulkanExampleBase::~VulkanExampleBase()
 	}
 	vkDestroyImageView(_device, _depthStencil.view, nullptr);
 	vkDestroyImage(_device, _depthStencil.image, nullptr);
-	vkFreeMemory(_device, _depthStencil.mem, nullptr);
+	vks::memory::freeMemory(_device, _depthStencil.mem);
 
+	// Nothing changes after prepare() at the moment, the save only writes if a pipeline was added later
+	savePipelineCache();
 	vkDestroyPipelineCache(_device, _pipelineCache, nullptr);
 
 	vkDestroyCommandPool(_device, _cmdPool, nullptr);
 
+	// Frees the secondary command buffers
+	for (VkCommandPool pool : _threadCmdPools)
+	{
+		vkDestroyCommandPool(_device, pool, nullptr);
+	}
+
 	if (_settings.overlay) {
 		_UIOverlay.freeResources();
 	}
@@ -754,12 +1332,21 @@ VulkanExampleBase::~VulkanExampleBase()
 
 }
 
-// Update the text buffer displayed by the text overlay
+// Update the text buffer displayed by the text overlay on the acquired image
 void VulkanExampleBase::updateTextOverlay(void)
 {
-	textOverlay->beginTextUpdate();
+	TraceZone zone("updateTextOverlay");
+
+	textOverlay->beginTextUpdate(_currentBuffer);
+
+	// Publishes an empty draw for the image
+	if (!textOverlay->_visible)
+	{
+		textOverlay->endTextUpdate();
+		return;
+	}
 
-	textOverlay->addText(_title, 5.0f, 5.0f, TextOverlay::alignLeft);
+	textOverlay->addText(_title.c_str(), 5.0f, 5.0f, TextOverlay::alignLeft);
 
 	float arena_rotationX = arena_uboVS.modelMatrix[0][0];
 	float arena_rotationY = arena_uboVS.modelMatrix[1][0];
@@ -786,11 +1373,15 @@ void VulkanExampleBase::updateTextOverlay(void)
 
 	int nRay = int(fRay + .5f);
 
-	textOverlay->addText(_title, 5.0f, 5.0f, TextOverlay::alignLeft);
+	textOverlay->addText(_title.c_str(), 5.0f, 5.0f, TextOverlay::alignLeft);
 
-	std::stringstream ss;
-	ss << std::fixed << std::setprecision(2) << (_frameTimer * 1000.0f) << "ms (" << _lastFPS << " fps) " << _deviceProperties.deviceName << " rotation " << rAngle << " nRay " << nRay;
-	textOverlay->addText(ss.str(), 5.0f, 25.0f, TextOverlay::alignLeft);
+	// The lines are formatted into the frame arena, a text update does not touch the heap
+	textOverlay->addText(frameArena->format("%.2fms (%u fps) %s rotation %.2f nRay %d", _statsFrameTimer * 1000.0f, _lastFPS, _deviceProperties.deviceName, rAngle, nRay), 5.0f, 25.0f, TextOverlay::alignLeft);
+
+	if (gpuTimer != nullptr)
+	{
+		textOverlay->addText(frameArena->format("gpu %.2fms (compute %.2f, robots %.2f, text %.2f)", _statsGpuMs[GPU_PASS_TOTAL], _statsGpuMs[GPU_PASS_COMPUTE], _statsGpuMs[GPU_PASS_ROBOTS], _statsGpuMs[GPU_PASS_TEXT]), 5.0f, 45.0f, TextOverlay::alignLeft);
+	}
 
 	// Display current model view matrix
 	textOverlay->addText("model view matrix", (float)_width, 5.0f, TextOverlay::alignRight);
@@ -798,10 +1389,8 @@ void VulkanExampleBase::updateTextOverlay(void)
 
 	for (uint32_t i = 0; i < 4; i++)
 	{
-		ss.str("");
-		ss << std::fixed << std::setprecision(2) << std::showpos;
-		ss << arena_uboVS.modelMatrix[0][i] << " " << arena_uboVS.modelMatrix[1][i] << " " << arena_uboVS.modelMatrix[2][i] << " " << arena_uboVS.modelMatrix[3][i];
-		textOverlay->addText(ss.str(), (float)_width, 25.0f + (float)i * 20.0f, TextOverlay::alignRight);
+		const glm::mat4& m = arena_uboVS.modelMatrix;
+		textOverlay->addText(frameArena->format("%+.2f %+.2f %+.2f %+.2f", m[0][i], m[1][i], m[2][i], m[3][i]), (float)_width, 25.0f + (float)i * 20.0f, TextOverlay::alignRight);
 	}
 
 	glm::vec3 projected = glm::project(glm::vec3(34.6281052f, 20.0473022f, 11.0037498f), arena_uboVS.modelMatrix, arena_uboVS.projectionMatrix, glm::vec4(0, 0, (float)_width, (float)_height));
@@ -825,15 +1414,17 @@ void VulkanExampleBase::prepareTextOverlay()
 
 	textOverlay = new TextOverlay(
 		_vulkanDevice,
-		_queue,
-		_frameBuffers,
-		_swapChain.colorFormat,
-		_depthFormat,
+		uploadService,
+		_pipelineCache,
+		_renderPass,
+		_imageCount,
 		&_width,
 		&_height,
 		shaderStages
 	);
-	updateTextOverlay();
+	textOverlay->_visible = _settings.text;
+	// The text of an image is written by render() once the image is acquired
+	_lcTextVersion.assign(_imageCount, UINT64_MAX);
 }
 
 
@@ -940,21 +1531,37 @@ bool VulkanExampleBase::initVulkan()
 	// and encapsulates functions related to a device
 	_vulkanDevice = new vks::VulkanDevice(_physicalDevice);
 
-	VkResult res = _vulkanDevice->createLogicalDevice(_enabledFeatures, _enabledDeviceExtensions);
+	_memoryBudget = _memoryBudget && _vulkanDevice->extensionSupported(vks::memory::budgetExtension);
+	if (_memoryBudget) {
+		_enabledDeviceExtensions.push_back(vks::memory::budgetExtension);
+	}
+
+	// Headless runs need no swap chain extension, software implementations may not expose one
+	VkResult res = _vulkanDevice->createLogicalDevice(_enabledFeatures, _enabledDeviceExtensions, !_settings.headless, VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT | VK_QUEUE_TRANSFER_BIT);
 	if (res != VK_SUCCESS) {
 		vks::tools::exitFatal("Could not create Vulkan device: \n" + vks::tools::errorString(res), res);
 		return false;
 	}
 	_device = _vulkanDevice->logicalDevice;
 
+	// Every device allocation from here on is accounted
+	vks::memory::setup(_instance, _physicalDevice, _memoryBudget);
+
 	// Get a graphics queue from the device
 	vkGetDeviceQueue(_device, _vulkanDevice->queueFamilyIndices.graphics, 0, &_queue);
 
+	// Transfer queue for uploads, the graphics queue when there is no dedicated transfer family
+	vkGetDeviceQueue(_device, _vulkanDevice->queueFamilyIndices.transfer, 0, &_transferQueue);
+
 	// Find a suitable depth format
 	VkBool32 validDepthFormat = vks::tools::getSupportedDepthFormat(_physicalDevice, &_depthFormat);
 	assert(validDepthFormat);
 
-	_swapChain.connect(_instance, _physicalDevice, _device);
+	// The surface function pointers only exist with the surface extensions
+	if (!_settings.headless)
+	{
+		_swapChain.connect(_instance, _physicalDevice, _device);
+	}
 
 	// Create synchronization objects
 	VkSemaphoreCreateInfo semaphoreCreateInfo = vks::initializers::semaphoreCreateInfo();
@@ -978,6 +1585,7 @@ bool VulkanExampleBase::initVulkan()
 	return true;
 }
 
+#if defined(_WIN32)
 // Win32 : Sets up a console window and redirects standard output to it
 void VulkanExampleBase::setupConsole(std::string title)
 {
@@ -1246,6 +1854,7 @@ void VulkanExampleBase::handleMessages(HWND hWnd, UINT uMsg, WPARAM wParam, LPAR
 		break;
 	}
 }
+#endif
 
 
 void VulkanExampleBase::keyPressed(uint32_t) {}
@@ -1257,7 +1866,8 @@ void VulkanExampleBase::createCommandPool()
 {
 	VkCommandPoolCreateInfo cmdPoolInfo = {};
 	cmdPoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-	cmdPoolInfo.queueFamilyIndex = _swapChain.queueNodeIndex;
+	// Family of _queue, there is no swap chain to pick one in headless mode
+	cmdPoolInfo.queueFamilyIndex = _vulkanDevice->queueFamilyIndices.graphics;
 	cmdPoolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
 	VK_CHECK_RESULT(vkCreateCommandPool(_device, &cmdPoolInfo, nullptr, &_cmdPool));
 }
@@ -1302,7 +1912,7 @@ void VulkanExampleBase::staticSetupDepthStencil(VkDevice device, VkFormat depthF
 	vkGetImageMemoryRequirements(device, depthStencil.image, &memReqs);
 	mem_alloc.allocationSize = memReqs.size;
     mem_alloc.memoryTypeIndex = vulkanDevice->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-	VK_CHECK_RESULT(vkAllocateMemory(device, &mem_alloc, nullptr, &depthStencil.mem));
+	VK_CHECK_RESULT(vks::memory::allocateMemory(device, &mem_alloc, &depthStencil.mem));
 	VK_CHECK_RESULT(vkBindImageMemory(device, depthStencil.image, depthStencil.mem, 0));
 
 	depthStencilView.image = depthStencil.image;
@@ -1313,27 +1923,28 @@ void VulkanExampleBase::staticSetupDepthStencil(VkDevice device, VkFormat depthF
 
 // Prepare vertex and index buffers for indexed triangles
 // Also uploads them to device local memory using staging and initializes vertex input and attribute binding to match the vertex shader
-void VulkanExampleBase::arena_prepareVertices()
+// Arena geometry, plain CPU work that can run on any thread
+void VulkanExampleBase::arena_generateGeometry(std::vector<arena_vertex>& lcVertex, std::vector<uint32_t>& lcIndex)
 {
-
-	// VmaMemoryUsage
-	// VMA_MEMORY_USAGE_CPU_TO_GPU
-
-
 	// Setup vertices
 
-	std::vector<arena_vertex> lcVertex;
-
 	// create_cube_arena(lcVertex);
 	create_single_cube(lcVertex);
 
-	uint32_t vertexBufferSize = static_cast<uint32_t>(lcVertex.size()) * sizeof(arena_vertex);
+	arena_robotRadius = bounding_radius(lcVertex);
 
 	uint32_t num_cubes = uint32_t(lcVertex.size() / 8);
 
-	std::vector<uint32_t> lcIndex;
-
 	setup_indices(lcIndex, num_cubes);
+}
+
+void VulkanExampleBase::arena_prepareVertices(const std::vector<arena_vertex>& lcVertex, const std::vector<uint32_t>& lcIndex)
+{
+
+	// VmaMemoryUsage
+	// VMA_MEMORY_USAGE_CPU_TO_GPU
+
+	uint32_t vertexBufferSize = static_cast<uint32_t>(lcVertex.size()) * sizeof(arena_vertex);
 
 	arena_indices.count = static_cast<uint32_t>(lcIndex.size());
 	uint32_t indexBufferSize = arena_indices.count * sizeof(uint32_t);
@@ -1343,39 +1954,9 @@ void VulkanExampleBase::arena_prepareVertices()
 	// Static data like vertex and index buffer should be stored on the device memory 
 	// for optimal (and fastest) access by the GPU
 	//
-	// To achieve this we use so-called "staging buffers" :
-	// - Create a buffer that's visible to the host (and can be mapped)
-	// - Copy the data to this buffer
-	// - Create another buffer that's local on the device (VRAM) with the same size
-	// - Copy the data from the host to the device using a command buffer
-	// - Delete the host visible (staging) buffer
-	// - Use the device local buffers for rendering
-
-	struct StagingBuffer {
-		VkDeviceMemory memory;
-		VkBuffer buffer;
-	};
-
-
-	StagingBuffer vertices_stagingBuffer;
-	StagingBuffer indices_stagingBuffer;
-	// StagingBuffer instance_stagingBuffer;
-
-	//  Vertex buffer
-
-	// Create a host-visible buffer to copy the vertex data to (staging buffer)
-
-
-	VK_CHECK_RESULT(_vulkanDevice->createBuffer(
-		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		vertexBufferSize,
-		&vertices_stagingBuffer.buffer,
-		&vertices_stagingBuffer.memory,
-		lcVertex.data()));
-
-
-	// Create a device local buffer to which the (host local) vertex data will be copied (below) and which will be used for rendering
+	// The upload service copies the data into staging buffers and batches the copies
+	// to the device local buffers on the transfer queue. The staging buffers are freed
+	// once the batch has completed.
 
 	VK_CHECK_RESULT(_vulkanDevice->createBuffer(
 		VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
@@ -1384,22 +1965,6 @@ void VulkanExampleBase::arena_prepareVertices()
 		&arena_vertices.buffer,
 		&arena_vertices.memory));
 
-
-	// Index buffer
-
-	// Copy index data to a buffer visible to the host (staging buffer)
-
-	VK_CHECK_RESULT(_vulkanDevice->createBuffer(
-		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		indexBufferSize,
-		&indices_stagingBuffer.buffer,
-		&indices_stagingBuffer.memory,
-		lcIndex.data()));
-
-	// Create destination buffer with device only visibility
-
-
 	VK_CHECK_RESULT(_vulkanDevice->createBuffer(
 		VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
 		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
@@ -1407,53 +1972,17 @@ void VulkanExampleBase::arena_prepareVertices()
 		&arena_indices.buffer,
 		&arena_indices.memory));
 
-
-
-	// Buffer copies have to be submitted to a queue, so we need a command buffer for them
-	// Note: Some devices offer a dedicated transfer queue (with only the transfer bit set) that may be faster when doing lots of copies
-	{
-		VkCommandBuffer copyCmd = getCommandBuffer(true);
-
-		// Put buffer region copies into command buffer
-		VkBufferCopy copyRegion = {};
-
-		// Vertex buffer
-		copyRegion.size = vertexBufferSize;
-		vkCmdCopyBuffer(copyCmd, vertices_stagingBuffer.buffer, arena_vertices.buffer, 1, &copyRegion);
-
-		// Index buffer
-		copyRegion.size = indexBufferSize;
-		vkCmdCopyBuffer(copyCmd, indices_stagingBuffer.buffer, arena_indices.buffer, 1, &copyRegion);
-
-		// Instance data
-		//copyRegion.size = instanceBufferSize;
-		//vkCmdCopyBuffer(copyCmd, instance_stagingBuffer.buffer, arena_instance_data.buffer, 1, &copyRegion);
-
-		// Flushing the command buffer will also submit it to the queue and uses a fence to ensure that all commands have been executed before returning
-		flushCommandBuffer(copyCmd);
-	}
-
-	// Destroy staging buffers
-	// Note: Staging buffer must not be deleted before the copies have been submitted and executed
-	vkDestroyBuffer(_device, vertices_stagingBuffer.buffer, nullptr);
-	vkFreeMemory(_device, vertices_stagingBuffer.memory, nullptr);
-	vkDestroyBuffer(_device, indices_stagingBuffer.buffer, nullptr);
-	vkFreeMemory(_device, indices_stagingBuffer.memory, nullptr);
-
-	//vkDestroyBuffer(device, instance_stagingBuffer.buffer, nullptr);
-	//vkFreeMemory(device, instance_stagingBuffer.memory, nullptr);
-
-
+	uploadService->uploadBuffer(arena_vertices.buffer, 0, lcVertex.data(), vertexBufferSize, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
+	uploadService->uploadBuffer(arena_indices.buffer, 0, lcIndex.data(), indexBufferSize, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_INDEX_READ_BIT);
 }
 
 
-void VulkanExampleBase::arena_updateUniformBuffers()
+// Keys pan the arena camera for every frame they are held
+void VulkanExampleBase::arena_updateCamera()
 {
-	// Update matrices
-	arena_uboVS.projectionMatrix = glm::perspective(glm::radians(35.0f), (float)_width / (float)_height, 0.1f, 4096.0f);
-
-	arena_uboVS.modelMatrix = glm::mat4(1.0f);
-
+	if (!_camera.moving()) {
+		return;
+	}
 
 	if (_camera.keys.up) {
 		y_center -= 0.01f;
@@ -1471,29 +2000,69 @@ void VulkanExampleBase::arena_updateUniformBuffers()
 		x_center += 0.01f;
 	}
 
+	viewChanged();
+}
 
+// View dependent part of the arena uniforms, reaches the GPU through arena_writeUniformBuffer.
+// Only rebuilt when the camera version has moved on
+void VulkanExampleBase::arena_updateUniformBuffers()
+{
+	if (_matricesVersion == _version.camera) {
+		return;
+	}
+
+	_matricesVersion = _version.camera;
+
+	// Update matrices
+	arena_uboVS.projectionMatrix = glm::perspective(glm::radians(35.0f), (float)_width / (float)_height, 0.1f, 4096.0f);
+
+	arena_uboVS.modelMatrix = glm::mat4(1.0f);
 
 	arena_uboVS.viewMatrix = glm::lookAt(glm::vec3(x_center, y_center, 150), glm::vec3(x_center, y_center, 0), glm::vec3(0, 1, 0));
 
+	// The model matrix is identity, so these planes are in world (park) space
+	_frustum.update(arena_uboVS.projectionMatrix * arena_uboVS.viewMatrix);
 
-	float ms = float(sessionTime->getTimeMS());
+	for (uint32_t i = 0; i < 6; i++)
+	{
+		arena_uboVS.frustumPlanes[i] = _frustum.planes[i];
+	}
+}
 
-	// Set color params
-	arena_uboVS.colorParams = glm::vec4(ms, 0, 0, 0);
+// Sets the per frame values and copies the block into the slice of image iImage. The image's
+// previous frame must have completed, the slice is then no longer read by the GPU
+void VulkanExampleBase::arena_writeUniformBuffer(uint32_t iImage)
+{
+	uint32_t t = sessionTime->getTimeMS();
 
+	// Rebase the instance records before the time since their epoch loses float precision.
+	// Every robot is rewritten, robotsim.comp moves its state over using the epoch in y
+	if (t - robotPark->epoch() >= INSTANCE_EPOCH_PERIOD) {
+		robotPark->set_epoch(t);
+	}
 
-	// Map uniform buffer and update it
+	float ms = float(t - robotPark->epoch());
 
-	uint8_t* pData;
+	// Set color params
+	arena_uboVS.colorParams = glm::vec4(ms, float(robotPark->epoch()), 0, 0);
 
-	VK_CHECK_RESULT(vkMapMemory(_device, arena_uniformBufferVS.memory, 0, sizeof(arena_uboVS), 0, (void**)&pData));
+	if (_settings.compact) {
+		// Re-encode the whole stream before a record would be extrapolated past its tile
+		if (t - arena_instance_tile.t >= INSTANCE_TILE_PERIOD) {
+			robotPark->get_instance_tile(arena_instance_tile, t, INSTANCE_TILE_PERIOD);
+			robotPark->set_all_dirty();
+		}
 
-	memcpy(pData, &arena_uboVS, sizeof(arena_uboVS));
+		arena_uboVS.tileParams = glm::vec4(
+			float(arena_instance_tile.origin[0]),
+			float(arena_instance_tile.origin[1]),
+			float(arena_instance_tile.step),
+			float(t - arena_instance_tile.t));
+	}
 
-	// Unmap after data has been copied
-	// Note: Since we requested a host coherent memory type for the uniform buffer, the write is instantly visible to the GPU
 
-	vkUnmapMemory(_device, arena_uniformBufferVS.memory);
+	// Note: Since we requested a host coherent memory type for the uniform buffer, the write is instantly visible to the GPU
+	memcpy(arena_uniformBufferVS.mapped + iImage * arena_uniformBufferVS.sliceSize, &arena_uboVS, sizeof(arena_uboVS));
 }
 
 
@@ -1511,8 +2080,13 @@ void VulkanExampleBase::arena_prepareUniformBuffers()
 	allocInfo.allocationSize = 0;
 	allocInfo.memoryTypeIndex = 0;
 
+	// One slice per swap chain image, dynamic offsets must be multiples of minUniformBufferOffsetAlignment
+	const VkDeviceSize alignment = _deviceProperties.limits.minUniformBufferOffsetAlignment;
+
+	arena_uniformBufferVS.sliceSize = (sizeof(arena_uboVS) + alignment - 1) / alignment * alignment;
+
 	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-	bufferInfo.size = sizeof(arena_uboVS);
+	bufferInfo.size = arena_uniformBufferVS.sliceSize * _imageCount;
 	// This buffer will be used as a uniform buffer
 	bufferInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
 
@@ -1527,16 +2101,26 @@ void VulkanExampleBase::arena_prepareUniformBuffers()
 	// Note: This may affect performance so you might not want to do this in a real world application that updates buffers on a regular base
 	allocInfo.memoryTypeIndex = getMemoryTypeIndex(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
 	// Allocate memory for the uniform buffer
-	VK_CHECK_RESULT(vkAllocateMemory(_device, &allocInfo, nullptr, &(arena_uniformBufferVS.memory)));
+	VK_CHECK_RESULT(vks::memory::allocateMemory(_device, &allocInfo, &(arena_uniformBufferVS.memory)));
 	// Bind memory to buffer
 	VK_CHECK_RESULT(vkBindBufferMemory(_device, arena_uniformBufferVS.buffer, arena_uniformBufferVS.memory, 0));
 
 	// Store information in the uniform's descriptor that is used by the descriptor set
+	// The range covers one slice, the dynamic offset picks the slice
 	arena_uniformBufferVS.descriptor.buffer = arena_uniformBufferVS.buffer;
 	arena_uniformBufferVS.descriptor.offset = 0;
 	arena_uniformBufferVS.descriptor.range = sizeof(arena_uboVS);
 
+	// Mapped once instead of every frame
+	VK_CHECK_RESULT(vkMapMemory(_device, arena_uniformBufferVS.memory, 0, VK_WHOLE_SIZE, 0, (void**)&arena_uniformBufferVS.mapped));
+
 	arena_updateUniformBuffers();
+
+	// Every slice is valid before its image is first rendered
+	for (uint32_t iImage = 0; iImage < _imageCount; ++iImage)
+	{
+		arena_writeUniformBuffer(iImage);
+	}
 }
 
 
@@ -1662,13 +2246,13 @@ VkPipeline VulkanExampleBase::arena_createPipeline(VkRenderPass rpass, VkPipelin
 	vertexInputBinding[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
 
 	vertexInputBinding[1].binding = 1;
-	vertexInputBinding[1].stride = sizeof(instance_data);
+	vertexInputBinding[1].stride = uint32_t(instance_stride());
 	vertexInputBinding[1].inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
 
 
 
 	// Inpute attribute bindings describe shader attribute locations and memory layouts
-	std::array<VkVertexInputAttributeDescription, 3> vertexInputAttributs;
+	std::array<VkVertexInputAttributeDescription, 4> vertexInputAttributs;
 	// These match the following shader layout (see triangle.vert):
 	//	layout (location = 0) in vec3 inPos;
 	//	layout (location = 1) in vec3 inColor;
@@ -1692,13 +2276,30 @@ VkPipeline VulkanExampleBase::arena_createPipeline(VkRenderPass rpass, VkPipelin
 	vertexInputAttributs[2].format = VK_FORMAT_R32G32B32A32_SFLOAT;
 	vertexInputAttributs[2].offset = offsetof(instance_data, data);
 
+	uint32_t attributeCount = 3;
+
+	if (_settings.compact) {
+		// triangle_compact.vert:
+		//	layout (location = 2) in vec2 instancePos;
+		//	layout (location = 3) in vec2 instanceVel;
+		// Position steps are read as integer valued floats, velocities as half floats
+		vertexInputAttributs[2].format = VK_FORMAT_R16G16_SSCALED;
+		vertexInputAttributs[2].offset = offsetof(compact_instance_data, pos);
+
+		vertexInputAttributs[3].binding = 1;
+		vertexInputAttributs[3].location = 3;
+		vertexInputAttributs[3].format = VK_FORMAT_R16G16_SFLOAT;
+		vertexInputAttributs[3].offset = offsetof(compact_instance_data, vel);
+
+		attributeCount = 4;
+	}
 
 	// Vertex input state used for pipeline creation
 	VkPipelineVertexInputStateCreateInfo vertexInputState = {};
 	vertexInputState.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
 	vertexInputState.vertexBindingDescriptionCount = uint32_t(vertexInputBinding.size());
 	vertexInputState.pVertexBindingDescriptions = vertexInputBinding.data();
-	vertexInputState.vertexAttributeDescriptionCount = 3;
+	vertexInputState.vertexAttributeDescriptionCount = attributeCount;
 	vertexInputState.pVertexAttributeDescriptions = vertexInputAttributs.data();
 
 	// Shaders
@@ -1709,7 +2310,7 @@ VkPipeline VulkanExampleBase::arena_createPipeline(VkRenderPass rpass, VkPipelin
 	// Set pipeline stage for this shader
 	shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
 	// Load binary SPIR-V shader
-	shaderStages[0].module = loadSPIRVShader(getAssetPath() + "shaders/triangle/vert.spv");
+	shaderStages[0].module = loadSPIRVShader(getAssetPath() + (_settings.compact ? "shaders/triangle/vert_compact.spv" : "shaders/triangle/vert.spv"));
 	// Main entry point for the shader
 	shaderStages[0].pName = "main";
 	assert(shaderStages[0].module != VK_NULL_HANDLE);
@@ -1771,13 +2372,19 @@ void VulkanExampleBase::windowResize()
 	_width = _destWidth;
 	_height = _destHeight;
 
+	// The per image state was sized for the old swap chain
+	const uint32_t imageCount = _imageCount;
+
 	setupSwapChain();
 
 	// Recreate the frame buffers
 	vkDestroyImageView(_device, _depthStencil.view, nullptr);
 	vkDestroyImage(_device, _depthStencil.image, nullptr);
-	vkFreeMemory(_device, _depthStencil.mem, nullptr);
-    staticSetupDepthStencil(_device, _depthFormat, _width, _height, _depthStencil, _vulkanDevice);
+	vks::memory::freeMemory(_device, _depthStencil.mem);
+	{
+		MemoryScope scope(MEMORY_FRAMEBUFFERS);
+		staticSetupDepthStencil(_device, _depthFormat, _width, _height, _depthStencil, _vulkanDevice);
+	}
 	for (uint32_t i = 0; i < _frameBuffers.size(); i++) {
 		vkDestroyFramebuffer(_device, _frameBuffers[i], nullptr);
 	}
@@ -1793,6 +2400,12 @@ void VulkanExampleBase::windowResize()
 	// references to the recreated frame buffer
 	destroyCommandBuffers();
 	createCommandBuffers();
+
+	// The recreated swap chain may hold a different number of images
+	if (_imageCount != imageCount) {
+		resizeImageResources();
+	}
+
 	buildCommandBuffers();
 
 	vkDeviceWaitIdle(_device);
@@ -1859,77 +2472,236 @@ void VulkanExampleBase::initSwapchain()
 void VulkanExampleBase::setupSwapChain()
 {
 	_swapChain.create(&_width, &_height, _settings.vsync);
+	_imageCount = _swapChain.imageCount;
+	_colorFormat = _swapChain.colorFormat;
+}
+
+// Headless mode renders into one color image per frame in flight, frame slot i always renders image i.
+// The images take the place of the swap chain images, the depth buffer stays shared
+void VulkanExampleBase::setupOffscreen()
+{
+	_imageCount = _settings.framesInFlight;
+	_colorFormat = HEADLESS_COLOR_FORMAT;
+
+	vks::AttachmentCreateInfo attachmentInfo = {};
+	attachmentInfo.width = _width;
+	attachmentInfo.height = _height;
+	attachmentInfo.layerCount = 1;
+	attachmentInfo.format = _colorFormat;
+	// Transfer source so a finished frame can be copied out
+	attachmentInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+
+	_offscreen.resize(_imageCount);
+
+	for (vks::Framebuffer*& target : _offscreen)
+	{
+		target = new vks::Framebuffer(_vulkanDevice);
+		// Frame buffers are created with the arena render pass by setupFrameBuffer, the wrapper only owns the attachment
+		target->framebuffer = VK_NULL_HANDLE;
+		target->renderPass = VK_NULL_HANDLE;
+		target->sampler = VK_NULL_HANDLE;
+		target->width = _width;
+		target->height = _height;
+		target->addAttachment(attachmentInfo);
+	}
 }
 
 void VulkanExampleBase::OnUpdateUIOverlay(vks::UIOverlay *overlay) {}
 
+void VulkanExampleBase::acquireFrame()
+{
+	frame_sync& frame = _lcFrameSync[_frameIndex];
+
+	// The slot's semaphores can be reused once its previous submission has completed
+	{
+		TraceZone zone("wait frame fence");
+		VK_CHECK_RESULT(vkWaitForFences(_device, 1, &frame.fence, VK_TRUE, UINT64_MAX));
+	}
+
+	if (_settings.headless)
+	{
+		// Offscreen images have no presentation engine holding them, the slot's fence covers its image
+		_currentBuffer = _frameIndex % _imageCount;
+	}
+	else
+	{
+		// Get next image in the swap chain (back/front buffer)
+		TraceZone zone("acquire image");
+		VK_CHECK_RESULT(_swapChain.acquireNextImage(frame.presentComplete, &_currentBuffer));
+	}
+
+	// A frame from another slot may still render to this image and read its command buffers and buffer copies
+	VkFence& imageFence = _imageFences[_currentBuffer];
+
+	if ((imageFence != VK_NULL_HANDLE) && (imageFence != frame.fence))
+	{
+		TraceZone zone("wait image fence");
+		VK_CHECK_RESULT(vkWaitForFences(_device, 1, &imageFence, VK_TRUE, UINT64_MAX));
+	}
+
+	imageFence = frame.fence;
+
+	VK_CHECK_RESULT(vkResetFences(_device, 1, &frame.fence));
+}
+
 void VulkanExampleBase::draw()
 {
-	// Get next image in the swap chain (back/front buffer)
-	VK_CHECK_RESULT(_swapChain.acquireNextImage(presentCompleteSemaphore, &_currentBuffer));
+	TraceZone zone("draw");
 
-	// Use a fence to wait until the command buffer has finished execution before using it again
-	VK_CHECK_RESULT(vkWaitForFences(_device, 1, &_waitFences[_currentBuffer], VK_TRUE, UINT64_MAX));
-	VK_CHECK_RESULT(vkResetFences(_device, 1, &_waitFences[_currentBuffer]));
+	frame_sync& frame = _lcFrameSync[_frameIndex];
 
 	// Pipeline stage at which the queue submission will wait (via pWaitSemaphores)
 	VkPipelineStageFlags waitStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	// Headless frames are neither acquired nor presented
+	uint32_t semaphoreCount = _settings.headless ? 0 : 1;
 	// The submit info structure specifices a command buffer queue submission batch
 	VkSubmitInfo submitInfo = {};
 	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 	submitInfo.pWaitDstStageMask = &waitStageMask;									// Pointer to the list of pipeline stages that the semaphore waits will occur at
-	submitInfo.pWaitSemaphores = &presentCompleteSemaphore;							// Semaphore(s) to wait upon before the submitted command buffer starts executing
-	submitInfo.waitSemaphoreCount = 1;												// One wait semaphore																				
-	submitInfo.pSignalSemaphores = &renderCompleteSemaphore;						// Semaphore(s) to be signaled when command buffers have completed
-	submitInfo.signalSemaphoreCount = 1;											// One signal semaphore
+	submitInfo.pWaitSemaphores = &frame.presentComplete;							// Semaphore(s) to wait upon before the submitted command buffer starts executing
+	submitInfo.waitSemaphoreCount = semaphoreCount;									// One wait semaphore
+	submitInfo.pSignalSemaphores = &frame.renderComplete;							// Semaphore(s) to be signaled when command buffers have completed
+	submitInfo.signalSemaphoreCount = semaphoreCount;								// One signal semaphore
 	submitInfo.pCommandBuffers = &_drawCmdBuffers[_currentBuffer];					// Command buffers(s) to execute in this batch (submission)
-	submitInfo.commandBufferCount = 1;												// One command buffer
+	submitInfo.commandBufferCount = 1;												// One command buffer, the text overlay is drawn inside it
 
+	// Submit to the graphics queue passing the frame's fence, the CPU only waits on it when the slot comes round again
+	{
+		TraceZone zone("submit");
+		VK_CHECK_RESULT(vkQueueSubmit(_queue, 1, &submitInfo, frame.fence));
+	}
+
+	// Present the current buffer to the swap chain
+	// Pass the semaphore signaled by the command buffer submission from the submit info as the wait semaphore for swap chain presentation
+	// This ensures that the image is not presented to the windowing system until all commands have been submitted
+	if (!_settings.headless)
+	{
+		TraceZone zone("present");
+		VK_CHECK_RESULT(_swapChain.queuePresent(_queue, _currentBuffer, frame.renderComplete));
+	}
 
+	_frameIndex = (_frameIndex + 1) % uint32_t(_lcFrameSync.size());
+}
 
 
-	if (textOverlay->_visible)
+void VulkanExampleBase::render()
+{
+	if (!_prepared)
+		return;
+
+	TraceZone zone("render");
+
+	allocation_count frameStart = AllocationCounter::total();
+
+	uploadService->collect();
+	_benchmark.stage(FRAME_STAGE_UPLOAD);
+
+	arena_updateCamera();
+	arena_updateUniformBuffers();
+	_benchmark.stage(FRAME_STAGE_CAMERA);
+
+	// The gpu simulation advances the park inside the draw command buffer
+	if (robotSimCompute == nullptr)
 	{
-		VK_CHECK_RESULT(vkQueueSubmit(_queue, 1, &submitInfo, VK_NULL_HANDLE));
+		uint32_t ms = sessionTime->getTimeMS();
 
-		VkSubmitInfo submitInfo_text = {};
-		submitInfo_text.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-		submitInfo_text.commandBufferCount = 1;
-		submitInfo_text.pCommandBuffers = &textOverlay->_cmdBuffers[_currentBuffer];
+		robotPark->advance(ms);
 
-		VK_CHECK_RESULT(vkQueueSubmit(_queue, 1, &submitInfo_text, _waitFences[_currentBuffer]));
-		VK_CHECK_RESULT(vkQueueWaitIdle(_queue));
+		// Re-sorting moves every robot, the uploads below then rewrite the whole stream
+		if (_settings.morton && (ms - _reorderTime >= ROBOTPARK_REORDER_PERIOD))
+		{
+			robotPark->reorder(_threadPool);
+			_reorderTime = ms;
+		}
+	}
+	_benchmark.stage(FRAME_STAGE_SIM);
 
+	acquireFrame();
+	_benchmark.stage(FRAME_STAGE_PRESENT_WAIT);
+
+	// The image's previous frame has completed, so its timestamps can be read without waiting
+	if ((gpuTimer != nullptr) && gpuTimer->read(_currentBuffer))
+	{
+		_benchmark.gpuPasses(gpuTimer->_ms);
 	}
-	else
+
+	// The image's previous frame has completed, its copies of the per image data can be rewritten.
+	// The uniforms go first, an epoch or compact tile rebase marks every robot dirty and the cull reads the time
+	arena_writeUniformBuffer(_currentBuffer);
+	_benchmark.stage(FRAME_STAGE_UPLOAD);
+
+	if (robotSimCompute == nullptr)
 	{
-		// Submit to the graphics queue passing a wait fence
-		VK_CHECK_RESULT(vkQueueSubmit(_queue, 1, &submitInfo, _waitFences[_currentBuffer]));
+		Trace::counter("dirty robots", robotPark->dirty_count());
+
+		if (instanceCulling != nullptr)
+		{
+			update_culled_instanced_buffer();
+		}
+		else
+		{
+			update_instanced_buffer();
+		}
 	}
+	_benchmark.stage(FRAME_STAGE_INSTANCES);
 
+	// The image's text slice is rebuilt when it was built from older inputs or the visibility changed
+	uint64_t textVersion = textOverlay->_visible ? std::max(_version.camera, _version.stats) : 0;
 
+	if (_lcTextVersion[_currentBuffer] != textVersion)
+	{
+		updateTextOverlay();
+		_lcTextVersion[_currentBuffer] = textVersion;
+	}
+	_benchmark.stage(FRAME_STAGE_OVERLAY);
 
-	// Present the current buffer to the swap chain
-	// Pass the semaphore signaled by the command buffer submission from the submit info as the wait semaphore for swap chain presentation
-	// This ensures that the image is not presented to the windowing system until all commands have been submitted
-	VK_CHECK_RESULT(_swapChain.queuePresent(_queue, _currentBuffer, renderCompleteSemaphore));
-}
+	draw();
+	_benchmark.stage(FRAME_STAGE_SUBMIT);
 
+	if (gpuTimer != nullptr)
+	{
+		gpuTimer->submitted(_currentBuffer);
+	}
 
-void VulkanExampleBase::render()
+	if (_settings.countAllocations)
+	{
+		countFrameAllocations(frameStart);
+	}
+
+	Trace::counter("frame arena KB", double(frameArena->used()) / 1024.0);
+	frameArena->endFrame();
+}
+
+void VulkanExampleBase::countFrameAllocations(const allocation_count& frameStart)
 {
-	if (!_prepared)
-		return;
+	allocation_count frameEnd = AllocationCounter::total();
+	uint64_t allocations = frameEnd.allocations - frameStart.allocations;
+	uint64_t bytes = frameEnd.bytes - frameStart.bytes;
 
-	uint32_t ms = sessionTime->getTimeMS();
+	Trace::counter("frame allocations", double(allocations));
+	_benchmark.allocations(allocations, bytes);
 
-	robotPark->advance(ms);
+	_frameAllocations.frames++;
+	_frameAllocations.allocatingFrames += (allocations > 0) ? 1 : 0;
+	_frameAllocations.allocations += allocations;
+	_frameAllocations.bytes += bytes;
+	_frameAllocations.max = std::max(_frameAllocations.max, allocations);
 
-	draw();
+	if (_settings.allocationAssert && (allocations > 0) && (_frameAllocations.frames > ALLOCATION_WARMUP_FRAMES))
+	{
+		std::string message = "Frame " + std::to_string(_frameAllocations.frames) + " allocated " + std::to_string(allocations) + " times (" + std::to_string(bytes) + " bytes)";
+		// exitFatal skips the destructor, the trace shows the zones that allocated
+		if (!_settings.traceFile.empty() && Trace::save(_settings.traceFile)) {
+			message += ", see the zone allocations in " + _settings.traceFile;
+		} else {
+			message += ", run with -trace <file.json> to see the zones that allocated";
+		}
+		vks::tools::exitFatal(message, BENCHMARK_EXIT_REGRESSION);
+	}
 }
 
 // A single render pass is set up with vkCreateRenderPass.
-void VulkanExampleBase::staticSetupRenderPass(VkDevice device, VulkanSwapChain swapChain, VkFormat depthFormat, VkRenderPass& renderPass)
+void VulkanExampleBase::staticSetupRenderPass(VkDevice device, VkFormat colorFormat, VkImageLayout colorFinalLayout, VkFormat depthFormat, VkRenderPass& renderPass)
 {
     // Descriptors for the attachments used by this renderpass
     std::array<VkAttachmentDescription, 2> attachmentDescriptions = {};
@@ -1937,14 +2709,14 @@ void VulkanExampleBase::staticSetupRenderPass(VkDevice device, VulkanSwapChain s
     // Color attachment
     VkAttachmentDescription a;
 
-    a.format = swapChain.colorFormat;									// Use the color format selected by the swapchain
+    a.format = colorFormat;											// Use the color format selected by the swapchain or the headless targets
     a.samples = VK_SAMPLE_COUNT_1_BIT;									// We don't use multi sampling in this example
     a.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;							    // Clear this attachment at the start of the render pass
     a.storeOp = VK_ATTACHMENT_STORE_OP_STORE;							// Keep it's contents after the render pass is finished (for displaying it)
     a.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;					// We don't use stencil, so don't care for load
     a.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;				// Same for store
     a.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;						// Layout at render pass start. Initial doesn't matter, so we use undefined
-    a.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;					// Layout to which the attachment is transitioned when the render pass is finished
+    a.finalLayout = colorFinalLayout;									// Layout to which the attachment is transitioned when the render pass is finished
 
     attachmentDescriptions[0] = a;
     // As we want to present the color buffer to the swapchain, we transition to PRESENT_KHR	
@@ -2025,33 +2797,143 @@ void VulkanExampleBase::staticSetupRenderPass(VkDevice device, VulkanSwapChain s
 
 void VulkanExampleBase::viewChanged()
 {
-	// This function is called by the base example class each time the view is changed by user input
-	arena_updateUniformBuffers();
+	TraceZone zone("viewChanged");
+
+	// This function is called by the base example class each time the view is changed by user input or a resize
+	// The stages that depend on the view rebuild on their next use
+	_version.camera = ++_versionClock;
+}
+
+// The vertex shader extrapolates robot positions from the instance data, so a robot only
+// has to be rewritten when its velocity changes. Every swap chain image has its own copy of
+// the stream, the dirty ranges are queued for all of them and the acquired image's queue is
+// copied into its region, flushing just those ranges. An epoch or compact tile rebase marks every robot dirty.
+void VulkanExampleBase::update_instanced_buffer() {
+
+	TraceZone zone("update_instanced_buffer");
+
+	const VkDeviceSize atomSize = _deviceProperties.limits.nonCoherentAtomSize;
+
+	const VkDeviceSize stride = instance_stride();
+
+	if (robotPark->dirty_count() > 0) {
+
+		// Clean robots closer than one non-coherent atom are rewritten rather than splitting the flush
+		uint32_t maxGap = uint32_t(std::max<VkDeviceSize>(1, atomSize / stride));
+
+		frame_vector<dirty_range> lcDirtyRange(frameArena);
+		robotPark->get_dirty_ranges(lcDirtyRange, maxGap);
+
+		for (tracked_vector<dirty_range, MEMORY_INSTANCES>& pending : _lcPendingRange) {
+			pending.insert(pending.end(), lcDirtyRange.begin(), lcDirtyRange.end());
+		}
+
+		robotPark->clear_dirty();
+	}
+
+	tracked_vector<dirty_range, MEMORY_INSTANCES>& pending = _lcPendingRange[_currentBuffer];
+
+	if (pending.empty()) {
+		return;
+	}
+
+	const VkDeviceSize regionBase = _currentBuffer * arena_instance_data.regionSize;
+
+	frame_vector<VkMappedMemoryRange> lcFlushRange(frameArena);
+	lcFlushRange.reserve(pending.size());
+
+	for (const dirty_range& r : pending) {
+
+		write_instance_data(_currentBuffer, r.first, r.count);
+
+		if (arena_instance_data.coherent) {
+			continue;
+		}
+
+		// Regions start and end on nonCoherentAtomSize, so aligning within the region is enough
+		VkDeviceSize begin = (r.first * stride) / atomSize * atomSize;
+		VkDeviceSize end = ((r.first + r.count) * stride + atomSize - 1) / atomSize * atomSize;
 
-	uint32_t ms = sessionTime->getTimeMS();
+		VkMappedMemoryRange mappedRange = vks::initializers::mappedMemoryRange();
+		mappedRange.memory = arena_instance_data.memory;
+		mappedRange.offset = regionBase + begin;
+		mappedRange.size = end - begin;
 
-	if (ms % 115 == 0) {
-		update_instanced_buffer();
+		lcFlushRange.push_back(mappedRange);
 	}
-	updateTextOverlay();
+
+	_benchmark.stage(FRAME_STAGE_INSTANCES);
+
+	if (!lcFlushRange.empty()) {
+		VK_CHECK_RESULT(vkFlushMappedMemoryRanges(_device, uint32_t(lcFlushRange.size()), lcFlushRange.data()));
+	}
+
+	_benchmark.stage(FRAME_STAGE_UPLOAD);
+
+	pending.clear();
 }
 
-void VulkanExampleBase::update_instanced_buffer() {
+// Writes robots [first, first + count) into region iRegion of the mapped instance buffer in the selected format
+void VulkanExampleBase::write_instance_data(uint32_t iRegion, uint32_t first, uint32_t count) {
+
+	char* pRegion = static_cast<char*>(arena_instance_data.mapped) + iRegion * arena_instance_data.regionSize;
+
+	if (_settings.compact) {
+		compact_instance_data* pInstance = reinterpret_cast<compact_instance_data*>(pRegion);
+		robotPark->get_compact_instance_data(pInstance + first, first, count, arena_instance_tile);
+	}
+	else {
+		instance_data* pInstance = reinterpret_cast<instance_data*>(pRegion);
+		robotPark->get_instance_data(pInstance + first, first, count);
+	}
+}
+
+VkDeviceSize VulkanExampleBase::instance_stride() {
+	return _settings.compact ? sizeof(compact_instance_data) : sizeof(instance_data);
+}
+
+// Culls the park against the camera frustum and refills the acquired image's region of the
+// instance buffer with the visible robots only. The draw reads the visible count from the
+// image's command in arena_indirect.
+void VulkanExampleBase::update_culled_instanced_buffer() {
 
-	std::vector<instance_data> lcInstance;
+	// Fold velocity changes into the cull copy, the buffer itself is rewritten below anyway
+	if (robotPark->dirty_count() > 0) {
 
-	robotPark->get_instance_data(lcInstance);
+		frame_vector<dirty_range> lcDirtyRange(frameArena);
+		robotPark->get_dirty_ranges(lcDirtyRange, 0);
 
-	uint32_t instanceBufferSize = static_cast<uint32_t>(lcInstance.size()) * sizeof(instance_data);
+		for (const dirty_range& r : lcDirtyRange) {
+			instance_data* pInstance = frameArena->allocate<instance_data>(r.count);
+			robotPark->get_instance_data(pInstance, r.first, r.count);
+			instanceCulling->set_instance_data(pInstance, r.first, r.count);
+		}
+
+		robotPark->clear_dirty();
+	}
 
-	uint8_t* pData;
+	// Cull at the time since the epoch the vertex shader will extrapolate to
+	uint32_t nVisible = instanceCulling->cull(_frustum.planes, arena_uboVS.colorParams.x, arena_robotRadius);
 
-	VK_CHECK_RESULT(vkMapMemory(_device, arena_instance_data.memory, 0, instanceBufferSize, 0, (void**)&pData));
+	const VkDeviceSize regionBase = _currentBuffer * arena_instance_data.regionSize;
 
-	memcpy(pData, lcInstance.data(), instanceBufferSize);
+	char* pRegion = static_cast<char*>(arena_instance_data.mapped) + regionBase;
 
-	// Unmap after data has been copied
-	vkUnmapMemory(_device, arena_instance_data.memory);
+	instanceCulling->get_visible_data(reinterpret_cast<instance_data*>(pRegion));
+
+	if (!arena_instance_data.coherent && nVisible > 0) {
+		const VkDeviceSize atomSize = _deviceProperties.limits.nonCoherentAtomSize;
+
+		VkDeviceSize end = (nVisible * sizeof(instance_data) + atomSize - 1) / atomSize * atomSize;
+
+		VkMappedMemoryRange mappedRange = vks::initializers::mappedMemoryRange();
+		mappedRange.memory = arena_instance_data.memory;
+		mappedRange.offset = regionBase;
+		mappedRange.size = end;
+		VK_CHECK_RESULT(vkFlushMappedMemoryRanges(_device, 1, &mappedRange));
+	}
+
+	arena_indirect.mapped[_currentBuffer].instanceCount = nVisible;
 }
 
 
@@ -2063,28 +2945,29 @@ void VulkanExampleBase::prepareSynchronizationPrimitives()
 	semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 	semaphoreCreateInfo.pNext = nullptr;
 
-	// Semaphore used to ensures that image presentation is complete before starting to submit again
-	VK_CHECK_RESULT(vkCreateSemaphore(_device, &semaphoreCreateInfo, nullptr, &presentCompleteSemaphore));
-
-	// Semaphore used to ensures that all commands submitted have been finished before submitting the image to the queue
-	VK_CHECK_RESULT(vkCreateSemaphore(_device, &semaphoreCreateInfo, nullptr, &renderCompleteSemaphore));
-
-	// Fences (Used to check draw command buffer completion)
+	// Fences (Used to check frame completion)
 	VkFenceCreateInfo fenceCreateInfo = {};
 	fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-	// Create in signaled state so we don't wait on first render of each command buffer
+	// Create in signaled state so we don't wait on the first use of each frame slot
 	fenceCreateInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-	_waitFences.resize(_drawCmdBuffers.size());
-	for (auto& fence : _waitFences)
+
+	_lcFrameSync.resize(_settings.framesInFlight);
+
+	for (frame_sync& frame : _lcFrameSync)
 	{
-		VK_CHECK_RESULT(vkCreateFence(_device, &fenceCreateInfo, nullptr, &fence));
+		VK_CHECK_RESULT(vkCreateSemaphore(_device, &semaphoreCreateInfo, nullptr, &frame.presentComplete));
+		VK_CHECK_RESULT(vkCreateSemaphore(_device, &semaphoreCreateInfo, nullptr, &frame.renderComplete));
+		VK_CHECK_RESULT(vkCreateFence(_device, &fenceCreateInfo, nullptr, &frame.fence));
 	}
+
+	// No image has been rendered yet
+	_imageFences.assign(_drawCmdBuffers.size(), VK_NULL_HANDLE);
 }
 
 
 // Command buffer
 
-void VulkanExampleBase::buildSingleCommandBuffer(VkCommandBuffer cmdBuffer, VkFramebuffer fb) {
+void VulkanExampleBase::buildSingleCommandBuffer(VkCommandBuffer cmdBuffer, VkFramebuffer fb, uint32_t iImage) {
 
 	VkCommandBufferBeginInfo cmdBufInfo = {};
 	cmdBufInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
@@ -2110,9 +2993,72 @@ void VulkanExampleBase::buildSingleCommandBuffer(VkCommandBuffer cmdBuffer, VkFr
 
 	VK_CHECK_RESULT(vkBeginCommandBuffer(cmdBuffer, &cmdBufInfo));
 
+	if (gpuTimer != nullptr)
+	{
+		gpuTimer->recordReset(cmdBuffer, iImage);
+		gpuTimer->recordWrite(cmdBuffer, iImage, GPU_TIMESTAMP_BEGIN, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+	}
+
+	// The image's uniform slice
+	uint32_t uboOffset = uint32_t(iImage * arena_uniformBufferVS.sliceSize);
+
+	// Advance and cull the robots before the render pass, dispatches are not allowed inside it
+	{
+		vks::debugmarker::Zone zone(cmdBuffer, "compute");
+
+		if (robotSimCompute != nullptr)
+		{
+			robotSimCompute->recordDispatch(cmdBuffer, uboOffset);
+		}
+
+		if (instanceCullCompute != nullptr)
+		{
+			// The CPU written stream has one region per image, the gpu simulation output is shared
+			VkDeviceSize instanceOffset = (robotSimCompute != nullptr) ? 0 : iImage * arena_instance_data.regionSize;
+
+			instanceCullCompute->recordDispatch(cmdBuffer, uint32_t(instanceOffset), uboOffset);
+		}
+	}
+
+	if (gpuTimer != nullptr)
+	{
+		gpuTimer->recordWrite(cmdBuffer, iImage, GPU_TIMESTAMP_COMPUTE, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+	}
+
 	// Start the first sub pass specified in our default render pass setup by the base class
-	// This will clear the color and depth attachment
-	vkCmdBeginRenderPass(cmdBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+	// This will clear the color and depth attachment. The draws are in the image's secondary command buffers
+	vkCmdBeginRenderPass(cmdBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+
+	vkCmdExecuteCommands(cmdBuffer, uint32_t(_secondaryCmdBuffers[iImage].size()), _secondaryCmdBuffers[iImage].data());
+
+	vkCmdEndRenderPass(cmdBuffer);
+
+	if (gpuTimer != nullptr)
+	{
+		gpuTimer->recordWrite(cmdBuffer, iImage, GPU_TIMESTAMP_END, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+	}
+
+	// Ending the render pass will add an implicit barrier transitioning the frame buffer color attachment to 
+	// VK_IMAGE_LAYOUT_PRESENT_SRC_KHR for presenting it to the windowing system
+
+	VK_CHECK_RESULT(vkEndCommandBuffer(cmdBuffer));
+
+}
+
+// Begins a secondary command buffer continuing subpass 0 of the arena render pass on image iImage.
+// Dynamic state is not inherited from the primary, viewport and scissor are set here
+void VulkanExampleBase::beginSecondaryCommandBuffer(VkCommandBuffer cmdBuffer, uint32_t iImage) {
+
+	VkCommandBufferInheritanceInfo inheritanceInfo = vks::initializers::commandBufferInheritanceInfo();
+	inheritanceInfo.renderPass = _renderPass;
+	inheritanceInfo.subpass = 0;
+	inheritanceInfo.framebuffer = _frameBuffers[iImage];
+
+	VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
+	cmdBufInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+	cmdBufInfo.pInheritanceInfo = &inheritanceInfo;
+
+	VK_CHECK_RESULT(vkBeginCommandBuffer(cmdBuffer, &cmdBufInfo));
 
 	// Update dynamic viewport state
 	VkViewport viewport = {};
@@ -2129,42 +3075,197 @@ void VulkanExampleBase::buildSingleCommandBuffer(VkCommandBuffer cmdBuffer, VkFr
 	scissor.offset.x = 0;
 	scissor.offset.y = 0;
 	vkCmdSetScissor(cmdBuffer, 0, 1, &scissor);
+}
 
-	// Bind descriptor sets describing shader binding points
+// Records robot batch iBatch of image iImage. Direct draws split the instances evenly over the
+// batches, indirect draws only know their count on the GPU and use a single batch
+void VulkanExampleBase::recordArenaBatch(VkCommandBuffer cmdBuffer, uint32_t iImage, uint32_t iBatch) {
 
-	vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, arena_pipelineLayout, 0, 1, &arena_descriptorSet, 0, nullptr);
+	beginSecondaryCommandBuffer(cmdBuffer, iImage);
 
+	// The marker region has to end before the command buffer does
+	{
+		vks::debugmarker::Zone zone(cmdBuffer, "robots");
 
-	// Bind the rendering pipeline
-	// The pipeline (state object) contains all states of the rendering pipeline, binding it will set all the states specified at pipeline creation time
-	vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, arena_pl);
+		// Bind descriptor sets describing shader binding points, the dynamic offset selects the image's uniform slice
 
-	// Bind triangle vertex buffer (contains position and colors)
-	VkDeviceSize offsets[1] = { 0 };
-	vkCmdBindVertexBuffers(cmdBuffer, 0, 1, &arena_vertices.buffer, offsets);
+		uint32_t uboOffset = uint32_t(iImage * arena_uniformBufferVS.sliceSize);
+		vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, arena_pipelineLayout, 0, 1, &arena_descriptorSet, 1, &uboOffset);
 
-	// Bind instance data
-	vkCmdBindVertexBuffers(cmdBuffer, 1, 1, &arena_instance_data.buffer, offsets);
 
-	// Bind triangle index buffer
-	vkCmdBindIndexBuffer(cmdBuffer, arena_indices.buffer, 0, VK_INDEX_TYPE_UINT32);
+		// Bind the rendering pipeline
+		// The pipeline (state object) contains all states of the rendering pipeline, binding it will set all the states specified at pipeline creation time
+		vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, arena_pl);
 
-	// Draw indexed triangle
-	vkCmdDrawIndexed(cmdBuffer, arena_indices.count, robotPark->instances(), 0, 0, 0);
+		// Bind triangle vertex buffer (contains position and colors)
+		VkDeviceSize offsets[1] = { 0 };
+		vkCmdBindVertexBuffers(cmdBuffer, 0, 1, &arena_vertices.buffer, offsets);
 
-	vkCmdEndRenderPass(cmdBuffer);
+		// Bind instance data, the CPU written stream has one region per image
+		VkBuffer instanceBuffer = arena_instance_data.buffer;
+		VkDeviceSize instanceOffset = 0;
 
-	// Ending the render pass will add an implicit barrier transitioning the frame buffer color attachment to 
-	// VK_IMAGE_LAYOUT_PRESENT_SRC_KHR for presenting it to the windowing system
+		if (instanceCullCompute != nullptr)
+		{
+			instanceBuffer = instanceCullCompute->_visibleBuffer;
+		}
+		else if (robotSimCompute != nullptr)
+		{
+			instanceBuffer = robotSimCompute->_instanceBuffer;
+		}
+		else
+		{
+			instanceOffset = iImage * arena_instance_data.regionSize;
+		}
+
+		vkCmdBindVertexBuffers(cmdBuffer, 1, 1, &instanceBuffer, &instanceOffset);
+
+		// Bind triangle index buffer
+		vkCmdBindIndexBuffer(cmdBuffer, arena_indices.buffer, 0, VK_INDEX_TYPE_UINT32);
+
+		// Draw indexed triangle
+		if (instanceCullCompute != nullptr)
+		{
+			// Instance count is written by cull.comp
+			vkCmdDrawIndexedIndirect(cmdBuffer, instanceCullCompute->_indirectBuffer, 0, 1, sizeof(VkDrawIndexedIndirectCommand));
+		}
+		else if (instanceCulling != nullptr)
+		{
+			// Visible instance count is only known when the frame is submitted
+			vkCmdDrawIndexedIndirect(cmdBuffer, arena_indirect.buffer, iImage * sizeof(VkDrawIndexedIndirectCommand), 1, sizeof(VkDrawIndexedIndirectCommand));
+		}
+		else
+		{
+			uint32_t instances = robotPark->instances();
+			uint32_t batchSize = (instances + _arenaBatchCount - 1) / _arenaBatchCount;
+			uint32_t first = std::min(iBatch * batchSize, instances);
+			uint32_t count = std::min(batchSize, instances - first);
+
+			if (count > 0)
+			{
+				vkCmdDrawIndexed(cmdBuffer, arena_indices.count, count, 0, 0, first);
+			}
+		}
+	}
+
+	VK_CHECK_RESULT(vkEndCommandBuffer(cmdBuffer));
+}
+
+// Text on top of the arena, the letter count is read from the overlay's indirect buffer
+void VulkanExampleBase::recordTextOverlay(VkCommandBuffer cmdBuffer, uint32_t iImage) {
+
+	beginSecondaryCommandBuffer(cmdBuffer, iImage);
+
+	// Executed after the robot batches, so this waits for their draws
+	if (gpuTimer != nullptr)
+	{
+		gpuTimer->recordWrite(cmdBuffer, iImage, GPU_TIMESTAMP_ROBOTS, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+	}
+
+	{
+		vks::debugmarker::Zone zone(cmdBuffer, "text");
+		textOverlay->recordDraw(cmdBuffer, iImage);
+	}
 
 	VK_CHECK_RESULT(vkEndCommandBuffer(cmdBuffer));
+}
+
+// Creates a command pool for every pool thread and the secondary command buffers of all images.
+// Secondary i of an image is allocated from, and always recorded by, thread i % threadCount
+void VulkanExampleBase::prepareRecordingThreads() {
+
+	const uint32_t threadCount = uint32_t(_threadPool.threads.size());
+
+	VkCommandPoolCreateInfo cmdPoolInfo = vks::initializers::commandPoolCreateInfo();
+	cmdPoolInfo.queueFamilyIndex = _vulkanDevice->queueFamilyIndices.graphics;
+	cmdPoolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+
+	_threadCmdPools.resize(threadCount);
+
+	for (VkCommandPool& pool : _threadCmdPools)
+	{
+		VK_CHECK_RESULT(vkCreateCommandPool(_device, &cmdPoolInfo, nullptr, &pool));
+	}
+
+	// Indirect draws take their instance count from the GPU and cannot be split
+	bool indirect = (instanceCullCompute != nullptr) || (instanceCulling != nullptr);
+
+	uint32_t maxBatches = std::max(1u, robotPark->instances() / ARENA_BATCH_MIN_INSTANCES);
+
+	_arenaBatchCount = indirect ? 1 : std::min(threadCount, maxBatches);
+
+	allocateSecondaryCommandBuffers();
+}
+
+// Secondary i of every image comes from the pool of thread i % threadCount
+void VulkanExampleBase::allocateSecondaryCommandBuffers() {
+
+	const uint32_t threadCount = uint32_t(_threadPool.threads.size());
+
+	// Robot batches, then the text overlay
+	const uint32_t secondaryCount = _arenaBatchCount + 1;
+
+	_secondaryCmdBuffers.resize(_drawCmdBuffers.size());
+
+	for (std::vector<VkCommandBuffer>& secondaries : _secondaryCmdBuffers)
+	{
+		secondaries.resize(secondaryCount);
+
+		for (uint32_t i = 0; i < secondaryCount; ++i)
+		{
+			VkCommandBufferAllocateInfo cmdBufAllocateInfo =
+				vks::initializers::commandBufferAllocateInfo(
+					_threadCmdPools[i % threadCount],
+					VK_COMMAND_BUFFER_LEVEL_SECONDARY,
+					1);
+
+			VK_CHECK_RESULT(vkAllocateCommandBuffers(_device, &cmdBufAllocateInfo, &secondaries[i]));
+		}
+	}
+}
+
+// Returns the secondaries to their thread pools, the device must be idle
+void VulkanExampleBase::freeSecondaryCommandBuffers() {
+
+	const uint32_t threadCount = uint32_t(_threadPool.threads.size());
+
+	for (std::vector<VkCommandBuffer>& secondaries : _secondaryCmdBuffers)
+	{
+		for (uint32_t i = 0; i < secondaries.size(); ++i)
+		{
+			vkFreeCommandBuffers(_device, _threadCmdPools[i % threadCount], 1, &secondaries[i]);
+		}
+	}
 
+	_secondaryCmdBuffers.clear();
 }
 
 // Build separate command buffers for every framebuffer image
+// The secondaries are recorded on the thread pool, each thread only touches its own command pool.
+// The primaries then execute them, they are small and recorded on the calling thread
 
 void VulkanExampleBase::buildCommandBuffers()
 {
+	const uint32_t threadCount = uint32_t(_threadPool.threads.size());
+
+	for (uint32_t iImage = 0; iImage < _secondaryCmdBuffers.size(); ++iImage)
+	{
+		for (uint32_t i = 0; i < _secondaryCmdBuffers[iImage].size(); ++i)
+		{
+			VkCommandBuffer cmdBuffer = _secondaryCmdBuffers[iImage][i];
+
+			if (i < _arenaBatchCount)
+			{
+				_threadPool.threads[i % threadCount]->addJob([=] { recordArenaBatch(cmdBuffer, iImage, i); });
+			}
+			else
+			{
+				_threadPool.threads[i % threadCount]->addJob([=] { recordTextOverlay(cmdBuffer, iImage); });
+			}
+		}
+	}
+
+	_threadPool.wait();
 
 	for (uint32_t iCmdBuffer = 0; iCmdBuffer < _drawCmdBuffers.size(); ++iCmdBuffer)
 	{
@@ -2172,17 +3273,16 @@ void VulkanExampleBase::buildCommandBuffers()
 		VkCommandBuffer cmdBuffer = _drawCmdBuffers[iCmdBuffer];
 		VkFramebuffer fb = _frameBuffers[iCmdBuffer];
 
-		buildSingleCommandBuffer(cmdBuffer, fb);
+		buildSingleCommandBuffer(cmdBuffer, fb, iCmdBuffer);
 	}
 }
 
-
 void VulkanExampleBase::setupDescriptorPool()
 {
 	// We need to tell the API the number of max. requested descriptors per type
 	VkDescriptorPoolSize typeCounts[1];
 	// This example only uses one descriptor type (uniform buffer) and only requests one descriptor of this type
-	typeCounts[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	typeCounts[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 	typeCounts[0].descriptorCount = 1;
 	// For additional types you need to add new entries in the type count list
 	// E.g. for two combined image samplers :
@@ -2210,25 +3310,18 @@ void VulkanExampleBase::arena_setupDescriptorSetLayout()
 
 
 
-	std::array<VkDescriptorSetLayoutBinding, 2> layoutBinding{};
+	// Instance data comes in through vertex buffer 1, not a descriptor
+	std::array<VkDescriptorSetLayoutBinding, 1> layoutBinding{};
 
 
-	// Binding 0: Uniform buffer (Vertex shader)
+	// Binding 0: Uniform buffer (Vertex shader), one slice per swap chain image
 
-	layoutBinding[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	layoutBinding[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 	layoutBinding[0].binding = 0;
 	layoutBinding[0].descriptorCount = 1;
 	layoutBinding[0].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 	layoutBinding[0].pImmutableSamplers = nullptr;
 
-	// Binding 1: Uniform buffer (Instanced data)
-
-	layoutBinding[1].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	layoutBinding[0].binding = 1;
-	layoutBinding[1].descriptorCount = 1;
-	layoutBinding[1].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
-	layoutBinding[1].pImmutableSamplers = nullptr;
-
 	VkDescriptorSetLayoutCreateInfo descriptorLayout = {};
 	descriptorLayout.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
 	descriptorLayout.pNext = nullptr;
@@ -2259,6 +3352,12 @@ void VulkanExampleBase::arena_setupDescriptorSet()
 
 	VK_CHECK_RESULT(vkAllocateDescriptorSets(_device, &allocInfo, &arena_descriptorSet));
 
+	arena_updateDescriptorSet();
+}
+
+// Points the set at the current uniform buffer, which a resize can recreate
+void VulkanExampleBase::arena_updateDescriptorSet()
+{
 	// Update the descriptor set determining the shader binding points
 	// For every binding point used in a shader there needs to be one
 	// descriptor set matching that binding point
@@ -2269,7 +3368,7 @@ void VulkanExampleBase::arena_setupDescriptorSet()
 	writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
 	writeDescriptorSet.dstSet = arena_descriptorSet;
 	writeDescriptorSet.descriptorCount = 1;
-	writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 	writeDescriptorSet.pBufferInfo = &arena_uniformBufferVS.descriptor;
 	// Binds this uniform buffer to binding point 0
 	writeDescriptorSet.dstBinding = 0;
@@ -2281,12 +3380,13 @@ void VulkanExampleBase::arena_setupDescriptorSet()
 // Note: Implementation of pure virtual function in the base class and called from within VulkanExampleBase::prepare
 void VulkanExampleBase::setupFrameBuffer()
 {
-	// Create a frame buffer for every image in the swapchain
-	_frameBuffers.resize(_swapChain.imageCount);
+	// Create a frame buffer for every image in the swapchain, or every offscreen image
+	_frameBuffers.resize(_imageCount);
 	for (size_t i = 0; i < _frameBuffers.size(); i++)
 	{
 		std::array<VkImageView, 2> attachments;
-		attachments[0] = _swapChain.buffers[i].view;									// Color attachment is the view of the swapchain image			
+		// Color attachment is the view of the swapchain image, or of the offscreen image when headless
+		attachments[0] = _settings.headless ? _offscreen[i]->attachments[0].view : _swapChain.buffers[i].view;
 		attachments[1] = _depthStencil.view;											// Depth/Stencil attachment is the same for all frame buffers			
 
 		VkFramebufferCreateInfo frameBufferCreateInfo = {};
@@ -2322,11 +3422,53 @@ void VulkanExampleBase::setupFrameBuffer()
 
 void VulkanExampleBase::prepare_instanced_buffer() {
 
-	std::vector<instance_data> lcInstance;
+	create_instance_buffer();
 
-	robotPark->get_instance_data(lcInstance);
+	const uint32_t imageCount = _imageCount;
 
-	uint32_t instanceBufferSize = static_cast<uint32_t>(lcInstance.size()) * sizeof(instance_data);
+	if (_settings.compact) {
+		robotPark->get_instance_tile(arena_instance_tile, sessionTime->getTimeMS(), INSTANCE_TILE_PERIOD);
+	}
+
+	// Initial upload of the whole park into every region, later frames only rewrite dirty robots
+	for (uint32_t iRegion = 0; iRegion < imageCount; ++iRegion) {
+		write_instance_data(iRegion, 0, robotPark->instances());
+	}
+
+	_lcPendingRange.resize(imageCount);
+
+	if (!arena_instance_data.coherent) {
+		VkMappedMemoryRange mappedRange = vks::initializers::mappedMemoryRange();
+		mappedRange.memory = arena_instance_data.memory;
+		mappedRange.offset = 0;
+		mappedRange.size = VK_WHOLE_SIZE;
+		VK_CHECK_RESULT(vkFlushMappedMemoryRanges(_device, 1, &mappedRange));
+	}
+
+	if (_settings.cull) {
+		// The cull keeps its own copy of every robot, the buffer is refilled with the visible ones each frame
+		instanceCulling = new InstanceCulling(robotPark->instances());
+
+		tracked_vector<instance_data, MEMORY_INSTANCES> lcInstance;
+		robotPark->get_instance_data(lcInstance);
+		instanceCulling->set_instance_data(lcInstance.data(), 0, robotPark->instances());
+	}
+
+	robotPark->clear_dirty();
+
+}
+
+// Creates and maps the instance buffer with one region per image, the regions are left unwritten
+void VulkanExampleBase::create_instance_buffer() {
+
+	// Regions are aligned for flushes and for the dynamic storage offset used by cull.comp
+	const VkDeviceSize alignment = std::max(_deviceProperties.limits.nonCoherentAtomSize, _deviceProperties.limits.minStorageBufferOffsetAlignment);
+
+	const uint32_t imageCount = _imageCount;
+
+	arena_instance_data.regionSize = (robotPark->instances() * instance_stride() + alignment - 1) / alignment * alignment;
+
+	VkDeviceSize instanceBufferSize = arena_instance_data.regionSize * imageCount;
 
 	VkMemoryRequirements memReqs;
 
@@ -2343,6 +3485,11 @@ void VulkanExampleBase::prepare_instanced_buffer() {
 
 	bufferInfo.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
 
+	// cull.comp reads the full instance stream as a storage buffer
+	if (_settings.gpucull) {
+		bufferInfo.usage |= VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+	}
+
 	// Create a new buffer
 	VK_CHECK_RESULT(vkCreateBuffer(_device, &bufferInfo, nullptr, &arena_instance_data.buffer));
 
@@ -2352,18 +3499,142 @@ void VulkanExampleBase::prepare_instanced_buffer() {
 
 	allocInfo.memoryTypeIndex = getMemoryTypeIndex(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
 	// Allocate memory for the uniform buffer
-	VK_CHECK_RESULT(vkAllocateMemory(_device, &allocInfo, nullptr, &(arena_instance_data.memory)));
+	VK_CHECK_RESULT(vks::memory::allocateMemory(_device, &allocInfo, &(arena_instance_data.memory)));
 	// Bind memory to buffer
 	VK_CHECK_RESULT(vkBindBufferMemory(_device, arena_instance_data.buffer, arena_instance_data.memory, 0));
 
-	update_instanced_buffer();
+	arena_instance_data.count = robotPark->instances();
+	arena_instance_data.size = allocInfo.allocationSize;
+	arena_instance_data.coherent = (_deviceMemoryProperties.memoryTypes[allocInfo.memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+
+	// The buffer stays mapped for the lifetime of the application
+	VK_CHECK_RESULT(vkMapMemory(_device, arena_instance_data.memory, 0, VK_WHOLE_SIZE, 0, &arena_instance_data.mapped));
+}
+
+void VulkanExampleBase::prepareInstanceCullCompute()
+{
+	VkPipelineShaderStageCreateInfo shaderStage = loadShader(getAssetPath() + "shaders/cull/cull.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+
+	// Culls whichever instance stream the arena draws, the CPU upload or the gpu simulation output
+	VkBuffer instanceBuffer = (robotSimCompute != nullptr) ? robotSimCompute->_instanceBuffer : arena_instance_data.buffer;
 
+	instanceCullCompute = new InstanceCullCompute(
+		_vulkanDevice,
+		_pipelineCache,
+		instanceBuffer,
+		robotPark->instances(),
+		arena_indices.count,
+		arena_robotRadius,
+		arena_uniformBufferVS.descriptor,
+		shaderStage
+	);
+}
+
+void VulkanExampleBase::prepare_indirect_buffer() {
+
+	const uint32_t imageCount = _imageCount;
+
+	VK_CHECK_RESULT(_vulkanDevice->createBuffer(
+		VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		imageCount * sizeof(VkDrawIndexedIndirectCommand),
+		&arena_indirect.buffer,
+		&arena_indirect.memory));
+
+	// Stays mapped, host coherent so the per frame instanceCount write needs no flush
+	VK_CHECK_RESULT(vkMapMemory(_device, arena_indirect.memory, 0, VK_WHOLE_SIZE, 0, (void**)&arena_indirect.mapped));
+
+	for (uint32_t i = 0; i < imageCount; ++i) {
+		arena_indirect.mapped[i].indexCount = arena_indices.count;
+		arena_indirect.mapped[i].instanceCount = 0;
+		arena_indirect.mapped[i].firstIndex = 0;
+		arena_indirect.mapped[i].vertexOffset = 0;
+		arena_indirect.mapped[i].firstInstance = 0;
+	}
+}
+
+void VulkanExampleBase::prepareRobotSimCompute()
+{
+	VkPipelineShaderStageCreateInfo shaderStage = loadShader(getAssetPath() + "shaders/robotsim/robotsim.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+
+	// Reads the session time from the arena uniform buffer, so that must exist first
+	robotSimCompute = new RobotSimCompute(
+		_vulkanDevice,
+		uploadService,
+		_pipelineCache,
+		robotPark,
+		arena_uniformBufferVS.descriptor,
+		shaderStage
+	);
+}
+
+// Every per image copy was sized by the swap chain image count. The device is idle, so the
+// copies are recreated empty and the next frame on each image rewrites its own.
+void VulkanExampleBase::resizeImageResources()
+{
+	_imageFences.assign(_imageCount, VK_NULL_HANDLE);
+	_lcTextVersion.assign(_imageCount, UINT64_MAX);
+
+	vkDestroyBuffer(_device, arena_uniformBufferVS.buffer, nullptr);
+	vkUnmapMemory(_device, arena_uniformBufferVS.memory);
+	vks::memory::freeMemory(_device, arena_uniformBufferVS.memory);
+	{
+		MemoryScope scope(MEMORY_ARENA);
+		arena_prepareUniformBuffers();
+	}
+	arena_updateDescriptorSet();
+
+	if (robotSimCompute == nullptr) {
+		vkDestroyBuffer(_device, arena_instance_data.buffer, nullptr);
+		vkUnmapMemory(_device, arena_instance_data.memory);
+		vks::memory::freeMemory(_device, arena_instance_data.memory);
+		{
+			MemoryScope scope(MEMORY_INSTANCES);
+			create_instance_buffer();
+		}
+
+		// No region holds any robot yet, the culled path refills its region every frame anyway
+		const dirty_range all = { 0, robotPark->instances() };
+		_lcPendingRange.assign(_imageCount, tracked_vector<dirty_range, MEMORY_INSTANCES>(1, all));
+	}
+
+	if (instanceCulling != nullptr) {
+		vkDestroyBuffer(_device, arena_indirect.buffer, nullptr);
+		vkUnmapMemory(_device, arena_indirect.memory);
+		vks::memory::freeMemory(_device, arena_indirect.memory);
+
+		MemoryScope scope(MEMORY_INSTANCES);
+		prepare_indirect_buffer();
+	}
+
+	if (instanceCullCompute != nullptr) {
+		VkBuffer instanceBuffer = (robotSimCompute != nullptr) ? robotSimCompute->_instanceBuffer : arena_instance_data.buffer;
+		instanceCullCompute->updateDescriptors(instanceBuffer, arena_uniformBufferVS.descriptor);
+	}
+
+	if (robotSimCompute != nullptr) {
+		robotSimCompute->updateDescriptors(arena_uniformBufferVS.descriptor);
+	}
+
+	{
+		MemoryScope scope(MEMORY_OVERLAY);
+		textOverlay->resize(_imageCount);
+	}
+
+	if (gpuTimer != nullptr) {
+		delete(gpuTimer);
+		gpuTimer = new GpuTimer(_vulkanDevice, _imageCount);
+	}
+
+	freeSecondaryCommandBuffers();
+	allocateSecondaryCommandBuffers();
 }
 
 
 
 VulkanExampleBase* vulkanExample;
 
+#if defined(_WIN32)
 LRESULT CALLBACK WndProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
 {
     if (vulkanExample != NULL)
@@ -2405,15 +3676,48 @@ int APIENTRY WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR pCmdLin
     load_numpy();
 
     for (size_t i = 0; i < __argc; i++) { VulkanExampleBase::_args.push_back(__argv[i]); };
+
+    // A sweep only starts the benchmark runs as child processes
+    vks::BenchmarkSweep sweep;
+    if (sweep.parse(VulkanExampleBase::_args)) {
+        return sweep.run();
+    }
+
+    vulkanExample = new VulkanExampleBase(ENABLE_VALIDATION);
+
+    vulkanExample->initVulkan();
+    if (!vulkanExample->_settings.headless)
+    {
+        vulkanExample->setupWindow(hInstance, WndProc);
+    }
+    vulkanExample->prepare();
+    vulkanExample->renderLoop();
+    int exitCode = vulkanExample->_benchmark.exitCode;
+    delete(vulkanExample);
+    return exitCode;
+}
+#else
+// Headless only, the benchmark drives the frame loop (see VulkanExampleBase::renderLoop)
+int main(const int argc, const char *argv[])
+{
+    for (int i = 0; i < argc; i++) { VulkanExampleBase::_args.push_back(argv[i]); };
+
+    // A sweep only starts the benchmark runs as child processes
+    vks::BenchmarkSweep sweep;
+    if (sweep.parse(VulkanExampleBase::_args)) {
+        return sweep.run();
+    }
+
     vulkanExample = new VulkanExampleBase(ENABLE_VALIDATION);
 
     vulkanExample->initVulkan();
-    vulkanExample->setupWindow(hInstance, WndProc);
     vulkanExample->prepare();
     vulkanExample->renderLoop();
+    int exitCode = vulkanExample->_benchmark.exitCode;
     delete(vulkanExample);
-    return 0;
+    return exitCode;
 }
+#endif
 
 
 
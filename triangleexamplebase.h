@@ -8,12 +8,14 @@
 
 #pragma once
 
+#if defined(_WIN32)
 #pragma comment(linker, "/subsystem:windows")
 
 #include <windows.h>
 #include <fcntl.h>
 #include <io.h>
 #include <ShellScalingAPI.h>
+#endif
 
 #include <iostream>
 #include <chrono>
@@ -37,14 +39,57 @@
 #include "VulkanInitializers.hpp"
 #include "VulkanDevice.hpp"
 #include "VulkanSwapChain.hpp"
+#include "VulkanFrameBuffer.hpp"
 #include "camera.hpp"
 #include "benchmark.hpp"
+#include "frustum.hpp"
 
 #include "SessionTime.h"
 #include "RobotPark.h"
+#include "UploadService.h"
 #include "TextOverlay.h"
-
-
+#include "RobotSimCompute.h"
+#include "InstanceCulling.h"
+#include "InstanceCullCompute.h"
+#include "StartupGraph.h"
+#include "GpuTimer.h"
+#include "Trace.h"
+#include "FlightRecorder.h"
+#include "AllocationCounter.h"
+#include "FrameArena.h"
+#include "MemoryAccounting.h"
+#include "VulkanMemory.h"
+
+
+
+// Smallest robot batch worth recording in its own secondary command buffer
+#define ARENA_BATCH_MIN_INSTANCES 256
+
+// Color format of the headless render targets, supported as color attachment by every implementation
+#define HEADLESS_COLOR_FORMAT VK_FORMAT_R8G8B8A8_UNORM
+
+// Pipeline cache loaded at startup and written back, relative to the working directory
+#define PIPELINE_CACHE_FILE "pipelinecache.bin"
+
+// Frames rendered before -allocassert expects a frame not to allocate, the first frames build
+// every image's text and fill the scratch lists
+#define ALLOCATION_WARMUP_FRAMES 60
+
+// Initial size of a frame arena slot. Slots grow to what the busiest frame needed, a frame that
+// rewrites every robot, after a reorder or a tile rebase, takes about 16 bytes per robot
+#define FRAMEARENA_SLOT_BYTES (64 << 10)
+
+// CPU stages of a frame timed by the benchmark, each covers the time since the previous stage ended
+enum frame_stage {
+	FRAME_STAGE_CAMERA,			// view change, camera and uniform matrices
+	FRAME_STAGE_SIM,			// robot park advance and reorder
+	FRAME_STAGE_PRESENT_WAIT,	// frame slot and image fences, swap chain acquire
+	FRAME_STAGE_INSTANCES,		// instance extraction and culling into the mapped buffer
+	FRAME_STAGE_UPLOAD,			// upload service, uniform slice and mapped range flushes
+	FRAME_STAGE_OVERLAY,		// text and UI overlay
+	FRAME_STAGE_SUBMIT,			// queue submit and present
+	FRAME_STAGE_COUNT
+};
 
 class VulkanExampleBase
 {
@@ -90,12 +135,17 @@ protected:
 	/** @brief Set of device extensions to be enabled for this example (must be set in the derived constructor) */
 	std::vector<const char*> _enabledDeviceExtensions;
 	std::vector<const char*> _enabledInstanceExtensions;
+	/** @brief True if the instance and device extensions for VK_EXT_memory_budget are enabled */
+	bool _memoryBudget = false;
 	/** @brief Logical device, application's view of the physical device (GPU) */
 	// todo: getter? should always point to VulkanDevice->device
 	VkDevice _device;
 	
 	// Handle to the device graphics queue that command buffers are submitted to
 	VkQueue _queue;
+
+	// Queue used by the upload service, same as _queue if the device has no dedicated transfer family
+	VkQueue _transferQueue;
 	
 	// Depth buffer format (selected during Vulkan initialization)
 	VkFormat _depthFormat;
@@ -131,14 +181,29 @@ protected:
 	
 	// List of shader modules created (stored for cleanup)
 	std::vector<VkShaderModule> _shaderModules;
+	std::mutex _shaderModuleMutex;
 	
-	// Pipeline cache object
+	// Pipeline cache object, shared by every pipeline of the application
 	VkPipelineCache _pipelineCache;
+
+	// Cache data last read from or written to PIPELINE_CACHE_FILE, a save is skipped while the cache still matches it
+	std::vector<uint8_t> _pipelineCacheData;
 	
 	// Wraps the swap chain to present images (framebuffers) to the windowing system
 	VulkanSwapChain _swapChain;
 
-	std::vector<VkFence> _waitFences;
+	// Color targets standing in for the swap chain images in headless mode, only their attachment is used
+	std::vector<vks::Framebuffer*> _offscreen;
+
+	// Number of swap chain or offscreen images, every per image resource is sized by it
+	uint32_t _imageCount = 0;
+
+	// Format of the color attachment, the swap chain's or HEADLESS_COLOR_FORMAT
+	VkFormat _colorFormat;
+
+	// Fence of the frame that last rendered each swap chain image, VK_NULL_HANDLE before first use.
+	// Borrowed from _lcFrameSync, guards the image's command buffers and buffer copies
+	std::vector<VkFence> _imageFences;
 public: 
 	
 	bool _prepared = false;
@@ -167,6 +232,38 @@ public:
 		bool vsync = false;
 		/** @brief Enable UI overlay */
 		bool overlay = false;
+		/** @brief Advance the robot park in a compute shader instead of on the CPU (-gpusim) */
+		bool gpusim = false;
+		/** @brief Frustum cull robots on the CPU and upload only the visible ones (-cull) */
+		bool cull = false;
+		/** @brief Frustum cull robots in a compute pre-pass feeding an indirect draw (-gpucull) */
+		bool gpucull = false;
+		/** @brief Upload robots as 8 byte quantized records instead of 16 byte floats (-compact) */
+		bool compact = false;
+		/** @brief Periodically sort robot storage into Morton order on a thread pool (-morton) */
+		bool morton = false;
+		/** @brief Number of frames the CPU may prepare while the GPU renders earlier ones, 1 to 3 (-frames <n>) */
+		uint32_t framesInFlight = 2;
+		/** @brief Render into offscreen images without a window or swap chain, frames are driven by the benchmark (-headless) */
+		bool headless = false;
+		/** @brief Print the startup step timings and their critical path (-startupreport) */
+		bool startupReport = false;
+		/** @brief Number of robots in the park (-robots <n>) */
+		uint32_t robots = 1000;
+		/** @brief Threads of the pool, 0 for one per hardware thread (-threads <n>) */
+		uint32_t threads = 0;
+		/** @brief Draw the text overlay, turned off to measure without it (-notext) */
+		bool text = true;
+		/** @brief Record trace zones and write them as Chrome trace events on exit (-trace <file.json>) */
+		std::string traceFile;
+		/** @brief Write the recent trace when a frame takes longer than this many ms, 0 to turn off. Off in benchmark runs unless given (-hitch <ms>) */
+		float hitchMs = 50.0f;
+		/** @brief Print host and device memory per subsystem and the device heap budgets on exit (-memreport) */
+		bool memoryReport = false;
+		/** @brief Count operator new calls per frame and per trace zone (-allocs) */
+		bool countAllocations = false;
+		/** @brief Exit with an error when a frame after the first ALLOCATION_WARMUP_FRAMES allocates, implies -allocs (-allocassert) */
+		bool allocationAssert = false;
 	} _settings;
 
 	VkClearColorValue _defaultClearColor = { { 0.025f, 0.025f, 0.025f, 1.0f } };
@@ -216,6 +313,9 @@ public:
 		uint32_t count;
 	} arena_indices;
 
+	// Radius of the robot mesh around its instance origin, the sphere both culls test
+	float arena_robotRadius;
+
 
 	// Instance data
 	struct
@@ -223,14 +323,74 @@ public:
 		VkDeviceMemory memory;
 		VkBuffer buffer;
 		uint32_t count;
+		VkDeviceSize size;
+		// One copy of the stream per swap chain image, command buffer i draws region i
+		VkDeviceSize regionSize;
+		// Persistently mapped, only the robots that changed velocity are rewritten
+		void* mapped;
+		bool coherent;
 	} arena_instance_data;
 
+	// Quantization frame of the compact instance stream, rebased every INSTANCE_TILE_PERIOD ms
+	instance_tile arena_instance_tile;
+
+	// Ranges each image's region has not received yet, written when the image is next rendered
+	std::vector<tracked_vector<dirty_range, MEMORY_INSTANCES>> _lcPendingRange;
+
+	// Set when culling, the instance buffer then holds only the visible robots
+	InstanceCulling* instanceCulling = nullptr;
+
+	// Workers for the robot park reorder and the secondary command buffer recording
+	vks::ThreadPool _threadPool;
+	// One command pool per pool thread, only used by its thread while recording
+	std::vector<VkCommandPool> _threadCmdPools;
+	// Secondary command buffers of the arena render pass per swap chain image: robot batches, then the text overlay
+	std::vector<std::vector<VkCommandBuffer>> _secondaryCmdBuffers;
+	// Number of robot batches recorded in parallel, 1 for indirect draws
+	uint32_t _arenaBatchCount = 1;
+	// Session time (ms) of the last reorder
+	uint32_t _reorderTime = 0;
+
+	// World space frustum of the arena camera, updated with the uniform buffer
+	vks::Frustum _frustum;
+
+	// Change tracking. An input records the value of _versionClock at its last change, a stage keeps
+	// the input version it was computed from and only recomputes when that differs
+	uint64_t _versionClock = 1;
+	struct {
+		// Arena camera position and viewport size
+		uint64_t camera = 1;
+		// Frame statistics shown by the text overlay, refreshed with the fps counter
+		uint64_t stats = 1;
+	} _version;
+	// Camera version of the arena_uboVS matrices and _frustum, UINT64_MAX before the first build
+	uint64_t _matricesVersion = UINT64_MAX;
+	// Per swap chain image, newest input version of the text in its overlay slice, 0 while hidden
+	std::vector<uint64_t> _lcTextVersion;
+	// Frame time shown by the text overlay
+	float _statsFrameTimer = 0.0f;
+	// GPU pass times shown by the text overlay, sampled with the frame time
+	double _statsGpuMs[GPU_PASS_COUNT] = {};
+
+	// Indirect draw arguments, one command per swap chain image. instanceCount is rewritten by the cull each frame
+	struct
+	{
+		VkDeviceMemory memory;
+		VkBuffer buffer;
+		VkDrawIndexedIndirectCommand* mapped;
+	} arena_indirect;
+
 
 	// Uniform buffer block object
+	// One slice per swap chain image, selected with a dynamic offset by the image's command buffer
 	struct {
 		VkDeviceMemory memory;
 		VkBuffer buffer;
 		VkDescriptorBufferInfo descriptor;
+		// sizeof(arena_uboVS) rounded up to minUniformBufferOffsetAlignment
+		VkDeviceSize sliceSize;
+		// Host coherent, mapped for the lifetime of the application
+		uint8_t* mapped;
 	}  arena_uniformBufferVS;
 
 	// For simplicity we use the same uniform block layout as in the shader:
@@ -240,6 +400,9 @@ public:
 	//		mat4 projectionMatrix;
 	//		mat4 modelMatrix;
 	//		mat4 viewMatrix;
+	//		vec4 colorParams;
+	//		vec4 frustumPlanes[6];
+	//		vec4 tileParams;
 	//	} ubo;
 	//
 	// This way we can just memcopy the ubo data to the ubo
@@ -248,7 +411,12 @@ public:
 		glm::mat4 projectionMatrix;
 		glm::mat4 modelMatrix;
 		glm::mat4 viewMatrix;
+		// ms since the instance epoch, the epoch (ms)
 		glm::vec4 colorParams;
+		// World space frustum, read by cull.comp
+		glm::vec4 frustumPlanes[6];
+		// Compact instance tile: origin xy, position step, ms since the tile reference time
+		glm::vec4 tileParams;
 	} arena_uboVS;
 
 	// The pipeline layout is used by a pipeline to access the descriptor sets 
@@ -271,17 +439,50 @@ public:
 	// Synchronization primitives
 	// Synchronization is an important concept of Vulkan that OpenGL mostly hid away. Getting this right is crucial to using Vulkan.
 
-	// Semaphores
-	// Used to coordinate operations within the graphics queue and ensure correct command ordering
-	VkSemaphore presentCompleteSemaphore;
-	VkSemaphore renderCompleteSemaphore;
-
-	// Fences
-	// Used to check the completion of queue operations (e.g. command buffer execution)
-	// std::vector<VkFence> waitFences;
+	// Semaphores and fence of one frame in flight
+	// The semaphores coordinate acquire, render and present on the queue, the fence tells the CPU when the slot can be reused
+	struct frame_sync {
+		// Signaled by the swap chain when the acquired image may be rendered to
+		VkSemaphore presentComplete;
+		// Signaled when the frame's command buffers have completed, waited on by the present
+		VkSemaphore renderComplete;
+		// Signaled when the frame's submission has completed
+		VkFence fence;
+	};
+
+	// Settings::framesInFlight slots, used round robin
+	std::vector<frame_sync> _lcFrameSync;
+	uint32_t _frameIndex = 0;
 
 	TextOverlay* textOverlay = nullptr;
 
+	// Batches startup uploads on the transfer queue
+	UploadService* uploadService = nullptr;
+
+	// Set when the robot park is simulated on the GPU, replaces arena_instance_data
+	RobotSimCompute* robotSimCompute = nullptr;
+
+	// Set when culling on the GPU, draws the visible buffer with its indirect command
+	InstanceCullCompute* instanceCullCompute = nullptr;
+
+	// Timestamps around the passes of the draw command buffers, null if the device has no timestamps
+	GpuTimer* gpuTimer = nullptr;
+
+	// Dumps the trace around slow frames, null if turned off
+	FlightRecorder* flightRecorder = nullptr;
+
+	// Transient data of the frame being rendered, one slot per frame in flight. Rewound at the end of render()
+	FrameArena* frameArena = nullptr;
+
+	// Operator new calls of the frames rendered so far (-allocs)
+	struct {
+		uint64_t frames = 0;
+		uint64_t allocatingFrames = 0;
+		uint64_t allocations = 0;
+		uint64_t bytes = 0;
+		uint64_t max = 0;
+	} _frameAllocations;
+
 
 
 
@@ -317,8 +518,10 @@ public:
 	} _mouseButtons;
 
 	// OS specific 
+#if defined(_WIN32)
 	HWND _window;
 	HINSTANCE _windowInstance;
+#endif
 
 	// Default ctor
 	VulkanExampleBase(bool enableValidation);
@@ -329,10 +532,12 @@ public:
 	// Setup the vulkan instance, enable required extensions and connect to the physical device (GPU)
 	bool initVulkan();
 
+#if defined(_WIN32)
 	void setupConsole(std::string title);
 	void setupDPIAwareness();
 	HWND setupWindow(HINSTANCE hinstance, WNDPROC wndproc);
 	void handleMessages(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam);
+#endif
 
 	/**
 	* Create the application wide Vulkan instance
@@ -342,32 +547,61 @@ public:
 	virtual VkResult createInstance(bool enableValidation);
 
 
-	static void staticSetupRenderPass(VkDevice device, VulkanSwapChain swapChain, VkFormat depthFormat, VkRenderPass& renderPass);
+	static void staticSetupRenderPass(VkDevice device, VkFormat colorFormat, VkImageLayout colorFinalLayout, VkFormat depthFormat, VkRenderPass& renderPass);
 
 	static void staticSetupDepthStencil(VkDevice device, VkFormat depthFormat, uint32_t width, uint32_t height, depthStencil_t& depthStencil, vks::VulkanDevice* vulkanDevice);
 
 	VkPipeline arena_createPipeline(VkRenderPass rpass, VkPipelineLayout pl_layout);
-	void arena_prepareVertices();
+	void arena_generateGeometry(std::vector<arena_vertex>& lcVertex, std::vector<uint32_t>& lcIndex);
+	void arena_prepareVertices(const std::vector<arena_vertex>& lcVertex, const std::vector<uint32_t>& lcIndex);
 	void arena_prepareUniformBuffers();
+	void arena_updateCamera();
 	void arena_updateUniformBuffers();
+	void arena_writeUniformBuffer(uint32_t iImage);
 
 	void updateTextOverlay();
 	void prepareTextOverlay();
 
+	// Memory per subsystem and the device heaps, allocation rates since previous over seconds
+	void printMemoryReport(const std::vector<memory_counters>& previous, double seconds);
+	// Adds the same to the benchmark results
+	void setBenchmarkMemory(const std::vector<memory_counters>& previous, double seconds);
+
+	// Counts the allocations of every thread since frameStart as one frame's
+	void countFrameAllocations(const allocation_count& frameStart);
+
 	void update_instanced_buffer();
+	void write_instance_data(uint32_t iRegion, uint32_t first, uint32_t count);
+	VkDeviceSize instance_stride();
+	void update_culled_instanced_buffer();
 
 	void prepareSynchronizationPrimitives();
-	void buildSingleCommandBuffer(VkCommandBuffer cmdBuffer, VkFramebuffer fb);
+	void buildSingleCommandBuffer(VkCommandBuffer cmdBuffer, VkFramebuffer fb, uint32_t iImage);
+	void beginSecondaryCommandBuffer(VkCommandBuffer cmdBuffer, uint32_t iImage);
+	void recordArenaBatch(VkCommandBuffer cmdBuffer, uint32_t iImage, uint32_t iBatch);
+	void recordTextOverlay(VkCommandBuffer cmdBuffer, uint32_t iImage);
+	void prepareRecordingThreads();
+	void allocateSecondaryCommandBuffers();
+	void freeSecondaryCommandBuffers();
 	void buildCommandBuffers();
 	void setupDescriptorPool();
 	void arena_setupDescriptorSetLayout();
 
 	void arena_setupDescriptorSet();
+	void arena_updateDescriptorSet();
 	void setupFrameBuffer();
 	void prepare_instanced_buffer();
+	void create_instance_buffer();
+	void prepareRobotSimCompute();
+	void prepare_indirect_buffer();
+	void prepareInstanceCullCompute();
+	// Rebuilds the per image copies and command buffers for a new swap chain image count
+	void resizeImageResources();
 
 	VkShaderModule loadSPIRVShader(std::string filename);
 
+	// Waits for the frame slot, acquires the next image and waits until that image's resources are free
+	void acquireFrame();
 	void draw();
 	void render();
 	// Called when view change occurs
@@ -402,6 +636,8 @@ public:
 	void initSwapchain();
 	// Create swap chain images
 	void setupSwapChain();
+	// Create the color targets used instead of the swap chain in headless mode
+	void setupOffscreen();
 
 	// Check if command buffers are valid (!= VK_NULL_HANDLE)
 	bool checkCommandBuffers();
@@ -409,7 +645,8 @@ public:
 	void createCommandBuffers();
 
 	uint32_t getMemoryTypeIndex(uint32_t typeBits, VkMemoryPropertyFlags properties);
-	void createTextureImage();
+	unsigned char* loadTexturePixels(int& texWidth, int& texHeight);
+	void createTextureImage(unsigned char* pixels, int texWidth, int texHeight);
 
 	// Destroy all command buffers and set their handles to VK_NULL_HANDLE
 	// May be necessary during runtime if options are toggled 
@@ -427,8 +664,11 @@ public:
 	// Creates and returns a new command buffer
 	VkCommandBuffer createCommandBuffer(VkCommandBufferLevel level, bool begin);
 	
-	// Create a cache pool for rendering pipelines
+	// Create a cache pool for rendering pipelines, seeded from PIPELINE_CACHE_FILE when it was written for this device
 	void createPipelineCache();
+	// Write the cache back to PIPELINE_CACHE_FILE if pipelines were added since it was loaded
+	void savePipelineCache();
+	bool validPipelineCache(const std::vector<uint8_t>& data);
 
 	// Prepare commonly used Vulkan functions
 	void prepare();